@@ -0,0 +1,287 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// detect_delim 基准测试辅助工具
+//   bench_tool gen <类型> <大小> <输出文件>      生成确定性测试数据，标准输出打印数据行数
+//   bench_tool run <结果文件> <版本> <命令名> <数据文件> -- <命令...>
+//                                                运行命令并记录耗时、吞吐量和峰值内存
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+// xorshift64* 伪随机数，固定种子保证每次生成的数据完全相同
+uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+unsigned rng_range(unsigned n) {
+    return (unsigned)(rng_next() % n);
+}
+
+int parse_size(const char* text, long long* size) {
+    char* endptr;
+    errno = 0;
+    double value = strtod(text, &endptr);
+    if (endptr == text || errno == ERANGE || !isfinite(value) || value <= 0) {
+        return -1;
+    }
+    switch (*endptr) {
+        case 'k': case 'K': value *= 1024.0; break;
+        case 'm': case 'M': value *= 1024.0 * 1024; break;
+        case 'g': case 'G': value *= 1024.0 * 1024 * 1024; break;
+        case '\0': break;
+        default: return -1;
+    }
+    // 单位后面不允许再有其他字符
+    if (*endptr && endptr[1] != '\0') {
+        return -1;
+    }
+    // 超出 long long 范围的值转换时是未定义行为，直接拒绝
+    if (value >= 9.2e18) {
+        return -1;
+    }
+    *size = (long long)value;
+    return 0;
+}
+
+// 窄表：6列TSV，约10%的行与上一行重复，便于测试去重
+int gen_narrow(char* line, char* prev, long long row) {
+    if (row == 0) {
+        return sprintf(line, "id\tsample\tgene\tchrom\tpos\tscore\n");
+    }
+    if (row > 1 && rng_range(10) == 0) {
+        strcpy(line, prev);
+        return (int)strlen(line);
+    }
+    return sprintf(line, "%lld\tS%05u\tGENE%04u\tchr%u\t%u\t%u.%04u\n", row, rng_range(20000), rng_range(5000),
+                   rng_range(22) + 1, rng_range(250000000), rng_range(100), rng_range(10000));
+}
+
+// 窄表换用其他分隔符，用于比较各分隔符的解析内核；重复行复制自上一行，已经替换过
+int narrow_with(char* line, char* prev, long long row, const char* sep) {
+    char tsv[8192];
+    int n = gen_narrow(tsv, prev, row);
+    int out = 0;
+    for (int i = 0; i < n; i++) {
+        if (tsv[i] == '\t') {
+            for (const char* s = sep; *s; s++) line[out++] = *s;
+        } else {
+            line[out++] = tsv[i];
+        }
+    }
+    line[out] = '\0';
+    return out;
+}
+
+int gen_narrow_comma(char* line, char* prev, long long row) { return narrow_with(line, prev, row, ","); }
+int gen_narrow_semicolon(char* line, char* prev, long long row) { return narrow_with(line, prev, row, ";"); }
+int gen_narrow_pipe(char* line, char* prev, long long row) { return narrow_with(line, prev, row, "|"); }
+int gen_narrow_space(char* line, char* prev, long long row) { return narrow_with(line, prev, row, " "); }
+int gen_narrow_multispace(char* line, char* prev, long long row) { return narrow_with(line, prev, row, "   "); }
+
+// 宽表：200列整数CSV
+int gen_wide(char* line, char* prev, long long row) {
+    (void)prev;
+    int n = 0;
+    for (int c = 0; c < 200; c++) {
+        if (row == 0) {
+            n += sprintf(line + n, "%sc%d", c ? "," : "", c + 1);
+        } else {
+            n += sprintf(line + n, "%s%u", c ? "," : "", rng_range(100000));
+        }
+    }
+    line[n++] = '\n';
+    line[n] = '\0';
+    return n;
+}
+
+// 带引号的CSV：描述字段中含有逗号
+int gen_quoted(char* line, char* prev, long long row) {
+    static const char* words[] = { "kinase", "receptor", "binding", "protein", "membrane", "factor", "domain", "alpha" };
+    (void)prev;
+    if (row == 0) {
+        return sprintf(line, "id,name,description,value\n");
+    }
+    return sprintf(line, "%lld,\"GENE%04u\",\"%s %s, %s\",%u.%02u\n", row, rng_range(5000), words[rng_range(8)],
+                   words[rng_range(8)], words[rng_range(8)], rng_range(1000), rng_range(100));
+}
+
+// 纯数值TSV：10列浮点数
+int gen_numeric(char* line, char* prev, long long row) {
+    (void)prev;
+    int n = 0;
+    for (int c = 0; c < 10; c++) {
+        if (row == 0) {
+            n += sprintf(line + n, "%sv%d", c ? "\t" : "", c + 1);
+        } else {
+            n += sprintf(line + n, "%s%s%u.%06u", c ? "\t" : "", rng_range(4) ? "" : "-", rng_range(1000), rng_range(1000000));
+        }
+    }
+    line[n++] = '\n';
+    line[n] = '\0';
+    return n;
+}
+
+// FASTA：每条序列300-3000bp，每行60个碱基
+int gen_fasta(char* line, char* prev, long long row) {
+    static const char bases[] = "ACGT";
+    (void)prev;
+    int n = sprintf(line, ">seq%lld_GENE%04u sample=S%05u\n", row, rng_range(5000), rng_range(20000));
+    int length = 300 + (int)rng_range(2700);
+    for (int i = 0; i < length; i++) {
+        line[n++] = bases[rng_next() >> 62];
+        if (i % 60 == 59 || i == length - 1) line[n++] = '\n';
+    }
+    line[n] = '\0';
+    return n;
+}
+
+int generate(const char* kind, long long target, const char* output) {
+    int (*gen)(char*, char*, long long) = NULL;
+    if (strcmp(kind, "narrow") == 0) gen = gen_narrow;
+    else if (strcmp(kind, "narrow_comma") == 0) gen = gen_narrow_comma;
+    else if (strcmp(kind, "narrow_semicolon") == 0) gen = gen_narrow_semicolon;
+    else if (strcmp(kind, "narrow_pipe") == 0) gen = gen_narrow_pipe;
+    else if (strcmp(kind, "narrow_space") == 0) gen = gen_narrow_space;
+    else if (strcmp(kind, "narrow_multispace") == 0) gen = gen_narrow_multispace;
+    else if (strcmp(kind, "wide") == 0) gen = gen_wide;
+    else if (strcmp(kind, "quoted") == 0) gen = gen_quoted;
+    else if (strcmp(kind, "numeric") == 0) gen = gen_numeric;
+    else if (strcmp(kind, "fasta") == 0) gen = gen_fasta;
+    else {
+        fprintf(stderr, "未知的数据类型: %s (可用: narrow narrow_<comma|semicolon|pipe|space|multispace> wide quoted numeric fasta)\n", kind);
+        return 1;
+    }
+
+    FILE* file = fopen(output, "wb");
+    if (!file) {
+        fprintf(stderr, "无法创建文件: %s\n", output);
+        return 1;
+    }
+    setvbuf(file, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    char line[8192];
+    char prev[8192] = "";
+    long long written = 0;
+    long long rows = 0;
+    int is_fasta = (gen == gen_fasta);
+    
+    // FASTA没有表头，每条记录算一行
+    for (long long row = is_fasta ? 1 : 0; written < target; row++) {
+        int n = gen(line, prev, row);
+        fwrite(line, 1, n, file);
+        memcpy(prev, line, n + 1);
+        written += n;
+        if (row > 0) rows++;
+    }
+    fclose(file);
+    printf("%lld\n", rows);
+    return 0;
+}
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int run_command(int argc, char* argv[]) {
+    // argv: 结果文件 版本 命令名 数据文件 -- 命令...
+    if (argc < 6 || strcmp(argv[4], "--") != 0) {
+        fprintf(stderr, "用法: bench_tool run <结果文件> <版本> <命令名> <数据文件> -- <命令...>\n");
+        return 1;
+    }
+    const char* results = argv[0];
+    const char* version = argv[1];
+    const char* label = argv[2];
+    const char* dataset = argv[3];
+    char** command = argv + 5;
+
+    struct stat st;
+    long long bytes = (stat(dataset, &st) == 0) ? (long long)st.st_size : 0;
+    long long rows = 0;
+    char rows_path[4096];
+    snprintf(rows_path, sizeof(rows_path), "%s.rows", dataset);
+    FILE* rows_file = fopen(rows_path, "r");
+    if (rows_file) {
+        if (fscanf(rows_file, "%lld", &rows) != 1) rows = 0;
+        fclose(rows_file);
+    }
+
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        // 丢弃命令输出，只测量处理本身
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            close(devnull);
+        }
+        execvp(command[0], command);
+        _exit(127);
+    }
+    
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return 1;
+    }
+    double seconds = now_seconds() - start;
+    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    double mb_per_s = seconds > 0 ? bytes / 1048576.0 / seconds : 0;
+    double rows_per_s = seconds > 0 ? rows / seconds : 0;
+    const char* dataset_name = strrchr(dataset, '/') ? strrchr(dataset, '/') + 1 : dataset;
+
+    FILE* out = fopen(results, "a");
+    if (!out) {
+        fprintf(stderr, "无法写入结果文件: %s\n", results);
+        return 1;
+    }
+    fprintf(out, "%s\t%s\t%s\t%lld\t%lld\t%.4f\t%.1f\t%.0f\t%ld\t%d\n", version, label, dataset_name, bytes, rows,
+            seconds, mb_per_s, rows_per_s, usage.ru_maxrss, exit_code);
+    fclose(out);
+    
+    fprintf(stderr, "%-22s %-24s %9.3fs %9.1f MB/s %12.0f 行/s %9ld KB%s\n", label, dataset_name, seconds, mb_per_s,
+            rows_per_s, usage.ru_maxrss, exit_code ? "  (失败)" : "");
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 5 && strcmp(argv[1], "gen") == 0) {
+        long long size;
+        if (parse_size(argv[3], &size) != 0) {
+            fprintf(stderr, "无效的大小: %s\n", argv[3]);
+            return 1;
+        }
+        return generate(argv[2], size, argv[4]);
+    }
+    if (argc >= 2 && strcmp(argv[1], "run") == 0) {
+        return run_command(argc - 2, argv + 2);
+    }
+    fprintf(stderr, "用法:\n");
+    fprintf(stderr, "  %s gen <narrow|narrow_<分隔符>|wide|quoted|numeric|fasta> <大小, 如64M> <输出文件>\n", argv[0]);
+    fprintf(stderr, "  %s run <结果文件> <版本> <命令名> <数据文件> -- <命令...>\n", argv[0]);
+    return 1;
+}
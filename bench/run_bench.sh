@@ -0,0 +1,101 @@
+#!/bin/bash
+# detect_delim 性能基准测试
+#
+# 环境变量:
+#   BENCH_SIZE    每个数据集的大小，如 16M、1G、20G（默认 64M）
+#   BENCH_DIR     测试数据目录（默认 bench/data，已生成的数据会复用）
+#   BENCH_OUTPUT  结果文件（默认 bench_output.txt，制表符分隔，可直接 diff）
+#   BENCH_ONLY    只运行名称包含该字符串的测试，如 stats、fasta
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+ROOT_DIR="$(dirname "$SCRIPT_DIR")"
+
+BIN="$ROOT_DIR/detect_delim"
+TOOL="$SCRIPT_DIR/bench_tool"
+SIZE="${BENCH_SIZE:-64M}"
+DATA_DIR="${BENCH_DIR:-$SCRIPT_DIR/data}"
+OUTPUT="${BENCH_OUTPUT:-$ROOT_DIR/bench_output.txt}"
+ONLY="${BENCH_ONLY:-}"
+
+for file in "$BIN" "$TOOL"; do
+    if [ ! -x "$file" ]; then
+        echo "❌ 缺少 $file，请先运行 make bench" >&2
+        exit 1
+    fi
+done
+
+VERSION="$(git -C "$ROOT_DIR" describe --always --dirty 2>/dev/null || echo unknown)"
+mkdir -p "$DATA_DIR"
+
+# 生成数据集（同样大小的数据只生成一次），行数记录在 <文件>.rows 中
+dataset() {
+    local kind="$1" ext="$2"
+    local file="$DATA_DIR/${kind}_${SIZE}.${ext}"
+    if [ ! -s "$file" ] || [ ! -s "$file.rows" ]; then
+        echo "生成数据: $file" >&2
+        "$TOOL" gen "$kind" "$SIZE" "$file" > "$file.rows" || exit 1
+    fi
+    echo "$file"
+}
+
+bench() {
+    local label="$1" file="$2"
+    shift 2
+    if [ -n "$ONLY" ] && [[ "$label" != *"$ONLY"* ]]; then
+        return
+    fi
+    "$TOOL" run "$OUTPUT" "$VERSION" "$label" "$file" -- "$BIN" "$file" "$@"
+}
+
+NARROW="$(dataset narrow tsv)"
+WIDE="$(dataset wide csv)"
+QUOTED="$(dataset quoted csv)"
+NUMERIC="$(dataset numeric tsv)"
+FASTA="$(dataset fasta fa)"
+
+if [ ! -f "$OUTPUT" ]; then
+    printf "version\tcommand\tdataset\tbytes\trows\tseconds\tmb_per_s\trows_per_s\tpeak_rss_kb\texit_code\n" > "$OUTPUT"
+fi
+
+echo "=========================================="
+echo "  detect_delim 基准测试 ($VERSION, $SIZE)"
+echo "=========================================="
+
+for file in "$NARROW" "$WIDE" "$QUOTED" "$NUMERIC"; do
+    bench detect "$file"
+    bench head "$file" head
+    bench stats "$file" stats
+    bench check "$file" check
+    bench csv "$file" csv
+    bench dedup "$file" dedup
+    bench duplicates "$file" duplicates
+    bench random "$file" random 1000
+done
+
+bench extract "$NARROW" 2,5
+bench extract_by_name "$NARROW" gene,score
+bench extract "$WIDE" 1,3
+bench extract_far "$WIDE" 200,1
+bench split "$QUOTED" split ,
+bench filter "$NARROW" filter "score < 10 && gene ~ ^GENE1"
+bench groupby "$NARROW" groupby gene count,mean:score,distinct:sample
+bench sort "$NARROW" sort chrom,pos:n
+bench sort_numeric "$NUMERIC" sort v1:n
+
+# 解析内核：同一窄表换用各种分隔符，分别测试只数列数（check）、切分全部字段（stats）和切分前几列（提取）
+for delim in tab comma semicolon pipe space multispace; do
+    if [ "$delim" = tab ]; then
+        file="$NARROW"
+    else
+        file="$(dataset "narrow_$delim" txt)"
+    fi
+    bench "kernel_count_$delim" "$file" check
+    bench "kernel_split_$delim" "$file" stats
+    bench "kernel_prefix_$delim" "$file" 2,5
+done
+
+bench fasta_list "$FASTA" fasta list
+bench fasta_extract "$FASTA" fasta GENE00
+
+echo
+echo "结果已追加到: $OUTPUT"
@@ -1,1132 +1,10034 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <unistd.h>
-#include <time.h>
-
-#define MAX_LINE_LENGTH 65536
-#define MAX_COLUMNS 1000
-#define MAX_FILENAME 256
-#define MAX_SEQUENCES 10000
-
-// 分隔符类型枚举
-typedef enum {
-    DELIM_TAB,
-    DELIM_COMMA,
-    DELIM_SEMICOLON,
-    DELIM_PIPE,
-    DELIM_SPACE,
-    DELIM_MULTISPACE,
-    DELIM_UNKNOWN
-} delimiter_type_t;
-
-// 数据类型枚举
-typedef enum {
-    DATA_INTEGER,
-    DATA_FLOAT,
-    DATA_TEXT,
-    DATA_MIXED,
-    DATA_EMPTY
-} data_type_t;
-
-// 列统计结构
-typedef struct {
-    char name[256];
-    int empty_count;
-    int non_empty_count;
-    int unique_count;
-    data_type_t data_type;
-    int numeric_count;
-    int float_count;
-    int text_count;
-} column_stats_t;
-
-// 文件统计结构
-typedef struct {
-    delimiter_type_t delimiter;
-    char delimiter_char;
-    int total_rows;
-    int total_columns;
-    int duplicate_rows;
-    long file_size;
-    column_stats_t columns[MAX_COLUMNS];
-} file_stats_t;
-
-// FASTA序列结构
-typedef struct {
-    char header[512];
-    char sequence[MAX_LINE_LENGTH];
-} fasta_sequence_t;
-
-// 函数声明
-void show_usage(const char* program_name);
-delimiter_type_t detect_delimiter(const char* filename, char* delim_char);
-void analyze_file_stats(const char* filename, file_stats_t* stats);
-void extract_columns_by_number(const char* filename, const char* columns);
-void extract_columns_by_name(const char* filename, const char* columns);
-void convert_to_csv(const char* filename);
-void check_file_consistency(const char* filename);
-void show_column_headers(const char* filename);
-void remove_duplicates(const char* filename);
-void show_duplicates(const char* filename);
-void random_sample_lines(const char* filename, int n_lines);
-void split_string(const char* input, const char* delimiter);
-void split_file_content(const char* filename, const char* delimiter);
-void process_fasta_list(const char* filename);
-void process_fasta_extract(const char* filename, const char* sequence_names, const char* output_file);
-int is_fasta_file(const char* filename);
-data_type_t detect_data_type(const char* value);
-void trim_whitespace(char* str);
-int count_char_occurrences(const char* str, char ch);
-void format_file_size(long size, char* buffer);
-
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        show_usage(argv[0]);
-        return 1;
-    }
-
-    const char* filename = argv[1];
-    const char* operation = (argc > 2) ? argv[2] : NULL;
-    const char* param3 = (argc > 3) ? argv[3] : NULL;
-
-    // 字符串拆分功能
-    if (operation && strcmp(operation, "split") == 0) {
-        if (access(filename, F_OK) != 0) {
-            // 文件不存在，作为字符串处理
-            split_string(filename, param3);
-            return 0;
-        } else {
-            // 文件存在，拆分文件内容
-            split_file_content(filename, param3);
-            return 0;
-        }
-    }
-
-    // FASTA文件处理
-    if (operation && strcmp(operation, "fasta") == 0) {
-        if (!is_fasta_file(filename)) {
-            fprintf(stderr, "错误: 不是有效的FASTA格式文件\n");
-            return 1;
-        }
-        
-        if (param3 && strcmp(param3, "list") == 0) {
-            process_fasta_list(filename);
-        } else if (param3) {
-            const char* output_file = (argc > 4) ? argv[4] : NULL;
-            process_fasta_extract(filename, param3, output_file);
-        } else {
-            fprintf(stderr, "请指定要提取的序列名或使用 'list' 查看所有序列\n");
-            return 1;
-        }
-        return 0;
-    }
-
-    // 检查文件是否存在
-    if (access(filename, F_OK) != 0) {
-        fprintf(stderr, "文件不存在: %s\n", filename);
-        return 1;
-    }
-
-    // 基础功能处理
-    if (!operation) {
-        // 仅检测分隔符
-        char delim_char;
-        delimiter_type_t delim = detect_delimiter(filename, &delim_char);
-        switch (delim) {
-            case DELIM_TAB: printf("TAB\n"); break;
-            case DELIM_COMMA: printf(",\n"); break;
-            case DELIM_SEMICOLON: printf(";\n"); break;
-            case DELIM_PIPE: printf("|\n"); break;
-            case DELIM_SPACE: printf(" \n"); break;
-            case DELIM_MULTISPACE: printf("MULTISPACE\n"); break;
-            default: printf("UNKNOWN\n"); break;
-        }
-    } else if (strcmp(operation, "head") == 0) {
-        show_column_headers(filename);
-    } else if (strcmp(operation, "check") == 0) {
-        check_file_consistency(filename);
-    } else if (strcmp(operation, "stats") == 0) {
-        file_stats_t stats;
-        analyze_file_stats(filename, &stats);
-    } else if (strcmp(operation, "csv") == 0) {
-        convert_to_csv(filename);
-    } else if (strcmp(operation, "dedup") == 0) {
-        remove_duplicates(filename);
-    } else if (strcmp(operation, "duplicates") == 0) {
-        show_duplicates(filename);
-    } else if (strcmp(operation, "random") == 0) {
-        if (!param3) {
-            fprintf(stderr, "错误: 请指定要随机抽取的行数\n");
-            fprintf(stderr, "用法: %s <文件路径> random <行数>\n", argv[0]);
-            return 1;
-        }
-        int n_lines = atoi(param3);
-        if (n_lines <= 0) {
-            fprintf(stderr, "错误: 行数必须是正整数\n");
-            return 1;
-        }
-        random_sample_lines(filename, n_lines);
-    } else if (strstr(operation, ",") != NULL && strspn(operation, "0123456789,") == strlen(operation)) {
-        // 按列号提取
-        extract_columns_by_number(filename, operation);
-    } else {
-        // 按列名提取
-        extract_columns_by_name(filename, operation);
-    }
-
-    return 0;
-}
-
-void show_usage(const char* program_name) {
-    printf("detect_delim - 多功能数据处理工具 (C语言版)\n");
-    printf("自动检测分隔符 & 编码，支持表格数据分析、FASTA序列处理、字符串拆分等功能\n\n");
-    
-    printf("=== 基础功能 ===\n");
-    printf("  %s <文件路径>                    # 检测文件分隔符\n", program_name);
-    printf("  %s <文件路径> head               # 显示列名和对应列号\n", program_name);
-    printf("  %s <文件路径> check              # 检查数据完整性\n", program_name);
-    printf("\n");
-    
-    printf("=== 数据提取与转换 ===\n");
-    printf("  %s <文件路径> <列号,...>         # 按列号提取数据\n", program_name);
-    printf("  %s <文件路径> <列名,...>         # 按列名模糊匹配提取\n", program_name);
-    printf("  %s <文件路径> csv               # 转换为标准CSV格式\n", program_name);
-    printf("\n");
-    
-    printf("=== 数据分析 ===\n");
-    printf("  %s <文件路径> stats             # 详细统计分析\n", program_name);
-    printf("  %s <文件路径> duplicates        # 检测并显示重复行详情\n", program_name);
-    printf("  %s <文件路径> dedup             # 去除重复行\n", program_name);
-    printf("  %s <文件路径> random <行数>     # 随机抽取N行数据\n", program_name);
-    printf("\n");
-    
-    printf("=== 字符串处理 ===\n");
-    printf("  %s \"字符串\" split [分隔符]      # 拆分字符串并换行显示\n", program_name);
-    printf("  %s <文件路径> split [分隔符]     # 拆分文件内容\n", program_name);
-    printf("    支持分隔符: 中文逗号(、) 英文逗号(,) 分号(;) 竖线(|) 空格\n");
-    printf("\n");
-    
-    printf("=== FASTA序列处理 ===\n");
-    printf("  %s <fasta文件> fasta list                    # 列出所有序列名称\n", program_name);
-    printf("  %s <fasta文件> fasta <序列名>                # 提取单个序列\n", program_name);
-    printf("  %s <fasta文件> fasta <序列名1,序列名2,...>   # 批量提取序列\n", program_name);
-    printf("  %s <fasta文件> fasta <序列名> [输出文件]     # 提取序列并保存\n", program_name);
-    printf("    支持模糊匹配: 如 'Stx' 可匹配 'Stx1', 'Stx2' 等\n");
-    printf("\n");
-    
-    printf("=== 使用示例 ===\n");
-    printf("  %s data.txt                      # 检测分隔符\n", program_name);
-    printf("  %s data.txt stats               # 数据统计分析\n", program_name);
-    printf("  %s \"Stx1、Stx2、LT\" split       # 拆分毒素基因名\n", program_name);
-    printf("  %s sequences.fa fasta Stx       # 提取Stx相关序列\n", program_name);
-}
-
-delimiter_type_t detect_delimiter(const char* filename, char* delim_char) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        return DELIM_UNKNOWN;
-    }
-
-    char line[MAX_LINE_LENGTH];
-    if (!fgets(line, sizeof(line), file)) {
-        fclose(file);
-        return DELIM_UNKNOWN;
-    }
-    fclose(file);
-
-    // 统计各种分隔符的出现次数
-    int tab_count = count_char_occurrences(line, '\t');
-    int comma_count = count_char_occurrences(line, ',');
-    int semicolon_count = count_char_occurrences(line, ';');
-    int pipe_count = count_char_occurrences(line, '|');
-    int space_count = count_char_occurrences(line, ' ');
-
-    // 检查是否有多个连续空格
-    int multispace = (strstr(line, "  ") != NULL) ? 1 : 0;
-
-    // 确定最可能的分隔符
-    int max_count = 0;
-    delimiter_type_t result = DELIM_UNKNOWN;
-
-    if (tab_count > max_count) {
-        max_count = tab_count;
-        result = DELIM_TAB;
-        *delim_char = '\t';
-    }
-    if (comma_count > max_count) {
-        max_count = comma_count;
-        result = DELIM_COMMA;
-        *delim_char = ',';
-    }
-    if (semicolon_count > max_count) {
-        max_count = semicolon_count;
-        result = DELIM_SEMICOLON;
-        *delim_char = ';';
-    }
-    if (pipe_count > max_count) {
-        max_count = pipe_count;
-        result = DELIM_PIPE;
-        *delim_char = '|';
-    }
-    if (space_count > max_count && !multispace) {
-        max_count = space_count;
-        result = DELIM_SPACE;
-        *delim_char = ' ';
-    }
-    if (multispace && space_count > 0) {
-        result = DELIM_MULTISPACE;
-        *delim_char = ' ';
-    }
-
-    return result;
-}
-
-void analyze_file_stats(const char* filename, file_stats_t* stats) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    // 获取文件大小
-    fseek(file, 0, SEEK_END);
-    stats->file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    // 检测分隔符
-    stats->delimiter = detect_delimiter(filename, &stats->delimiter_char);
-
-    char line[MAX_LINE_LENGTH];
-    char header_line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    int expected_columns = 0;
-
-    printf("=== 文件统计信息 ===\n");
-    
-    // 显示分隔符
-    switch (stats->delimiter) {
-        case DELIM_TAB: printf("分隔符: TAB\n"); break;
-        case DELIM_COMMA: printf("分隔符: ,\n"); break;
-        case DELIM_SEMICOLON: printf("分隔符: ;\n"); break;
-        case DELIM_PIPE: printf("分隔符: |\n"); break;
-        case DELIM_SPACE: printf("分隔符: 空格\n"); break;
-        case DELIM_MULTISPACE: printf("分隔符: 多空格\n"); break;
-        default: printf("分隔符: 未知\n"); break;
-    }
-
-    // 显示文件大小
-    char size_str[64];
-    format_file_size(stats->file_size, size_str);
-    printf("文件大小: %s\n", size_str);
-
-    // 读取并分析数据
-    while (fgets(line, sizeof(line), file)) {
-        line_number++;
-        
-        // 移除换行符
-        line[strcspn(line, "\r\n")] = 0;
-        
-        if (line_number == 1) {
-            // 保存表头
-            strcpy(header_line, line);
-            
-            // 计算列数
-            char* token = strtok(line, &stats->delimiter_char);
-            while (token != NULL) {
-                expected_columns++;
-                if (expected_columns <= MAX_COLUMNS) {
-                    strncpy(stats->columns[expected_columns-1].name, token, 255);
-                    stats->columns[expected_columns-1].name[255] = '\0';
-                }
-                token = strtok(NULL, &stats->delimiter_char);
-            }
-            stats->total_columns = expected_columns;
-            printf("总列数: %d\n", expected_columns);
-            continue;
-        }
-
-        stats->total_rows++;
-        
-        // 分析每列的数据
-        char line_copy[MAX_LINE_LENGTH];
-        strcpy(line_copy, line);
-        
-        char* token = strtok(line_copy, &stats->delimiter_char);
-        int col_index = 0;
-        
-        while (token != NULL && col_index < expected_columns) {
-            trim_whitespace(token);
-            
-            if (strlen(token) == 0) {
-                stats->columns[col_index].empty_count++;
-            } else {
-                stats->columns[col_index].non_empty_count++;
-                
-                data_type_t type = detect_data_type(token);
-                switch (type) {
-                    case DATA_INTEGER:
-                        stats->columns[col_index].numeric_count++;
-                        break;
-                    case DATA_FLOAT:
-                        stats->columns[col_index].float_count++;
-                        break;
-                    case DATA_TEXT:
-                        stats->columns[col_index].text_count++;
-                        break;
-                    default:
-                        break;
-                }
-            }
-            
-            token = strtok(NULL, &stats->delimiter_char);
-            col_index++;
-        }
-    }
-
-    printf("总行数: %d (不含表头)\n", stats->total_rows);
-    printf("\n=== 各列统计 ===\n");
-
-    // 显示每列的统计信息
-    for (int i = 0; i < stats->total_columns && i < MAX_COLUMNS; i++) {
-        printf("列 %d (%s):\n", i+1, stats->columns[i].name);
-        
-        float empty_percent = stats->total_rows > 0 ? 
-            (float)stats->columns[i].empty_count * 100.0 / stats->total_rows : 0.0;
-        printf("  空值: %d (%.1f%%)\n", stats->columns[i].empty_count, empty_percent);
-        
-        // 确定数据类型
-        int total_non_empty = stats->columns[i].non_empty_count;
-        if (total_non_empty > 0) {
-            if (stats->columns[i].numeric_count == total_non_empty) {
-                printf("  数据类型: 整数\n");
-            } else if ((stats->columns[i].numeric_count + stats->columns[i].float_count) == total_non_empty) {
-                printf("  数据类型: 数值\n");
-            } else if (stats->columns[i].text_count == total_non_empty) {
-                printf("  数据类型: 文本\n");
-            } else {
-                printf("  数据类型: 混合\n");
-            }
-        } else {
-            printf("  数据类型: 全空\n");
-        }
-        printf("\n");
-    }
-
-    fclose(file);
-}
-
-void extract_columns_by_number(const char* filename, const char* columns) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char delim_char;
-    detect_delimiter(filename, &delim_char);
-
-    // 解析列号
-    int col_indices[MAX_COLUMNS];
-    int num_cols = 0;
-    
-    char cols_copy[256];
-    strncpy(cols_copy, columns, 255);
-    cols_copy[255] = '\0';
-    
-    char* token = strtok(cols_copy, ",");
-    while (token != NULL && num_cols < MAX_COLUMNS) {
-        col_indices[num_cols] = atoi(token) - 1; // 转换为0基索引
-        num_cols++;
-        token = strtok(NULL, ",");
-    }
-
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        
-        char* fields[MAX_COLUMNS];
-        int field_count = 0;
-        
-        char* field = strtok(line, &delim_char);
-        while (field != NULL && field_count < MAX_COLUMNS) {
-            fields[field_count] = field;
-            field_count++;
-            field = strtok(NULL, &delim_char);
-        }
-        
-        // 输出指定列
-        for (int i = 0; i < num_cols; i++) {
-            if (i > 0) printf(",");
-            if (col_indices[i] < field_count) {
-                printf("%s", fields[col_indices[i]]);
-            }
-        }
-        printf("\n");
-    }
-
-    fclose(file);
-}
-
-void extract_columns_by_name(const char* filename, const char* columns) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char delim_char;
-    detect_delimiter(filename, &delim_char);
-
-    char line[MAX_LINE_LENGTH];
-    int col_indices[MAX_COLUMNS];
-    int num_target_cols = 0;
-    int found_indices[MAX_COLUMNS];
-    
-    // 解析目标列名
-    char target_cols[MAX_COLUMNS][256];
-    char cols_copy[256];
-    strncpy(cols_copy, columns, 255);
-    cols_copy[255] = '\0';
-    
-    char* token = strtok(cols_copy, ",");
-    while (token != NULL && num_target_cols < MAX_COLUMNS) {
-        trim_whitespace(token);
-        strncpy(target_cols[num_target_cols], token, 255);
-        target_cols[num_target_cols][255] = '\0';
-        // 转换为小写以便比较
-        for (int i = 0; target_cols[num_target_cols][i]; i++) {
-            target_cols[num_target_cols][i] = tolower(target_cols[num_target_cols][i]);
-        }
-        found_indices[num_target_cols] = -1;
-        num_target_cols++;
-        token = strtok(NULL, ",");
-    }
-
-    // 读取表头并找到匹配的列
-    if (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        
-        char* field = strtok(line, &delim_char);
-        int field_index = 0;
-        
-        while (field != NULL) {
-            char field_lower[256];
-            strncpy(field_lower, field, 255);
-            field_lower[255] = '\0';
-            
-            // 转换为小写
-            for (int i = 0; field_lower[i]; i++) {
-                field_lower[i] = tolower(field_lower[i]);
-            }
-            
-            // 检查是否匹配任何目标列名
-            for (int i = 0; i < num_target_cols; i++) {
-                if (strstr(field_lower, target_cols[i]) != NULL) {
-                    found_indices[i] = field_index;
-                }
-            }
-            
-            field = strtok(NULL, &delim_char);
-            field_index++;
-        }
-        
-        // 输出表头
-        for (int i = 0; i < num_target_cols; i++) {
-            if (i > 0) printf(",");
-            if (found_indices[i] >= 0) {
-                // 重新读取表头以获取原始列名
-                fseek(file, 0, SEEK_SET);
-                fgets(line, sizeof(line), file);
-                line[strcspn(line, "\r\n")] = 0;
-                
-                char* header_field = strtok(line, &delim_char);
-                int idx = 0;
-                while (header_field != NULL && idx <= found_indices[i]) {
-                    if (idx == found_indices[i]) {
-                        printf("%s", header_field);
-                        break;
-                    }
-                    header_field = strtok(NULL, &delim_char);
-                    idx++;
-                }
-            }
-        }
-        printf("\n");
-    }
-
-    // 处理数据行
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        
-        char* fields[MAX_COLUMNS];
-        int field_count = 0;
-        
-        char* field = strtok(line, &delim_char);
-        while (field != NULL && field_count < MAX_COLUMNS) {
-            fields[field_count] = field;
-            field_count++;
-            field = strtok(NULL, &delim_char);
-        }
-        
-        // 输出匹配的列
-        for (int i = 0; i < num_target_cols; i++) {
-            if (i > 0) printf(",");
-            if (found_indices[i] >= 0 && found_indices[i] < field_count) {
-                printf("%s", fields[found_indices[i]]);
-            }
-        }
-        printf("\n");
-    }
-
-    fclose(file);
-}
-
-void convert_to_csv(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char delim_char;
-    detect_delimiter(filename, &delim_char);
-
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        
-        // 替换分隔符为逗号
-        for (int i = 0; line[i]; i++) {
-            if (line[i] == delim_char) {
-                line[i] = ',';
-            }
-        }
-        
-        printf("%s\n", line);
-    }
-
-    fclose(file);
-}
-
-void check_file_consistency(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char delim_char;
-    delimiter_type_t delim_type = detect_delimiter(filename, &delim_char);
-
-    char line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    int expected_columns = 0;
-    int inconsistent_lines = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-        line_number++;
-        line[strcspn(line, "\r\n")] = 0;
-        
-        int column_count = 1; // 至少有一列
-        if (delim_type == DELIM_MULTISPACE) {
-            // 处理多空格分隔符
-            char* ptr = line;
-            int in_field = 0;
-            column_count = 0;
-            
-            while (*ptr) {
-                if (*ptr == ' ') {
-                    if (in_field) {
-                        in_field = 0;
-                    }
-                } else {
-                    if (!in_field) {
-                        column_count++;
-                        in_field = 1;
-                    }
-                }
-                ptr++;
-            }
-        } else {
-            column_count = count_char_occurrences(line, delim_char) + 1;
-        }
-        
-        if (line_number == 1) {
-            expected_columns = column_count;
-        } else if (column_count != expected_columns) {
-            printf("不一致行号:%d, 列数:%d, 内容: %s\n", line_number, column_count, line);
-            inconsistent_lines++;
-        }
-    }
-
-    if (inconsistent_lines == 0) {
-        printf("所有行列数相同 (分隔符: ");
-        switch (delim_type) {
-            case DELIM_TAB: printf("TAB"); break;
-            case DELIM_COMMA: printf(","); break;
-            case DELIM_SEMICOLON: printf(";"); break;
-            case DELIM_PIPE: printf("|"); break;
-            case DELIM_SPACE: printf("空格"); break;
-            case DELIM_MULTISPACE: printf("多空格"); break;
-            default: printf("未知"); break;
-        }
-        printf(")\n");
-    } else {
-        printf("共有 %d 行列数不同\n", inconsistent_lines);
-    }
-
-    fclose(file);
-}
-
-void show_column_headers(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char delim_char;
-    detect_delimiter(filename, &delim_char);
-
-    char line[MAX_LINE_LENGTH];
-    if (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        
-        printf("列名和对应的列号:\n");
-        
-        char* token = strtok(line, &delim_char);
-        int column_number = 1;
-        
-        while (token != NULL) {
-            printf("%d: %s\n", column_number, token);
-            token = strtok(NULL, &delim_char);
-            column_number++;
-        }
-    }
-
-    fclose(file);
-}
-
-void remove_duplicates(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char lines[10000][MAX_LINE_LENGTH];
-    int line_count = 0;
-    char line[MAX_LINE_LENGTH];
-
-    // 读取所有行
-    while (fgets(line, sizeof(line), file) && line_count < 10000) {
-        line[strcspn(line, "\r\n")] = 0;
-        strcpy(lines[line_count], line);
-        line_count++;
-    }
-    fclose(file);
-
-    // 输出第一行（表头）
-    if (line_count > 0) {
-        printf("%s\n", lines[0]);
-    }
-
-    // 去重输出
-    for (int i = 1; i < line_count; i++) {
-        int is_duplicate = 0;
-        
-        // 检查是否与之前的行重复
-        for (int j = 1; j < i; j++) {
-            if (strcmp(lines[i], lines[j]) == 0) {
-                is_duplicate = 1;
-                break;
-            }
-        }
-        
-        if (!is_duplicate) {
-            printf("%s\n", lines[i]);
-        }
-    }
-}
-
-void show_duplicates(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char delim_char;
-    delimiter_type_t delim_type = detect_delimiter(filename, &delim_char);
-
-    printf("=== 重复行检测结果 ===\n");
-    printf("分隔符: ");
-    switch (delim_type) {
-        case DELIM_TAB: printf("TAB\n"); break;
-        case DELIM_COMMA: printf(",\n"); break;
-        case DELIM_SEMICOLON: printf(";\n"); break;
-        case DELIM_PIPE: printf("|\n"); break;
-        case DELIM_SPACE: printf("空格\n"); break;
-        case DELIM_MULTISPACE: printf("多空格\n"); break;
-        default: printf("未知\n"); break;
-    }
-    printf("\n");
-
-    char lines[10000][MAX_LINE_LENGTH];
-    int line_numbers[10000];
-    int line_count = 0;
-    char line[MAX_LINE_LENGTH];
-    int current_line = 0;
-
-    // 读取所有行
-    while (fgets(line, sizeof(line), file) && line_count < 10000) {
-        current_line++;
-        line[strcspn(line, "\r\n")] = 0;
-        
-        if (current_line == 1) {
-            printf("表头: %s\n\n", line);
-            continue;
-        }
-        
-        strcpy(lines[line_count], line);
-        line_numbers[line_count] = current_line;
-        line_count++;
-    }
-    fclose(file);
-
-    // 查找重复行
-    int duplicate_groups = 0;
-    int total_duplicates = 0;
-    int processed[10000] = {0};
-
-    for (int i = 0; i < line_count; i++) {
-        if (processed[i]) continue;
-        
-        int group_size = 1;
-        int group_lines[1000];
-        group_lines[0] = line_numbers[i];
-        
-        for (int j = i + 1; j < line_count; j++) {
-            if (!processed[j] && strcmp(lines[i], lines[j]) == 0) {
-                group_lines[group_size] = line_numbers[j];
-                group_size++;
-                processed[j] = 1;
-            }
-        }
-        
-        if (group_size > 1) {
-            duplicate_groups++;
-            total_duplicates += group_size;
-            
-            printf("重复组 %d (出现 %d 次):\n", duplicate_groups, group_size);
-            printf("行号: ");
-            for (int k = 0; k < group_size; k++) {
-                if (k > 0) printf(",");
-                printf("%d", group_lines[k]);
-            }
-            printf("\n内容: %s\n\n", lines[i]);
-        }
-        
-        processed[i] = 1;
-    }
-
-    if (duplicate_groups == 0) {
-        printf("没有发现重复行\n");
-    } else {
-        printf("总结: 共有 %d 个重复组，涉及 %d 行数据\n", duplicate_groups, total_duplicates);
-        int unique_lines = line_count - (total_duplicates - duplicate_groups);
-        printf("唯一行数: %d\n", unique_lines);
-        printf("重复率: %.2f%%\n", (float)(total_duplicates - duplicate_groups) * 100.0 / line_count);
-    }
-}
-
-void random_sample_lines(const char* filename, int n_lines) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    // 初始化随机数生成器
-    srand((unsigned int)time(NULL));
-
-    char lines[10000][MAX_LINE_LENGTH];
-    int line_count = 0;
-    char line[MAX_LINE_LENGTH];
-    char header[MAX_LINE_LENGTH];
-    int current_line = 0;
-
-    // 读取所有行
-    while (fgets(line, sizeof(line), file) && line_count < 10000) {
-        current_line++;
-        line[strcspn(line, "\r\n")] = 0;
-        
-        if (current_line == 1) {
-            // 保存表头
-            strcpy(header, line);
-            continue;
-        }
-        
-        strcpy(lines[line_count], line);
-        line_count++;
-    }
-    fclose(file);
-
-    // 检查请求的行数
-    if (n_lines > line_count) {
-        fprintf(stderr, "警告: 请求行数(%d)大于数据行数(%d)，将返回所有数据行\n", 
-                n_lines, line_count);
-        n_lines = line_count;
-    }
-
-    // 输出表头
-    printf("%s\n", header);
-
-    // Fisher-Yates洗牌算法随机抽取
-    for (int i = line_count - 1; i > 0; i--) {
-        int j = rand() % (i + 1);
-        
-        // 交换 lines[i] 和 lines[j]
-        char temp[MAX_LINE_LENGTH];
-        strcpy(temp, lines[i]);
-        strcpy(lines[i], lines[j]);
-        strcpy(lines[j], temp);
-    }
-
-    // 输出前n行
-    for (int i = 0; i < n_lines && i < line_count; i++) {
-        printf("%s\n", lines[i]);
-    }
-}
-
-void split_string(const char* input, const char* delimiter) {
-    char input_copy[MAX_LINE_LENGTH];
-    strncpy(input_copy, input, MAX_LINE_LENGTH - 1);
-    input_copy[MAX_LINE_LENGTH - 1] = '\0';
-
-    char* delim_pattern = "、,;| ";
-    if (delimiter && strlen(delimiter) > 0) {
-        delim_pattern = (char*)delimiter;
-    }
-
-    char* token = strtok(input_copy, delim_pattern);
-    while (token != NULL) {
-        trim_whitespace(token);
-        if (strlen(token) > 0) {
-            printf("%s\n", token);
-        }
-        token = strtok(NULL, delim_pattern);
-    }
-}
-
-void split_file_content(const char* filename, const char* delimiter) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    char* delim_pattern = "、,;| ";
-    if (delimiter && strlen(delimiter) > 0) {
-        delim_pattern = (char*)delimiter;
-    }
-
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        split_string(line, delim_pattern);
-    }
-
-    fclose(file);
-}
-
-void process_fasta_list(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    printf("=== FASTA文件序列列表 ===\n");
-    
-    char line[MAX_LINE_LENGTH];
-    int seq_count = 0;
-    
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        
-        if (line[0] == '>') {
-            seq_count++;
-            printf("%d: %s\n", seq_count, line + 1); // 跳过'>'符号
-        }
-    }
-    
-    printf("\n总序列数: %d\n", seq_count);
-    fclose(file);
-}
-
-void process_fasta_extract(const char* filename, const char* sequence_names, const char* output_file) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "无法打开文件: %s\n", filename);
-        return;
-    }
-
-    FILE* output = stdout;
-    if (output_file) {
-        output = fopen(output_file, "w");
-        if (!output) {
-            fprintf(stderr, "无法创建输出文件: %s\n", output_file);
-            fclose(file);
-            return;
-        }
-    }
-
-    // 解析序列名列表
-    char target_names[100][256];
-    int num_targets = 0;
-    
-    char names_copy[1024];
-    strncpy(names_copy, sequence_names, 1023);
-    names_copy[1023] = '\0';
-    
-    char* token = strtok(names_copy, ",");
-    while (token != NULL && num_targets < 100) {
-        trim_whitespace(token);
-        // 转换为小写以便比较
-        for (int i = 0; token[i]; i++) {
-            target_names[num_targets][i] = tolower(token[i]);
-        }
-        target_names[num_targets][strlen(token)] = '\0';
-        num_targets++;
-        token = strtok(NULL, ",");
-    }
-
-    char line[MAX_LINE_LENGTH];
-    int in_target_sequence = 0;
-    int found_any = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-        line[strcspn(line, "\r\n")] = 0;
-        
-        if (line[0] == '>') {
-            // 检查是否匹配目标序列
-            char header_lower[512];
-            strncpy(header_lower, line + 1, 511);
-            header_lower[511] = '\0';
-            
-            // 转换为小写
-            for (int i = 0; header_lower[i]; i++) {
-                header_lower[i] = tolower(header_lower[i]);
-            }
-            
-            in_target_sequence = 0;
-            for (int i = 0; i < num_targets; i++) {
-                if (strstr(header_lower, target_names[i]) != NULL) {
-                    in_target_sequence = 1;
-                    found_any = 1;
-                    break;
-                }
-            }
-            
-            if (in_target_sequence) {
-                fprintf(output, "%s\n", line);
-            }
-        } else if (in_target_sequence) {
-            fprintf(output, "%s\n", line);
-        }
-    }
-
-    if (!found_any) {
-        fprintf(stderr, "未找到匹配的序列: %s\n", sequence_names);
-        fprintf(stderr, "提示: 使用 '%s %s fasta list' 查看所有可用序列\n", "detect_delim", filename);
-    } else if (output_file) {
-        printf("序列已保存到: %s\n", output_file);
-    }
-
-    fclose(file);
-    if (output != stdout) {
-        fclose(output);
-    }
-}
-
-int is_fasta_file(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        return 0;
-    }
-
-    char line[MAX_LINE_LENGTH];
-    if (fgets(line, sizeof(line), file)) {
-        fclose(file);
-        return (line[0] == '>');
-    }
-    
-    fclose(file);
-    return 0;
-}
-
-data_type_t detect_data_type(const char* value) {
-    if (strlen(value) == 0) {
-        return DATA_EMPTY;
-    }
-
-    char* endptr;
-    
-    // 尝试解析为整数
-    long int_val = strtol(value, &endptr, 10);
-    if (*endptr == '\0') {
-        return DATA_INTEGER;
-    }
-    
-    // 尝试解析为浮点数
-    double float_val = strtod(value, &endptr);
-    if (*endptr == '\0') {
-        return DATA_FLOAT;
-    }
-    
-    return DATA_TEXT;
-}
-
-void trim_whitespace(char* str) {
-    // 移除前导空白
-    char* start = str;
-    while (isspace(*start)) {
-        start++;
-    }
-    
-    // 移除尾随空白
-    char* end = start + strlen(start) - 1;
-    while (end > start && isspace(*end)) {
-        end--;
-    }
-    
-    // 复制结果
-    int len = end - start + 1;
-    memmove(str, start, len);
-    str[len] = '\0';
-}
-
-int count_char_occurrences(const char* str, char ch) {
-    int count = 0;
-    for (int i = 0; str[i]; i++) {
-        if (str[i] == ch) {
-            count++;
-        }
-    }
-    return count;
-}
-
-void format_file_size(long size, char* buffer) {
-    if (size >= 1073741824) {
-        sprintf(buffer, "%.2fGB", (double)size / 1073741824);
-    } else if (size >= 1048576) {
-        sprintf(buffer, "%.2fMB", (double)size / 1048576);
-    } else if (size >= 1024) {
-        sprintf(buffer, "%.2fKB", (double)size / 1024);
-    } else {
-        sprintf(buffer, "%ldB", size);
-    }
-}
\ No newline at end of file
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <strings.h>
+#include <regex.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <iconv.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef DD_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+#define MAX_LINE_LENGTH 65536
+#define MAX_COLUMNS 1000
+#define MAX_FILENAME 256
+#define MAX_SEQUENCES 10000
+#define READ_BUFFER_SIZE (1 << 20)
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define MAX_THREADS 64
+#define MIN_THREAD_CHUNK (4 << 20)
+#define DEFAULT_MEM_BUDGET ((size_t)1 << 30)
+#define GROUPBY_PARTITIONS 16
+#define GROUPBY_MAX_LEVEL 8
+#define MAX_SORT_KEYS 16
+#define MAX_SORT_RUNS 512
+#define MAX_MERGE_FANIN 128
+#define MAX_JOIN_PARTITIONS 256
+#define DUP_PARTITIONS 16
+#define DUP_MAX_LEVEL 8
+#define FUZZY_SIG_SIZE 64
+#define FUZZY_SHINGLE 4
+#define FUZZY_DEFAULT_THRESHOLD 0.8
+#define FUZZY_MAX_PARTS 256
+#define FUZZY_BUFFER_RECORDS 512
+#define FUZZY_TRIM 1
+#define FUZZY_CASE 2
+#define PROFILE_SAMPLE_MASK 63
+#define JSON_MAX_DEPTH 16
+#define STATE_FILE_VERSION 1
+#define SPLIT_MAX_DELIMS 32
+#define SPLIT_DEFAULT_DELIMS "、,;| "
+#define OUT_BUFFER_SIZE (1 << 16)
+#define ENCODING_SAMPLE_SIZE (64 << 10)
+#define RAW_BUFFER_SIZE (256 << 10)
+#define SERVE_MAX_FILES 64
+#define SERVE_MAX_CONNS 256
+#define SERVE_MAX_REQUEST (64 << 10)
+#define SERVE_MAX_REPORT 1000
+#define CONVERT_SAMPLE_ROWS 10000
+#define CONVERT_GROUP_ROWS 65536
+#define CONVERT_GROUP_BYTES (64 << 20)
+#define COLUMNAR_MAGIC "DDCOL001"
+#define CHECK_EXAMPLE_BYTES 160
+#define CHECK_DEFAULT_EXAMPLES 3
+#define CHECK_TYPE_TOLERANCE 0.01
+
+// 解析内核每次比较的块大小，PARSE_MASK 给出块内等于 ch 的字节位掩码
+#ifdef __SSE2__
+#define PARSE_BLOCK 16
+#define PARSE_MASK(p, ch) ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p)), _mm_set1_epi8(ch))))
+#else
+#define PARSE_BLOCK 8
+#define PARSE_MASK(p, ch) parse_mask_short((p), PARSE_BLOCK, (ch))
+#endif
+// 行内从 base 开始的一块；行尾不足一块时改为读取以行尾结束的一整块再移掉已处理的部分，
+// 整行不足一块时逐字节比较，都不会读到行外
+#define PARSE_MASK_AT(line, len, base, ch) \
+    ((base) + PARSE_BLOCK <= (len) ? PARSE_MASK((line) + (base), ch) \
+     : (len) >= PARSE_BLOCK ? PARSE_MASK((line) + (len) - PARSE_BLOCK, ch) >> (PARSE_BLOCK - ((len) - (base))) \
+     : parse_mask_short((line) + (base), (len) - (base), ch))
+#define PARSE_VALID_MASK(len, base) \
+    ((base) + PARSE_BLOCK <= (len) ? (1u << PARSE_BLOCK) - 1 : (1u << ((len) - (base))) - 1)
+
+// 分隔符类型枚举
+typedef enum {
+    DELIM_TAB,
+    DELIM_COMMA,
+    DELIM_SEMICOLON,
+    DELIM_PIPE,
+    DELIM_SPACE,
+    DELIM_MULTISPACE,
+    DELIM_UNKNOWN
+} delimiter_type_t;
+
+// 文件编码，非UTF-8的输入在读取时转码为UTF-8
+typedef enum {
+    ENC_UTF8,
+    ENC_UTF8_BOM,
+    ENC_UTF16LE,
+    ENC_UTF16BE,
+    ENC_GB18030,
+    ENC_OTHER,      // --encoding 指定的其他编码
+    ENC_UNKNOWN     // 无法识别，按原始字节处理
+} encoding_t;
+
+// 数据类型枚举
+typedef enum {
+    DATA_INTEGER,
+    DATA_FLOAT,
+    DATA_TEXT,
+    DATA_MIXED,
+    DATA_EMPTY
+} data_type_t;
+
+// 字段切片：指向行缓冲区，不做拷贝
+typedef struct {
+    char* ptr;
+    size_t len;
+} field_t;
+
+// 解析内核：每种分隔符一组专用的切分、计数和定位函数，分隔符在函数内是常量。
+// 检测出分隔符后选定一次，逐行解析时不再判断分隔符和多空格模式
+typedef struct {
+    int (*split)(char* line, size_t len, field_t* fields, int max_fields);
+    int (*count)(const char* line, size_t len);
+    void (*field_at)(char* line, size_t len, int index, field_t* field);
+} parse_kernel_t;
+
+// 列统计结构
+typedef struct {
+    const char* name;         // 列名（驻留字符串）
+    long long empty_count;
+    long long non_empty_count;
+    long long unique_count;
+    data_type_t data_type;
+    long long numeric_count;
+    long long float_count;
+    long long text_count;
+} column_stats_t;
+
+// 文件统计结构
+typedef struct {
+    delimiter_type_t delimiter;
+    char delimiter_char;
+    const parse_kernel_t* kernel; // 与分隔符一起设置，逐行直接调用
+    encoding_t encoding;
+    long long lines;          // 已处理的行数（含表头）
+    long long total_rows;
+    int total_columns;
+    int duplicate_rows;
+    long file_size;
+    column_stats_t columns[MAX_COLUMNS];
+} file_stats_t;
+
+// 列数一致性检查状态
+typedef struct {
+    delimiter_type_t delim_type;
+    char delim_char;
+    const parse_kernel_t* kernel; // 与分隔符一起设置，逐行直接调用
+    long long lines;
+    int expected_columns;
+    long long inconsistent_lines;
+    int stopped;              // 达到 --max-errors 后提前停止
+    FILE* record_file;        // 非空时不一致行写入部分状态文件而不是输出
+} check_state_t;
+
+// 增量扫描状态：--follow/--checkpoint 使用，可保存为状态文件后续扫；
+// --state 用它保存一个数据范围的部分结果，由 merge 合并
+typedef struct {
+    int is_check;             // 0 为 stats，1 为 check
+    long long offset;         // 已处理到的文件偏移，总在行边界上
+    unsigned long long inode; // 用于发现文件被替换（日志轮转）
+    long long range_start;    // 部分状态对应的数据范围，合并时按范围排序
+    long long range_end;
+    long long file_size;
+    char file[MAX_FILENAME];  // 状态对应的数据文件
+    int lines_pending_detect; // 尚未检测分隔符
+    file_stats_t* stats;
+    check_state_t check;
+} scan_state_t;
+
+// merge 的一个输入：部分状态及其文件路径（输出不一致行时需要重新读取）
+typedef struct {
+    scan_state_t state;
+    const char* path;
+} merge_input_t;
+
+// 分块输出：工作线程先写内存，超过限额后转存临时文件，全部完成后由主线程按分块顺序输出
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    size_t limit;
+    FILE* spill;
+} chunk_output_t;
+
+// FASTA并行处理的一个分块：[start, end) 从记录开头开始，到下一分块的记录开头结束
+typedef struct {
+    const char* filename;
+    long long start;
+    long long end;
+    const char* const* targets; // 要提取的序列名（小写），为NULL时只列出表头
+    int num_targets;
+    chunk_output_t out;
+    long long records;          // 分块中的记录数
+    long long matched;          // 匹配的记录数
+    char* header;               // 当前表头（可能跨越读取块）
+    size_t header_len;
+    size_t header_cap;
+    char* lower;
+    int pending_cr;             // 上一块以\r结尾，要看下一字节才知道是否属于\r\n
+    char last_byte;             // 最后输出的序列字节，用于给文件末尾补换行
+    int failed;
+} fasta_worker_t;
+
+// 行读取器：按大块读取文件，返回的行直接指向内部缓冲区，不受行长限制
+typedef struct {
+    FILE* file;
+    char* buf;
+    size_t cap;
+    size_t pos;     // 下一行的起始位置
+    size_t scan;    // 已确认不含换行符的位置，避免长行重复扫描
+    size_t end;     // 缓冲区有效数据末尾
+    long long base; // buf[0]对应的文件偏移
+    long long limit; // 只返回起始偏移小于该值的行，-1表示不限
+    int eof;
+    long long origin;   // 文本的起始偏移（UTF-8跳过BOM；转码时偏移是转码后的位置，从0开始）
+    long long raw_start; // 文本在文件中的起始位置
+    encoding_t encoding;
+    iconv_t cd;         // 转码器，(iconv_t)-1 表示直接读取
+    char* raw;          // 转码前的原始数据
+    size_t raw_len;
+    int raw_eof;
+    int validate;       // 读取时校验UTF-8，发现无效字节后停止
+    size_t checked;     // 缓冲区中已校验到的位置
+} line_reader_t;
+
+// 输出缓冲：大量小块输出先攒在缓冲区，满了再一次性写出
+typedef struct {
+    FILE* out;
+    char* data;
+    size_t len;
+} out_buffer_t;
+
+// split 的分隔符集合：每个分隔符是一个完整的UTF-8字符，只在字符边界上匹配
+typedef struct {
+    unsigned char bytes[SPLIT_MAX_DELIMS][4];
+    int lens[SPLIT_MAX_DELIMS];
+    int count;
+    unsigned char is_first[256];         // 可能是分隔符首字节的字节
+    unsigned char first[SPLIT_MAX_DELIMS]; // 不重复的首字节，用于向量化预筛
+    int num_first;
+#ifdef __SSE2__
+    __m128i first_vec[SPLIT_MAX_DELIMS];
+#endif
+} split_set_t;
+
+// 表格读取器：检测分隔符并预先读取表头
+typedef struct {
+    line_reader_t reader;
+    delimiter_type_t delim_type;
+    char delim_char;
+    int multispace;
+    const parse_kernel_t* kernel;
+    char* header_line;   // 表头原文
+    size_t header_len;
+    const char** names;  // 各列名称（驻留字符串）
+    int num_columns;
+    long long data_start;   // 数据行的字节范围，--range/--rows 会缩小这个范围
+    long long data_end;     // -1 表示读到文件末尾（转码输入事先不知道转码后的长度）
+    long long file_size;
+    long long first_row;    // 范围前的数据行数，-1 表示未知（--range 从文件中间开始）
+    int include_header;     // 表头是否属于本范围，只有从文件开头开始的范围才输出表头
+} table_reader_t;
+
+// 行过滤谓词节点
+typedef enum {
+    PRED_AND,
+    PRED_OR,
+    PRED_NOT,
+    PRED_CMP,
+    PRED_REGEX,
+    PRED_IN
+} pred_kind_t;
+
+typedef enum {
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE
+} cmp_op_t;
+
+typedef struct pred_node {
+    pred_kind_t kind;
+    struct pred_node* left;
+    struct pred_node* right;
+    int column;
+    cmp_op_t op;
+    char* str;          // 比较用的字符串常量
+    size_t str_len;
+    double num;         // 比较用的数值常量
+    int is_numeric;
+    regex_t regex;
+    int has_regex;
+    int negate;         // !~
+    char** set;         // in 集合（已排序）
+    int set_size;
+} pred_node_t;
+
+// 结果输出格式
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_JSON,      // 整个结果为一个JSON文档
+    FORMAT_NDJSON     // 每条记录一行JSON
+} output_format_t;
+
+// 流式JSON写出器：边生成边输出，不在内存中拼接整个文档
+typedef struct {
+    FILE* out;
+    int ndjson;                        // 顶层每个对象单独一行
+    int depth;
+    int need_comma[JSON_MAX_DEPTH];
+} json_writer_t;
+
+// 全局选项（--threads、--mem 等，可出现在命令行任意位置）
+typedef struct {
+    int threads;          // 0 表示按CPU核数
+    size_t mem_budget;    // 聚合等操作的内存预算
+    int profile;          // 0 不剖析，1 文本报告，2 JSON报告
+    output_format_t format;
+    const char* by_columns;   // duplicates --by 指定的键列
+    const char* range;        // --range start:end，按字节划分数据
+    const char* rows;         // --rows a:b，按数据行号划分
+    const char* state;        // stats/check 只输出可合并的部分状态
+    int follow;               // 持续跟踪文件追加的内容
+    int interval_ms;          // --follow 输出间隔
+    const char* checkpoint;   // 检查点文件，从上次的位置继续
+    const char* encoding;     // --encoding 指定输入编码，默认自动检测
+    double fuzzy;             // duplicates --fuzzy 的相似度阈值，0 表示精确匹配
+    const char* normalize;    // --fuzzy 的行规范化方式，默认 trim,case
+    const char* ignore_columns;   // --fuzzy 比较时忽略的列
+    int check_summary;        // check 汇总输出问题分布和示例，同时检查列类型
+    long long max_errors;     // check 发现这么多问题行后停止，0 表示不限
+    int examples;             // check --summary 每类问题保留的示例数
+} options_t;
+
+// 性能剖析阶段
+typedef enum {
+    PROF_READ,
+    PROF_SPLIT,
+    PROF_CLASSIFY,
+    PROF_HASH,
+    PROF_WRITE,
+    PROF_NUM_PHASES
+} prof_phase_t;
+
+// 性能剖析计数器：每个线程一份，线程结束时汇总
+typedef struct {
+    uint64_t ticks[PROF_NUM_PHASES];
+    uint64_t calls[PROF_NUM_PHASES];
+    uint64_t sampled[PROF_NUM_PHASES];   // 实际计时的调用次数
+    uint64_t bytes[PROF_NUM_PHASES];
+    uint64_t rows;
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+} profile_counters_t;
+
+// 剖析时线程经由中转函数启动，结束前汇总计数器
+typedef struct {
+    void* (*worker)(void*);
+    void* arg;
+} profile_task_t;
+
+// 剖析宏：未定义DD_PROFILE时展开为空，不产生任何开销。
+// 读取和输出按大块进行，每次都计时；切分、类型检测、哈希按行或按字段调用，
+// 每PROFILE_SAMPLE_MASK+1次计时一次，报告时按调用次数折算
+#ifdef DD_PROFILE
+#define PROF_BEGIN(t) uint64_t t = profile_ticks()
+#define PROF_END(t, phase, n) profile_add((phase), profile_ticks() - (t), (n))
+#define PROF_SAMPLE_BEGIN(t, phase) uint64_t t = profile_sample_begin(phase)
+#define PROF_SAMPLE_END(t, phase, n) profile_sample_end((phase), (t), (n))
+#define PROF_ROW() (g_prof_local.rows++)
+#define PROF_ALLOC(n) (g_prof_local.allocs++, g_prof_local.alloc_bytes += (n))
+#else
+#define PROF_BEGIN(t)
+#define PROF_END(t, phase, n)
+#define PROF_SAMPLE_BEGIN(t, phase)
+#define PROF_SAMPLE_END(t, phase, n)
+#define PROF_ROW()
+#define PROF_ALLOC(n)
+#endif
+
+// 块式内存池：只分配不单独释放，用完整体释放
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used;
+    size_t cap;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t* head;
+    size_t total;
+} arena_t;
+
+// 字符串驻留表：相同内容只保存一份，驻留后的字符串不可修改，可以按指针比较
+typedef struct {
+    uint64_t hash;
+    const char* str;
+    size_t len;
+} intern_slot_t;
+
+typedef struct {
+    intern_slot_t* slots;
+    size_t slot_cap;
+    size_t count;
+} intern_table_t;
+
+// 聚合函数
+typedef enum {
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_MEAN,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_DISTINCT
+} agg_kind_t;
+
+typedef struct {
+    agg_kind_t kind;
+    int column;
+} agg_spec_t;
+
+// 单个分组上单个聚合函数的状态
+typedef struct {
+    double sum;
+    double min;
+    double max;
+    long long count;        // 有效数值个数
+    uint64_t* distinct;     // 去重计数用的值哈希集合（开放寻址）
+    uint32_t distinct_size;
+    uint32_t distinct_cap;
+} agg_state_t;
+
+typedef struct {
+    uint64_t hash;
+    char* key;              // 分组键，各键列以\x1f连接，存放在arena中
+    uint32_t key_len;
+    long long rows;
+    long long first;        // 首行在文件中的偏移，溢出后按它恢复首次出现的顺序
+    agg_state_t* aggs;
+} group_entry_t;
+
+// 哈希槽只存哈希值和条目下标，探测时不必访问条目本身
+typedef struct {
+    uint64_t hash;
+    uint32_t index;         // 条目下标+1，0表示空槽
+} group_slot_t;
+
+// 开放寻址哈希表，条目按首次出现顺序存放
+typedef struct {
+    group_slot_t* slots;
+    size_t slot_cap;
+    group_entry_t* entries;
+    size_t count;
+    size_t entry_cap;
+    int num_aggs;
+    arena_t arena;
+    size_t memory;          // 估算的内存占用
+} group_table_t;
+
+typedef struct {
+    char delim_char;
+    int multispace;
+    const parse_kernel_t* kernel;
+    int key_cols[MAX_COLUMNS];
+    int num_keys;
+    agg_spec_t aggs[MAX_COLUMNS];
+    int num_aggs;
+    int max_col;
+    size_t mem_budget;      // 每个哈希表的内存预算
+} groupby_plan_t;
+
+typedef struct {
+    field_t* fields;
+    char* key;
+    size_t key_cap;
+} groupby_scratch_t;
+
+typedef struct {
+    const groupby_plan_t* plan;
+    const char* filename;
+    long long start;
+    long long end;
+    group_table_t table;
+    FILE* spill[GROUPBY_PARTITIONS];
+    int failed;
+} groupby_worker_t;
+
+// 排序键：列号，是否按数值比较，是否降序
+typedef struct {
+    int column;
+    int numeric;
+    int reverse;
+} sort_key_t;
+
+typedef struct {
+    char delim_char;
+    int multispace;
+    const parse_kernel_t* kernel;
+    sort_key_t keys[MAX_SORT_KEYS];
+    int num_keys;
+    int max_col;
+} sort_plan_t;
+
+// 待排序的行：第一个排序键归一化为64位前缀，多数比较只需比较前缀
+typedef struct {
+    uint64_t prefix;
+    char* line;
+    uint32_t len;
+    uint32_t key_off;       // 第一个排序键在行内的位置
+    uint32_t key_len;
+} sort_record_t;
+
+typedef struct {
+    const sort_plan_t* plan;
+    sort_record_t* records;
+    sort_record_t* tmp;
+    size_t count;
+} sort_worker_t;
+
+// 多路归并的一路输入
+typedef struct {
+    line_reader_t reader;
+    sort_record_t record;
+    int done;
+} sort_merge_input_t;
+
+// 按原始文件偏移恢复顺序的输出：每行以 "偏移," 开头，各段内已按偏移排序，最后归并并去掉偏移
+typedef struct {
+    sort_plan_t order;      // 按每行开头的偏移（第0列）比较
+    FILE* runs[MAX_SORT_RUNS];
+    int num_runs;
+} offset_runs_t;
+
+// 连接方式
+typedef enum {
+    JOIN_INNER,
+    JOIN_LEFT,
+    JOIN_ANTI
+} join_mode_t;
+
+// 连接的一侧：分隔符与键列
+typedef struct {
+    char delim_char;
+    int multispace;
+    const parse_kernel_t* kernel;
+    int key_cols[MAX_COLUMNS];
+    int num_columns;
+} join_side_t;
+
+typedef struct {
+    join_side_t left;
+    join_side_t right;
+    int num_keys;
+    join_mode_t mode;
+    int build_is_left;          // 较小的一侧作为构建端
+    char out_delim;             // 输出的分隔符，沿用左表
+    char right_is_key[MAX_COLUMNS];
+    field_t* left_fields;
+    field_t* right_fields;
+    char* key;
+    size_t key_cap;
+} join_ctx_t;
+
+// 构建端的一个键及其所有行（行以链表相连，保持文件顺序）
+typedef struct {
+    uint64_t hash;
+    char* key;
+    uint32_t key_len;
+    int matched;
+    int32_t head;
+    int32_t tail;
+} join_key_t;
+
+typedef struct {
+    char* line;
+    long long offset;       // 构建端是左表时为该行在左表中的偏移，用于恢复左表顺序
+    uint32_t len;
+    int32_t next;
+} join_row_t;
+
+typedef struct {
+    group_slot_t* slots;
+    size_t slot_cap;
+    join_key_t* keys;
+    size_t num_keys;
+    size_t key_cap;
+    join_row_t* rows;
+    size_t num_rows;
+    size_t row_cap;
+    arena_t arena;
+} join_table_t;
+
+// 重复组：同一行（或同一组键列值）的所有出现位置
+typedef struct {
+    uint64_t first_line;     // 首次出现的行号
+    long long first_offset;  // 首次出现的文件偏移，输出时按偏移回读内容
+    uint64_t last_line;
+    uint64_t count;
+    unsigned char* deltas;   // 之后各行号与前一行号的差值，按变长整数编码
+    size_t deltas_len;
+    size_t deltas_cap;
+    char* key;               // 参与比较的内容（整行或以\x1f连接的键列），哈希相同的行再逐字节比较
+    size_t key_len;
+} dup_group_t;
+
+// 重复检测的行记录，溢出时原样写入临时文件
+typedef struct {
+    uint64_t hash;
+    uint64_t check;          // 第二个独立哈希，两者都相等才视为相同
+    uint64_t line;
+    long long offset;
+} dup_record_t;
+
+// 重复检测哈希表槽位，只保存哈希和首次出现位置，不保存行内容
+typedef struct {
+    uint64_t hash;
+    uint64_t check;
+    uint64_t first_line;     // 0 表示空槽（数据行从第2行开始）
+    long long first_offset;
+    int64_t group;           // 重复组下标，-1 表示目前只出现过一次
+} dup_slot_t;
+
+typedef struct {
+    dup_slot_t* slots;
+    size_t slot_cap;
+    size_t count;
+} dup_table_t;
+
+typedef struct {
+    char delim_char;
+    int multispace;
+    const parse_kernel_t* kernel;
+    int num_keys;            // 0 表示按整行判断
+    int key_cols[MAX_COLUMNS];
+    int max_col;
+    field_t* fields;
+    dup_group_t* groups;     // 所有分区共用的重复组列表
+    size_t num_groups;
+    size_t group_cap;
+    size_t group_memory;
+    FILE* source;            // 按偏移回读行内容：原始文件，转码输入为转码后的临时副本
+    int source_read;         // 临时副本刚被回读过，继续写入前要先定位到末尾
+    char* row;               // 回读的当前行（溢出分区中的记录不带内容）
+    size_t row_cap;
+    char* first;             // 回读的首次出现的行
+    size_t first_cap;
+    char* key;
+    size_t key_cap;
+    char* first_key;
+    size_t first_key_cap;
+} dup_ctx_t;
+
+// duplicates --fuzzy 的计划：行的规范化方式、MinHash 签名参数和分桶记录的分区文件
+typedef struct {
+    const parse_kernel_t* kernel;
+    int normalize;            // FUZZY_TRIM、FUZZY_CASE 的组合
+    int num_cols;             // 参与比较的列，规范化后按顺序拼接
+    int cols[MAX_COLUMNS];
+    int max_col;
+    double threshold;
+    int bands;                // 签名分为 bands 段，每段 band_rows 个值，任一段完全相同即为候选
+    int band_rows;
+    unsigned char probe[FUZZY_SIG_SIZE][FUZZY_SIG_SIZE];   // 空位置借用其他位置时的探查顺序
+    int part_bits;            // 分桶记录按哈希高位分到 1 << part_bits 个分区
+    FILE* parts[FUZZY_MAX_PARTS];
+    pthread_mutex_t parts_lock;
+} fuzzy_plan_t;
+
+// 分桶记录：某一段签名的哈希和行号（写入时为 线程号 << 40 | 线程内序号）
+typedef struct {
+    uint64_t key;
+    uint64_t row;
+} fuzzy_band_t;
+
+// duplicates --fuzzy 的工作线程：计算一个数据范围内各行的签名
+typedef struct {
+    fuzzy_plan_t* plan;
+    const char* filename;
+    long long start;
+    long long end;
+    int id;
+    FILE* sigs;               // 各行签名按行顺序写入临时文件
+    const uint32_t* sig_map;  // 第二阶段只读映射的签名
+    size_t sig_map_len;
+    uint64_t rows;
+    uint64_t first_row;       // 本线程第一行在所有数据行中的序号
+    fuzzy_band_t* buffers;    // 每个分区一个写缓冲
+    int* buffered;
+    int failed;
+} fuzzy_worker_t;
+
+// 近似重复组的成员：组内第一行的序号和本行序号
+typedef struct {
+    uint32_t root;
+    uint32_t row;
+} fuzzy_member_t;
+
+// 列存文件的列类型
+typedef enum {
+    COLUMN_INT64,
+    COLUMN_DOUBLE,
+    COLUMN_STRING
+} column_type_t;
+
+// 列存文件中一个列块的位置和统计信息
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t null_count;
+    uint64_t stats[2];        // 整数/浮点列为最小值和最大值（按位存放），字符串列为字典大小
+} column_chunk_meta_t;
+
+// 列存文件的一个行组：各列的列块依次存放
+typedef struct {
+    uint64_t rows;
+    column_chunk_meta_t* chunks;
+} row_group_meta_t;
+
+// convert 的转换计划：从样本推断出的表结构
+typedef struct {
+    const parse_kernel_t* kernel;
+    int num_columns;
+    const char** names;
+    column_type_t* types;
+    uint32_t group_rows;      // 每个行组的最大行数
+} convert_plan_t;
+
+// 一列在当前行组中的数据；字符串列按行组建字典，每行只存字典下标
+typedef struct {
+    uint8_t* validity;        // 有值的行对应位为1
+    int64_t* ints;
+    double* doubles;
+    uint32_t* indices;
+    char* dict_bytes;         // 字典中的字符串依次存放
+    size_t dict_len;
+    size_t dict_cap;
+    uint32_t* dict_offsets;   // 第i个字符串为 [offsets[i], offsets[i+1])
+    uint32_t dict_count;
+    uint32_t* slots;          // 字典哈希表，存放下标+1，0表示空槽
+    size_t slot_cap;
+    uint64_t null_count;
+    int has_value;
+    int64_t int_min;
+    int64_t int_max;
+    double double_min;
+    double double_max;
+} column_builder_t;
+
+// convert 的工作线程：把一个数据范围转换成若干行组
+typedef struct {
+    const convert_plan_t* plan;
+    const char* filename;
+    long long start;
+    long long end;
+    FILE* out;                // 第一个线程直接写输出文件，其余写临时文件
+    row_group_meta_t* groups;
+    int num_groups;
+    int group_cap;
+    long long rows;
+    long long* mismatched;    // 各列与推断类型不符、存为空值的个数
+    int failed;
+} convert_worker_t;
+
+// check --summary 的一个示例行：行号和截断后的内容
+typedef struct {
+    long long line;
+    int len;
+    int truncated;
+    char text[CHECK_EXAMPLE_BYTES];
+} check_example_t;
+
+// check --summary 的一类问题（某个列数，或某列的类型不符）：出现次数和最先出现的几个示例
+typedef struct {
+    long long lines;
+    int num_examples;
+    check_example_t* examples;   // 第一次出现时分配
+} check_bucket_t;
+
+// check --summary 的校验状态：内存只与列数和示例个数有关，与问题行的数量无关
+typedef struct {
+    const parse_kernel_t* kernel;
+    delimiter_type_t delim_type;
+    convert_plan_t schema;       // 列名取自表头，类型按开头的样本推断
+    int max_typed_col;           // 需要检查类型的最后一列，-1 表示全部为字符串
+    int max_examples;
+    long long lines;             // 含表头的总行数，也是当前行号
+    long long rows;              // 已检查的数据行
+    long long invalid_lines;
+    long long count_lines;       // 列数不同的行
+    long long type_lines;        // 列数正确但有值与类型不符的行
+    int stopped;                 // 达到 --max-errors 后提前停止
+    check_bucket_t counts[MAX_COLUMNS + 2];   // 按列数分布，最后一项为超过 MAX_COLUMNS 列
+    check_bucket_t* types;       // 各列的类型不符
+    long long* nulls;            // 各列的空值个数
+    field_t* fields;
+} check_profile_t;
+
+
+// serve 缓存文件中的一个不一致行
+typedef struct {
+    long long line;
+    int columns;
+    long long offset;
+} serve_bad_line_t;
+
+// serve 缓存的一个文件：内容读入内存，分隔符和表头在加载时检测，行索引和 check 结果首次用到时生成
+typedef struct {
+    char* path;               // 规范化后的绝对路径，作为缓存键
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;    // 与大小、inode 一起判断文件是否变化
+    const char* data;         // 读入内存的文件内容，空文件为NULL
+    size_t header_start;      // 表头偏移（跳过BOM）
+    size_t header_len;
+    size_t data_start;        // 第一条数据行的偏移
+    delimiter_type_t delim_type;
+    char delim_char;
+    encoding_t encoding;
+    int num_columns;
+    pthread_mutex_t lock;     // 保护下面按需生成的内容
+    long long* rows;          // 各数据行的起始偏移
+    long long num_rows;
+    int indexed;
+    int checked;
+    long long check_lines;
+    int expected_columns;
+    long long inconsistent_lines;
+    serve_bad_line_t* bad;    // 前 SERVE_MAX_REPORT 个不一致行
+    int num_bad;
+    int refs;                 // 正在使用该文件的请求数
+    int stale;                // 已移出缓存，最后一个使用者释放时卸载
+    uint64_t last_used;
+    size_t memory;            // 计入缓存预算的内存（文件内容和行索引）
+} serve_file_t;
+
+// serve 的文件缓存：按最近使用淘汰，文件数和索引内存都有上限
+typedef struct {
+    pthread_mutex_t lock;
+    serve_file_t* files[SERVE_MAX_FILES];
+    int count;
+    uint64_t tick;
+    size_t memory;
+    size_t budget;
+    uint64_t hits;
+    uint64_t misses;
+} serve_cache_t;
+
+// serve 的请求：一行一个JSON对象，只解析用到的键
+typedef struct {
+    char* id;          // 请求编号的JSON原文，原样写回响应
+    char* op;
+    char* file;
+    long long n;       // head/random 的行数
+    long long limit;   // check 最多返回的不一致行数
+    long long seed;    // random 的随机种子，0表示每次不同
+} serve_request_t;
+
+// 请求在事件循环和工作线程之间传递；完成后带着响应放回完成队列
+typedef struct serve_job {
+    struct serve_job* next;
+    int conn;
+    unsigned generation;
+    unsigned long long seq;   // 在连接内的提交序号，响应按序号写回
+    char* request;
+    size_t request_len;
+    char* response;
+    size_t response_len;
+} serve_job_t;
+
+// 客户端连接：输入按行切分成请求，响应攒在输出缓冲区中等待可写
+typedef struct {
+    int fd;                // -1 表示空闲槽位
+    unsigned generation;   // 槽位复用时递增，丢弃属于已关闭连接的响应
+    char* in;
+    size_t in_len;
+    size_t in_cap;
+    char* out;
+    size_t out_pos;
+    size_t out_len;
+    size_t out_cap;
+    int pending;           // 已提交尚未写回的请求数
+    int eof;               // 客户端已关闭写端
+    unsigned long long next_seq;   // 下一个提交的请求序号
+    unsigned long long write_seq;  // 下一个应写回的请求序号
+    serve_job_t* held;             // 已完成但前面还有请求未完成的响应，按序号排列
+} serve_conn_t;
+
+// 服务状态：工作线程从任务队列取请求，完成后通过管道唤醒事件循环
+typedef struct {
+    serve_cache_t cache;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    serve_job_t* jobs;
+    serve_job_t* jobs_tail;
+    int stopping;
+    pthread_mutex_t done_lock;
+    serve_job_t* done;
+    serve_job_t* done_tail;
+    uint64_t requests;
+    int wake[2];
+} serve_t;
+
+options_t g_options = { 0, DEFAULT_MEM_BUDGET, 0, FORMAT_TEXT, NULL, NULL, NULL, NULL, 0, 5000, NULL, NULL, 0, NULL, NULL, 0, 0, CHECK_DEFAULT_EXAMPLES };
+volatile sig_atomic_t g_follow_stop = 0;
+volatile sig_atomic_t g_serve_stop = 0;
+volatile int g_encoding_warned = 0;
+int g_exit_status = 0;   // 命令内部出错（如 --range/--rows 无效）时置1，作为进程退出码
+
+// 运行期内存池：列名、表达式、列表参数、重复组等元数据都从这里分配，
+// 不单独释放，退出时整体释放一次。只在主线程中使用
+arena_t g_run_arena = { NULL, 0 };
+intern_table_t g_strings = { NULL, 0, 0 };
+const char* column_type_names[] = { "int64", "double", "string" };
+const char* encoding_keys[] = { "utf-8", "utf-8-bom", "utf-16le", "utf-16be", "gb18030", "other", "unknown" };
+const char* delimiter_keys[] = { "tab", "comma", "semicolon", "pipe", "space", "multispace", "unknown" };
+const char* data_type_names[] = { "整数", "数值", "文本", "混合", "全空" };
+const char* data_type_keys[] = { "integer", "numeric", "text", "mixed", "empty" };
+const char* prof_phase_names[] = { "读取", "切分", "类型检测", "哈希", "输出" };
+const char* prof_phase_keys[] = { "read", "split", "classify", "hash", "write" };
+#ifdef DD_PROFILE
+__thread profile_counters_t g_prof_local;
+profile_counters_t g_prof_total;
+pthread_mutex_t g_prof_lock = PTHREAD_MUTEX_INITIALIZER;
+uint64_t g_prof_start_ticks;
+uint64_t g_prof_start_ns;
+#endif
+const char* agg_names[] = { "count", "sum", "mean", "min", "max", "distinct" };
+
+// 函数声明
+void show_usage(const char* program_name);
+delimiter_type_t detect_delimiter(const char* filename, char* delim_char);
+delimiter_type_t detect_delimiter_in_line(const char* line, char* delim_char);
+void analyze_file_stats(const char* filename, file_stats_t* stats);
+void extract_columns_by_number(const char* filename, const char* columns);
+void extract_columns_by_name(const char* filename, const char* columns);
+void filter_rows(const char* filename, const char* expression, const char* columns);
+void groupby_file(const char* filename, const char* key_spec, const char* agg_spec);
+void sort_file(const char* filename, const char* key_spec);
+void join_files(const char* left_file, const char* right_file, const char* key_spec, const char* mode_name);
+void convert_to_csv(const char* filename);
+void convert_file(const char* filename, const char* output);
+int convert_infer_schema(table_reader_t* table, convert_plan_t* plan, double tolerance);
+data_type_t convert_classify(const char* value, size_t len, int64_t* int_value, double* double_value);
+void* convert_worker_main(void* arg);
+void column_builder_init(column_builder_t* col, column_type_t type, uint32_t rows);
+void column_builder_reset(column_builder_t* col, uint32_t rows);
+void column_builder_free(column_builder_t* col);
+void column_builder_add(column_builder_t* col, column_type_t type, uint32_t row, const char* value, size_t len,
+                        long long* mismatched);
+uint32_t column_dict_index(column_builder_t* col, const char* value, size_t len);
+void convert_flush_group(convert_worker_t* worker, column_builder_t* cols, uint32_t rows);
+void convert_write_footer(FILE* out, const convert_plan_t* plan, const convert_worker_t* workers, int threads,
+                          const long long* bases, uint64_t total_rows);
+void write_padding(FILE* out);
+void write_u32(FILE* out, uint32_t value);
+void write_u64(FILE* out, uint64_t value);
+uint32_t read_u32(const unsigned char* p);
+uint64_t read_u64(const unsigned char* p);
+int columnar_is_file(const char* filename);
+void columnar_export_csv(const char* filename);
+void columnar_print_double(double value);
+void check_file_consistency(const char* filename);
+void write_stats_json(const char* filename, const file_stats_t* stats);
+void stats_consume_line(file_stats_t* stats, char* line, size_t len, field_t* fields);
+void print_file_stats(const char* filename, file_stats_t* stats);
+void check_consume_line(check_state_t* state, json_writer_t* json, char* line, size_t len);
+void check_print_summary(const char* filename, const check_state_t* state, json_writer_t* json);
+void follow_file(const char* filename, const char* command);
+void scan_state_init(scan_state_t* state, int is_check);
+void scan_state_reset(scan_state_t* state);
+void scan_consume_line(scan_state_t* state, json_writer_t* json, char* line, size_t len, field_t* fields);
+void scan_emit(const char* filename, scan_state_t* state, json_writer_t* json);
+int scan_state_save(const scan_state_t* state, const char* filename, const char* path);
+FILE* scan_state_begin(const scan_state_t* state, const char* filename, const char* path);
+int scan_state_finish(FILE* file, const scan_state_t* state, const char* path);
+void merge_states(int count, char** paths);
+int merge_compare(const void* a, const void* b);
+void check_emit_inconsistent(json_writer_t* json, long long line_number, int column_count, int expected,
+                             const char* line, size_t len);
+void check_begin_output(const char* filename, delimiter_type_t delim_type, json_writer_t* json);
+void check_file_profile(const char* filename);
+void check_profile_line(check_profile_t* profile, char* line, size_t len);
+int check_value_type(column_type_t type, const char* value, size_t len);
+void check_add_example(check_bucket_t* bucket, int max_examples, long long line, const char* text, size_t len);
+void check_print_profile(const char* filename, const check_profile_t* profile);
+void check_print_examples(const check_bucket_t* bucket, json_writer_t* json);
+void scan_partial(const char* filename, const char* command);
+int scan_state_load(scan_state_t* state, const char* path);
+void follow_signal_handler(int sig);
+void show_column_headers(const char* filename);
+void remove_duplicates(const char* filename);
+void show_duplicates(const char* filename);
+void dup_hash_row(dup_ctx_t* ctx, char* line, size_t len, dup_record_t* rec);
+void dup_consume(dup_ctx_t* ctx, dup_table_t* table, FILE** spill, int level, const dup_record_t* rec,
+                 char* line, size_t len);
+int dup_same_row(dup_ctx_t* ctx, dup_slot_t* slot, const dup_record_t* rec, char* line, size_t len);
+const char* dup_row_key(dup_ctx_t* ctx, char* line, size_t len, char** buf, size_t* cap, size_t* key_len);
+char* dup_read_row(dup_ctx_t* ctx, long long offset, char** buf, size_t* cap, size_t* len);
+void dup_process_spill(dup_ctx_t* ctx, FILE* file, int level);
+void dup_table_init(dup_table_t* table);
+dup_slot_t* dup_table_find(const dup_table_t* table, uint64_t hash, uint64_t check);
+dup_slot_t* dup_table_next(const dup_table_t* table, const dup_slot_t* slot, uint64_t hash, uint64_t check);
+void dup_table_grow(dup_table_t* table);
+void dup_group_add(dup_group_t* group, uint64_t line);
+int dup_group_compare(const void* a, const void* b);
+void show_fuzzy_duplicates(const char* filename);
+int fuzzy_parse_normalize(const char* spec);
+void fuzzy_choose_bands(fuzzy_plan_t* plan);
+void* fuzzy_worker_main(void* arg);
+size_t fuzzy_normalize_row(const fuzzy_plan_t* plan, field_t* fields, char* line, size_t len, char** text, size_t* cap);
+void fuzzy_signature(const fuzzy_plan_t* plan, const char* text, size_t len, uint32_t* sig);
+void fuzzy_emit_bands(fuzzy_worker_t* worker, const uint32_t* sig, uint64_t row);
+void fuzzy_flush_part(fuzzy_worker_t* worker, int part);
+const uint32_t* fuzzy_row_signature(const fuzzy_worker_t* workers, int threads, uint32_t row);
+double fuzzy_similarity(const uint32_t* a, const uint32_t* b);
+void fuzzy_process_part(const fuzzy_plan_t* plan, const fuzzy_worker_t* workers, int threads, FILE* part,
+                        uint32_t* parent);
+uint32_t fuzzy_find(uint32_t* parent, uint32_t x);
+void fuzzy_union(uint32_t* parent, uint32_t a, uint32_t b);
+void fuzzy_sort_bands(fuzzy_band_t* recs, size_t count);
+int fuzzy_band_compare(const void* a, const void* b);
+int fuzzy_member_compare(const void* a, const void* b);
+int fuzzy_row_compare(const void* a, const void* b);
+void random_sample_lines(const char* filename, int n_lines);
+void split_string(const char* input, const char* delimiter);
+void split_file_content(const char* filename, const char* delimiter);
+void split_set_init(split_set_t* set, const char* pattern, int split_lines);
+void split_set_add(split_set_t* set, const unsigned char* bytes, int n);
+size_t split_scan(const split_set_t* set, const char* data, size_t len, int at_eof, out_buffer_t* out);
+size_t split_next_candidate(const split_set_t* set, const char* data, size_t pos, size_t len);
+int split_match(const split_set_t* set, const char* data, size_t avail);
+void split_emit(const char* token, size_t len, out_buffer_t* out);
+void process_fasta_list(const char* filename);
+void process_fasta_extract(const char* filename, const char* sequence_names, const char* output_file);
+long long fasta_scan_parallel(const char* filename, const char* const* targets, int num_targets,
+                              FILE* output, long long* matched);
+long long fasta_align_start(FILE* file, long long pos, long long file_size);
+size_t fasta_find_record(const char* data, size_t len, int prev_newline);
+void* fasta_worker_main(void* arg);
+void fasta_finish_header(fasta_worker_t* worker);
+void fasta_copy_body(fasta_worker_t* worker, const char* data, size_t len);
+void chunk_output_init(chunk_output_t* out, size_t limit);
+void chunk_output_write(chunk_output_t* out, const char* data, size_t len);
+void chunk_output_drain(chunk_output_t* out, FILE* dest, long long* number);
+int is_fasta_file(const char* filename);
+data_type_t detect_data_type(const char* value);
+void trim_whitespace(char* str);
+int count_char_occurrences(const char* str, char ch);
+void format_file_size(long size, char* buffer);
+void* xmalloc(size_t size);
+void* xrealloc(void* ptr, size_t size);
+int line_reader_open(line_reader_t* reader, const char* filename);
+void line_reader_init(line_reader_t* reader, FILE* file, size_t buffer_size);
+int line_reader_open_range(line_reader_t* reader, const char* filename, long long start, long long end);
+int line_reader_seek(line_reader_t* reader, long long start, long long end);
+int line_reader_detect(line_reader_t* reader);
+size_t line_reader_fill(line_reader_t* reader, char* dest, size_t room);
+void line_reader_validate(line_reader_t* reader);
+int line_reader_rewind_to(line_reader_t* reader, long long target);
+encoding_t detect_encoding(const unsigned char* data, size_t len, size_t* bom);
+int utf8_validate(const unsigned char* data, size_t len, size_t* consumed);
+size_t utf8_char_length(const unsigned char* data, size_t len, size_t* invalid);
+int gb18030_plausible(const unsigned char* data, size_t len);
+const char* encoding_name(encoding_t encoding);
+char* line_reader_next(line_reader_t* reader, size_t* len);
+long long line_reader_tell(const line_reader_t* reader);
+void line_reader_close(line_reader_t* reader);
+int split_fields(char* line, size_t len, char delim, int multispace, field_t* fields, int max_fields);
+void field_at(char* line, size_t len, char delim, int multispace, int index, field_t* field);
+const parse_kernel_t* parse_kernel_select(char delim, int multispace);
+unsigned int parse_mask_short(const char* p, size_t n, char ch);
+#define DECLARE_PARSE_KERNEL(name) \
+    int split_##name(char* line, size_t len, field_t* fields, int max_fields); \
+    int count_##name(const char* line, size_t len); \
+    void field_at_##name(char* line, size_t len, int index, field_t* field);
+DECLARE_PARSE_KERNEL(tab)
+DECLARE_PARSE_KERNEL(comma)
+DECLARE_PARSE_KERNEL(semicolon)
+DECLARE_PARSE_KERNEL(pipe)
+DECLARE_PARSE_KERNEL(space)
+DECLARE_PARSE_KERNEL(multispace)
+DECLARE_PARSE_KERNEL(none)
+int table_open(table_reader_t* table, const char* filename);
+int table_find_column(const table_reader_t* table, const char* spec);
+int table_parse_columns(const table_reader_t* table, const char* spec, int* indices, int max_indices);
+void table_close(table_reader_t* table);
+int table_apply_window(table_reader_t* table);
+long long table_data_size(const table_reader_t* table);
+int parse_offset(const char* text, long long* value);
+int parse_span(const char* text, const char* option, long long* from, long long* to);
+int pred_accept(const char** cursor, const char* token);
+char* pred_read_word(const char** cursor);
+char* pred_read_regex(const char** cursor);
+int pred_compare_strings(const void* a, const void* b);
+pred_node_t* pred_new(pred_kind_t kind);
+pred_node_t* pred_parse_or(const table_reader_t* table, const char** cursor);
+pred_node_t* pred_parse_and(const table_reader_t* table, const char** cursor);
+pred_node_t* pred_parse_unary(const table_reader_t* table, const char** cursor);
+pred_node_t* pred_parse_comparison(const table_reader_t* table, const char** cursor);
+int pred_max_column(const pred_node_t* node);
+int pred_eval(const pred_node_t* node, field_t* fields, int field_count);
+void pred_free(pred_node_t* node);
+int field_to_double(const field_t* field, double* value);
+int field_compare(const field_t* field, const char* str, size_t str_len);
+int groupby_parse_aggs(const table_reader_t* table, const char* spec, groupby_plan_t* plan);
+void* groupby_worker_main(void* arg);
+void groupby_scratch_init(groupby_scratch_t* scratch, const groupby_plan_t* plan);
+void groupby_scratch_free(groupby_scratch_t* scratch);
+void groupby_consume(const groupby_plan_t* plan, groupby_scratch_t* scratch, group_table_t* primary,
+                     group_table_t* table, FILE** spill, int level, char* line, size_t len, long long offset);
+void groupby_process_spill(const groupby_plan_t* plan, group_table_t* primary, FILE** files, int num_files,
+                           int level, offset_runs_t* output);
+void groupby_print(const groupby_plan_t* plan, const group_table_t* table, FILE* out, int with_first);
+void groupby_add_run(const groupby_plan_t* plan, group_table_t* table, offset_runs_t* output);
+int group_entry_compare(const void* a, const void* b);
+void group_table_init(group_table_t* table, int num_aggs);
+group_entry_t* group_find(const group_table_t* table, uint64_t hash, const char* key, size_t key_len);
+group_entry_t* group_insert(group_table_t* table, uint64_t hash, const char* key, size_t key_len);
+void group_accumulate(group_table_t* table, group_entry_t* entry, const groupby_plan_t* plan,
+                      field_t* fields, int field_count);
+size_t agg_distinct_add(agg_state_t* state, uint64_t hash);
+void group_merge_entry(group_table_t* table, const group_entry_t* src);
+void group_table_free(group_table_t* table);
+int sort_parse_keys(const table_reader_t* table, const char* spec, sort_plan_t* plan);
+void sort_make_record(const sort_plan_t* plan, char* line, size_t len, sort_record_t* record);
+uint64_t double_sort_key(double value);
+int sort_compare(const sort_plan_t* plan, const sort_record_t* a, const sort_record_t* b);
+void sort_records(const sort_plan_t* plan, sort_record_t* records, sort_record_t* tmp, size_t count);
+void sort_merge_sorted(const sort_plan_t* plan, const sort_record_t* a, size_t na,
+                       const sort_record_t* b, size_t nb, sort_record_t* out);
+void* sort_worker_main(void* arg);
+void sort_records_parallel(const sort_plan_t* plan, sort_record_t* records, size_t count, int threads);
+int sort_merge_less(const sort_plan_t* plan, sort_merge_input_t* inputs, int a, int b);
+void sort_merge_advance(const sort_plan_t* plan, sort_merge_input_t* input);
+void sort_merge_runs(const sort_plan_t* plan, FILE** runs, int num_runs, FILE* out);
+void sort_loser_adjust(const sort_plan_t* plan, sort_merge_input_t* inputs, int* tree, int k, int s);
+int sort_merge_cascade(const sort_plan_t* plan, FILE** runs, int num_runs);
+void offset_runs_init(offset_runs_t* runs);
+FILE* offset_runs_add(offset_runs_t* runs);
+void offset_runs_merge(offset_runs_t* runs, FILE* out);
+void offset_runs_add_unsorted(offset_runs_t* runs, FILE* in);
+int join_parse_keys(const table_reader_t* left, const table_reader_t* right, const char* spec, join_ctx_t* ctx);
+uint64_t join_make_key(join_ctx_t* ctx, const join_side_t* side, char* line, size_t len, size_t* key_len);
+void join_write_partitions(join_ctx_t* ctx, line_reader_t* reader, const join_side_t* side, FILE** parts, int num_parts,
+                           int with_offset);
+void join_partition(join_ctx_t* ctx, line_reader_t* build, line_reader_t* probe, FILE* out, int with_offset);
+void join_emit(join_ctx_t* ctx, FILE* out, char* left_line, size_t left_len, char* right_line, size_t right_len);
+void join_table_init(join_table_t* table);
+join_key_t* join_table_find(const join_table_t* table, uint64_t hash, const char* key, size_t key_len);
+join_key_t* join_table_insert(join_table_t* table, uint64_t hash, const char* key, size_t key_len);
+void join_table_add_row(join_table_t* table, join_key_t* key, const char* line, size_t len, long long offset);
+void join_table_free(join_table_t* table);
+void* arena_alloc(arena_t* arena, size_t size);
+void arena_free(arena_t* arena);
+char* arena_strndup(arena_t* arena, const char* str, size_t len);
+const char* intern_string(const char* str, size_t len);
+void run_memory_release(void);
+int serve_main(const char* socket_path);
+int client_main(const char* socket_path, int count, char** requests);
+void serve_signal_handler(int sig);
+void serve_accept(serve_conn_t* conns, int listen_fd);
+void serve_read(serve_t* server, serve_conn_t* conns, int slot);
+void serve_submit(serve_t* server, serve_conn_t* conns, int slot, const char* line, size_t len);
+void serve_conn_append(serve_conn_t* conn, const char* data, size_t len);
+void serve_conn_deliver(serve_conn_t* conn, serve_job_t* job);
+int serve_conn_flush(serve_conn_t* conn);
+void serve_conn_close(serve_conn_t* conn);
+void* serve_worker_main(void* arg);
+char* serve_handle(serve_t* server, const char* line, size_t len, size_t* out_len);
+const char* serve_parse_request(const char* line, size_t len, serve_request_t* req);
+void serve_request_free(serve_request_t* req);
+char* json_parse_string(const char** cursor, const char* end);
+serve_file_t* serve_cache_acquire(serve_cache_t* cache, const char* path, const char** error);
+void serve_cache_release(serve_cache_t* cache, serve_file_t* file);
+void serve_cache_remove(serve_cache_t* cache, int index);
+int serve_cache_evict(serve_cache_t* cache, int max_files);
+serve_file_t* serve_file_load(char* path, const struct stat* st, const char** error);
+void serve_file_free(serve_file_t* file);
+void serve_file_index(serve_cache_t* cache, serve_file_t* file);
+void serve_file_check(serve_cache_t* cache, serve_file_t* file);
+size_t serve_line_length(const serve_file_t* file, size_t offset);
+void serve_do_head(const serve_file_t* file, const serve_request_t* req, json_writer_t* json);
+void serve_do_check(serve_cache_t* cache, serve_file_t* file, const serve_request_t* req, json_writer_t* json);
+void serve_do_random(serve_cache_t* cache, serve_file_t* file, const serve_request_t* req, json_writer_t* json);
+void serve_do_status(serve_t* server, json_writer_t* json);
+uint64_t splitmix64_next(uint64_t* state);
+uint64_t hash_bytes(const void* data, size_t len, uint64_t seed);
+long long get_file_size(const char* filename);
+int parse_size(const char* text, size_t* size);
+int parse_global_options(int* argc, char** argv);
+int choose_thread_count(long long data_size);
+void run_workers(void* (*worker)(void*), void* args, size_t arg_size, int count);
+void copy_stream(FILE* in, FILE* out);
+void out_buffer_init(out_buffer_t* buf, FILE* out);
+void out_buffer_write(out_buffer_t* buf, const char* data, size_t len);
+void out_buffer_close(out_buffer_t* buf);
+FILE* create_temp_file(void);
+int count_fields(const char* line, size_t len, char delim, int multispace);
+void json_init(json_writer_t* json, FILE* out, int ndjson);
+void json_begin_object(json_writer_t* json, const char* key);
+void json_end_object(json_writer_t* json);
+void json_begin_array(json_writer_t* json, const char* key);
+void json_end_array(json_writer_t* json);
+void json_string(json_writer_t* json, const char* key, const char* str, size_t len);
+void json_cstring(json_writer_t* json, const char* key, const char* str);
+void json_int(json_writer_t* json, const char* key, long long value);
+void json_double(json_writer_t* json, const char* key, double value);
+void json_bool(json_writer_t* json, const char* key, int value);
+void json_write_key(json_writer_t* json, const char* key);
+void json_write_escaped(FILE* out, const char* str, size_t len);
+void profile_start(void);
+void profile_report(void);
+#ifdef DD_PROFILE
+uint64_t profile_ticks(void);
+uint64_t profile_clock_ns(void);
+void profile_add(prof_phase_t phase, uint64_t ticks, uint64_t bytes);
+uint64_t profile_sample_begin(prof_phase_t phase);
+void profile_sample_end(prof_phase_t phase, uint64_t start, uint64_t bytes);
+void profile_flush_thread(void);
+void* profile_worker_main(void* arg);
+ssize_t profile_stdout_write(void* cookie, const char* data, size_t size);
+#endif
+
+// 各分隔符的解析内核，按 delimiter_type_t 的顺序排列
+const parse_kernel_t parse_kernels[] = {
+    { split_tab, count_tab, field_at_tab },
+    { split_comma, count_comma, field_at_comma },
+    { split_semicolon, count_semicolon, field_at_semicolon },
+    { split_pipe, count_pipe, field_at_pipe },
+    { split_space, count_space, field_at_space },
+    { split_multispace, count_multispace, field_at_multispace },
+    { split_none, count_none, field_at_none }
+};
+
+int main(int argc, char* argv[]) {
+    atexit(run_memory_release);
+    if (parse_global_options(&argc, argv) != 0) {
+        return 1;
+    }
+    if (g_options.profile) {
+        profile_start();
+    }
+    if (argc < 2) {
+        show_usage(argv[0]);
+        return 1;
+    }
+
+    const char* filename = argv[1];
+    const char* operation = (argc > 2) ? argv[2] : NULL;
+    const char* param3 = (argc > 3) ? argv[3] : NULL;
+
+    // --by、--fuzzy 只用于 duplicates，其他命令不能默默忽略
+    if ((g_options.by_columns || g_options.fuzzy > 0) && (!operation || strcmp(operation, "duplicates") != 0)) {
+        fprintf(stderr, "错误: --by/--fuzzy 只能用于 duplicates\n");
+        return 1;
+    }
+
+    // 字符串拆分功能
+    if (operation && strcmp(operation, "split") == 0) {
+        if (access(filename, F_OK) != 0) {
+            // 文件不存在，作为字符串处理
+            split_string(filename, param3);
+            return 0;
+        } else {
+            // 文件存在，拆分文件内容
+            split_file_content(filename, param3);
+            return 0;
+        }
+    }
+
+    // FASTA文件处理
+    if (operation && strcmp(operation, "fasta") == 0) {
+        if (!is_fasta_file(filename)) {
+            fprintf(stderr, "错误: 不是有效的FASTA格式文件\n");
+            return 1;
+        }
+        
+        if (param3 && strcmp(param3, "list") == 0) {
+            process_fasta_list(filename);
+        } else if (param3) {
+            const char* output_file = (argc > 4) ? argv[4] : NULL;
+            process_fasta_extract(filename, param3, output_file);
+        } else {
+            fprintf(stderr, "请指定要提取的序列名或使用 'list' 查看所有序列\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    // 合并各范围的部分状态文件
+    if (strcmp(filename, "merge") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "错误: 请指定要合并的状态文件\n");
+            fprintf(stderr, "用法: %s merge <状态文件> [状态文件...]\n", argv[0]);
+            return 1;
+        }
+        merge_states(argc - 2, argv + 2);
+        return 0;
+    }
+
+    // 服务模式及其客户端
+    if (strcmp(filename, "serve") == 0 || strcmp(filename, "client") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "错误: 请指定套接字路径\n");
+            fprintf(stderr, "用法: %s serve <套接字>\n", argv[0]);
+            fprintf(stderr, "      %s client <套接字> [请求...]\n", argv[0]);
+            return 1;
+        }
+        if (filename[0] == 's') {
+            return serve_main(argv[2]);
+        }
+        return client_main(argv[2], argc - 3, argv + 3);
+    }
+
+    // 检查文件是否存在
+    if (access(filename, F_OK) != 0) {
+        fprintf(stderr, "文件不存在: %s\n", filename);
+        return 1;
+    }
+
+    // 基础功能处理
+    if (!operation) {
+        // 仅检测分隔符
+        char delim_char;
+        delimiter_type_t delim = detect_delimiter(filename, &delim_char);
+        switch (delim) {
+            case DELIM_TAB: printf("TAB\n"); break;
+            case DELIM_COMMA: printf(",\n"); break;
+            case DELIM_SEMICOLON: printf(";\n"); break;
+            case DELIM_PIPE: printf("|\n"); break;
+            case DELIM_SPACE: printf(" \n"); break;
+            case DELIM_MULTISPACE: printf("MULTISPACE\n"); break;
+            default: printf("UNKNOWN\n"); break;
+        }
+    } else if (strcmp(operation, "head") == 0) {
+        show_column_headers(filename);
+    } else if ((strcmp(operation, "check") == 0 || strcmp(operation, "stats") == 0) &&
+               (g_options.follow || g_options.checkpoint)) {
+        follow_file(filename, operation);
+    } else if ((strcmp(operation, "check") == 0 || strcmp(operation, "stats") == 0) && g_options.state) {
+        scan_partial(filename, operation);
+    } else if (strcmp(operation, "check") == 0) {
+        check_file_consistency(filename);
+    } else if (strcmp(operation, "stats") == 0) {
+        file_stats_t* stats = xmalloc(sizeof(file_stats_t));
+        analyze_file_stats(filename, stats);
+        free(stats);
+    } else if (strcmp(operation, "csv") == 0) {
+        convert_to_csv(filename);
+    } else if (strcmp(operation, "convert") == 0) {
+        if (!param3) {
+            fprintf(stderr, "错误: 请指定输出文件\n");
+            fprintf(stderr, "用法: %s <文件路径> convert <输出文件>\n", argv[0]);
+            return 1;
+        }
+        convert_file(filename, param3);
+    } else if (strcmp(operation, "dedup") == 0) {
+        remove_duplicates(filename);
+    } else if (strcmp(operation, "duplicates") == 0) {
+        show_duplicates(filename);
+    } else if (strcmp(operation, "filter") == 0) {
+        if (!param3) {
+            fprintf(stderr, "错误: 请指定筛选表达式\n");
+            fprintf(stderr, "用法: %s <文件路径> filter <表达式> [列,...]\n", argv[0]);
+            return 1;
+        }
+        const char* columns = (argc > 4) ? argv[4] : NULL;
+        filter_rows(filename, param3, columns);
+    } else if (strcmp(operation, "groupby") == 0) {
+        if (!param3 || argc < 5) {
+            fprintf(stderr, "错误: 请指定分组列和聚合函数\n");
+            fprintf(stderr, "用法: %s <文件路径> groupby <分组列,...> <聚合:列,...>\n", argv[0]);
+            return 1;
+        }
+        groupby_file(filename, param3, argv[4]);
+    } else if (strcmp(operation, "sort") == 0) {
+        if (!param3) {
+            fprintf(stderr, "错误: 请指定排序列\n");
+            fprintf(stderr, "用法: %s <文件路径> sort <列[:n][:r],...>\n", argv[0]);
+            return 1;
+        }
+        sort_file(filename, param3);
+    } else if (strcmp(operation, "join") == 0) {
+        if (!param3 || argc < 5) {
+            fprintf(stderr, "错误: 请指定另一个文件和连接列\n");
+            fprintf(stderr, "用法: %s <左表> join <右表> <列[=右表列],...> [inner|left|anti]\n", argv[0]);
+            return 1;
+        }
+        if (access(param3, F_OK) != 0) {
+            fprintf(stderr, "文件不存在: %s\n", param3);
+            return 1;
+        }
+        join_files(filename, param3, argv[4], (argc > 5) ? argv[5] : NULL);
+    } else if (strcmp(operation, "random") == 0) {
+        if (!param3) {
+            fprintf(stderr, "错误: 请指定要随机抽取的行数\n");
+            fprintf(stderr, "用法: %s <文件路径> random <行数>\n", argv[0]);
+            return 1;
+        }
+        int n_lines = atoi(param3);
+        if (n_lines <= 0) {
+            fprintf(stderr, "错误: 行数必须是正整数\n");
+            return 1;
+        }
+        random_sample_lines(filename, n_lines);
+    } else if (strstr(operation, ",") != NULL && strspn(operation, "0123456789,") == strlen(operation)) {
+        // 按列号提取
+        extract_columns_by_number(filename, operation);
+    } else {
+        // 按列名提取
+        extract_columns_by_name(filename, operation);
+    }
+
+    return g_exit_status;
+}
+
+void show_usage(const char* program_name) {
+    printf("detect_delim - 多功能数据处理工具 (C语言版)\n");
+    printf("自动检测分隔符 & 编码，支持表格数据分析、FASTA序列处理、字符串拆分等功能\n\n");
+    
+    printf("=== 基础功能 ===\n");
+    printf("  %s <文件路径>                    # 检测文件分隔符\n", program_name);
+    printf("  %s <文件路径> head               # 显示列名和对应列号\n", program_name);
+    printf("  %s <文件路径> check              # 检查数据完整性\n", program_name);
+    printf("\n");
+    
+    printf("=== 数据提取与转换 ===\n");
+    printf("  %s <文件路径> <列号,...>         # 按列号提取数据\n", program_name);
+    printf("  %s <文件路径> <列名,...>         # 按列名模糊匹配提取\n", program_name);
+    printf("  %s <文件路径> csv               # 转换为标准CSV格式（列存文件导出为CSV）\n", program_name);
+    printf("  %s <文件路径> convert <输出文件>  # 推断列类型，转换为带行组和字典编码的列存文件\n", program_name);
+    printf("  %s <文件路径> sort <列[:n][:r],...>  # 按列排序（n数值 r降序），支持超大文件\n", program_name);
+    printf("  %s <左表> join <右表> <列[=右表列],...> [inner|left|anti]  # 按键连接两个文件\n", program_name);
+    printf("  %s <文件路径> filter <表达式> [列,...]  # 按条件筛选行，可同时提取列\n", program_name);
+    printf("    表达式: 列名或$列号 与 == != < <= > >= ~(正则) !~ in(a,b) 组合 && || ! ()\n");
+    printf("\n");
+    
+    printf("=== 数据分析 ===\n");
+    printf("  %s <文件路径> stats             # 详细统计分析\n", program_name);
+    printf("  %s <文件路径> duplicates [--by 列,...]  # 检测并显示重复行详情，可只按指定列判断\n", program_name);
+    printf("  %s <文件路径> duplicates --fuzzy[=0.8] [--normalize trim,case] [--ignore 列,...]  # 近似重复检测（MinHash）\n", program_name);
+    printf("  %s <文件路径> dedup             # 去除重复行\n", program_name);
+    printf("  %s <文件路径> random <行数>     # 随机抽取N行数据\n", program_name);
+    printf("  %s <文件路径> groupby <分组列,...> <聚合:列,...>  # 分组聚合\n", program_name);
+    printf("    聚合函数: count sum mean min max distinct，如 count,sum:reads,mean:expr\n");
+    printf("  %s merge <状态文件> [状态文件...]  # 合并各范围的 stats/check 部分结果\n", program_name);
+    printf("\n");
+    
+    printf("=== 服务模式 ===\n");
+    printf("  %s serve <套接字>               # 常驻服务，缓存文件内容、表头和行索引\n", program_name);
+    printf("  %s client <套接字> [请求...]    # 发送JSON请求（无参数时从标准输入逐行读取）\n", program_name);
+    printf("    请求示例: {\"id\":1,\"op\":\"head\",\"file\":\"data.csv\",\"n\":5}\n");
+    printf("    op: head check random status\n");
+    printf("\n");
+    
+    printf("=== 全局选项 ===\n");
+    printf("  --threads <N>                     # 工作线程数（默认CPU核数）\n");
+    printf("  --mem <大小>                      # 内存预算，超出后溢出到临时文件（默认1G）\n");
+    printf("  --profile[=json]                  # 退出时向stderr输出各阶段耗时（需 make profile 编译）\n");
+    printf("  --format <text|json|ndjson>       # stats/check/duplicates 输出结构化结果\n");
+    printf("  --follow [--interval <秒>]        # stats/check 持续处理文件新追加的内容，定期输出\n");
+    printf("  --checkpoint <文件>               # stats/check 保存处理进度，下次从上次位置继续\n");
+    printf("  --range <起始:结束>               # 只处理该字节范围内开始的数据行（如 0:1G），可用于分布式处理\n");
+    printf("  --rows <a:b>                      # 只处理第a到第b个数据行（从1开始，含两端）\n");
+    printf("  --state <文件>                    # stats/check 输出可合并的部分状态，用 merge 合并\n");
+    printf("  --encoding <编码>                 # 指定输入编码（如 gbk、utf-16le），默认自动检测并转为UTF-8\n");
+    printf("  --fuzzy[=阈值]                    # duplicates 按相似度找近似重复行（默认0.8）\n");
+    printf("  --normalize <trim,case|none>      # --fuzzy 比较前的规范化方式（默认 trim,case）\n");
+    printf("  --ignore <列,...>                 # --fuzzy 比较时忽略的列\n");
+    printf("  --summary [--examples <N>]        # check 检查列数和列类型，汇总为分布和每类前N个示例（默认3个）\n");
+    printf("  --max-errors <N>                  # check 发现N个问题行后停止\n");
+    printf("\n");
+    
+    printf("=== 字符串处理 ===\n");
+    printf("  %s \"字符串\" split [分隔符]      # 拆分字符串并换行显示\n", program_name);
+    printf("  %s <文件路径> split [分隔符]     # 拆分文件内容\n", program_name);
+    printf("    支持分隔符: 中文逗号(、) 英文逗号(,) 分号(;) 竖线(|) 空格\n");
+    printf("\n");
+    
+    printf("=== FASTA序列处理 ===\n");
+    printf("  %s <fasta文件> fasta list                    # 列出所有序列名称\n", program_name);
+    printf("  %s <fasta文件> fasta <序列名>                # 提取单个序列\n", program_name);
+    printf("  %s <fasta文件> fasta <序列名1,序列名2,...>   # 批量提取序列\n", program_name);
+    printf("  %s <fasta文件> fasta <序列名> [输出文件]     # 提取序列并保存\n", program_name);
+    printf("    支持模糊匹配: 如 'Stx' 可匹配 'Stx1', 'Stx2' 等\n");
+    printf("\n");
+    
+    printf("=== 使用示例 ===\n");
+    printf("  %s data.txt                      # 检测分隔符\n", program_name);
+    printf("  %s data.txt stats               # 数据统计分析\n", program_name);
+    printf("  %s \"Stx1、Stx2、LT\" split       # 拆分毒素基因名\n", program_name);
+    printf("  %s sequences.fa fasta Stx       # 提取Stx相关序列\n", program_name);
+}
+
+delimiter_type_t detect_delimiter(const char* filename, char* delim_char) {
+    *delim_char = '\0';
+    // 通过行读取器读取第一行，非UTF-8文件先转码
+    line_reader_t reader;
+    if (line_reader_open(&reader, filename) != 0) {
+        return DELIM_UNKNOWN;
+    }
+    size_t len;
+    char* line = line_reader_next(&reader, &len);
+    delimiter_type_t result = line ? detect_delimiter_in_line(line, delim_char) : DELIM_UNKNOWN;
+    line_reader_close(&reader);
+    return result;
+}
+
+delimiter_type_t detect_delimiter_in_line(const char* line, char* delim_char) {
+    *delim_char = '\0';
+    // 统计各种分隔符的出现次数
+    int tab_count = count_char_occurrences(line, '\t');
+    int comma_count = count_char_occurrences(line, ',');
+    int semicolon_count = count_char_occurrences(line, ';');
+    int pipe_count = count_char_occurrences(line, '|');
+    int space_count = count_char_occurrences(line, ' ');
+
+    // 检查是否有多个连续空格
+    int multispace = (strstr(line, "  ") != NULL) ? 1 : 0;
+
+    // 确定最可能的分隔符
+    int max_count = 0;
+    delimiter_type_t result = DELIM_UNKNOWN;
+
+    if (tab_count > max_count) {
+        max_count = tab_count;
+        result = DELIM_TAB;
+        *delim_char = '\t';
+    }
+    if (comma_count > max_count) {
+        max_count = comma_count;
+        result = DELIM_COMMA;
+        *delim_char = ',';
+    }
+    if (semicolon_count > max_count) {
+        max_count = semicolon_count;
+        result = DELIM_SEMICOLON;
+        *delim_char = ';';
+    }
+    if (pipe_count > max_count) {
+        max_count = pipe_count;
+        result = DELIM_PIPE;
+        *delim_char = '|';
+    }
+    if (space_count > max_count && !multispace) {
+        max_count = space_count;
+        result = DELIM_SPACE;
+        *delim_char = ' ';
+    }
+    if (multispace && space_count > 0) {
+        result = DELIM_MULTISPACE;
+        *delim_char = ' ';
+    }
+
+    return result;
+}
+
+void analyze_file_stats(const char* filename, file_stats_t* stats) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    // 获取文件大小
+    stats->file_size = (long)get_file_size(filename);
+
+    // 检测分隔符
+    stats->delimiter = table.delim_type;
+    stats->delimiter_char = table.delim_char;
+    stats->kernel = table.kernel;
+    stats->encoding = table.reader.encoding;
+
+    // 读取并分析数据，字段直接在行缓冲区中切分；表头总是先处理，范围从文件中间开始时也能得到列名
+    field_t* fields = xmalloc(MAX_COLUMNS * sizeof(field_t));
+    char* line;
+    size_t len;
+    if (table.num_columns > 0) {
+        stats_consume_line(stats, table.header_line, table.header_len, fields);
+    }
+    while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+        stats_consume_line(stats, line, len, fields);
+    }
+    free(fields);
+    table_close(&table);
+
+    print_file_stats(filename, stats);
+}
+
+void stats_consume_line(file_stats_t* stats, char* line, size_t len, field_t* fields) {
+    const parse_kernel_t* kernel = stats->kernel;
+    stats->lines++;
+    
+    if (stats->lines == 1) {
+        // 计算列数并保存列名
+        stats->total_columns = kernel->count(line, len);
+        int count = kernel->split(line, len, fields, MAX_COLUMNS);
+        for (int i = 0; i < count; i++) {
+            stats->columns[i].name = intern_string(fields[i].ptr, fields[i].len);
+        }
+        return;
+    }
+
+    stats->total_rows++;
+    
+    // 分析每列的数据
+    int count = kernel->split(line, len, fields, MAX_COLUMNS);
+    for (int col_index = 0; col_index < count && col_index < stats->total_columns; col_index++) {
+        char* token = fields[col_index].ptr;
+        token[fields[col_index].len] = '\0';
+        trim_whitespace(token);
+        
+        if (token[0] == '\0') {
+            stats->columns[col_index].empty_count++;
+        } else {
+            stats->columns[col_index].non_empty_count++;
+            
+            data_type_t type = detect_data_type(token);
+            switch (type) {
+                case DATA_INTEGER:
+                    stats->columns[col_index].numeric_count++;
+                    break;
+                case DATA_FLOAT:
+                    stats->columns[col_index].float_count++;
+                    break;
+                case DATA_TEXT:
+                    stats->columns[col_index].text_count++;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+void print_file_stats(const char* filename, file_stats_t* stats) {
+    // 确定每列的数据类型
+    for (int i = 0; i < stats->total_columns && i < MAX_COLUMNS; i++) {
+        column_stats_t* col = &stats->columns[i];
+        int total_non_empty = col->non_empty_count;
+        if (total_non_empty == 0) {
+            col->data_type = DATA_EMPTY;
+        } else if (col->numeric_count == total_non_empty) {
+            col->data_type = DATA_INTEGER;
+        } else if (col->numeric_count + col->float_count == total_non_empty) {
+            col->data_type = DATA_FLOAT;
+        } else if (col->text_count == total_non_empty) {
+            col->data_type = DATA_TEXT;
+        } else {
+            col->data_type = DATA_MIXED;
+        }
+    }
+
+    if (g_options.format != FORMAT_TEXT) {
+        write_stats_json(filename, stats);
+        return;
+    }
+
+    printf("=== 文件统计信息 ===\n");
+    
+    // 显示分隔符
+    switch (stats->delimiter) {
+        case DELIM_TAB: printf("分隔符: TAB\n"); break;
+        case DELIM_COMMA: printf("分隔符: ,\n"); break;
+        case DELIM_SEMICOLON: printf("分隔符: ;\n"); break;
+        case DELIM_PIPE: printf("分隔符: |\n"); break;
+        case DELIM_SPACE: printf("分隔符: 空格\n"); break;
+        case DELIM_MULTISPACE: printf("分隔符: 多空格\n"); break;
+        default: printf("分隔符: 未知\n"); break;
+    }
+    printf("编码: %s\n", encoding_name(stats->encoding));
+
+    // 显示文件大小
+    char size_str[64];
+    format_file_size(stats->file_size, size_str);
+    printf("文件大小: %s\n", size_str);
+
+    printf("总列数: %d\n", stats->total_columns);
+    printf("总行数: %lld (不含表头)\n", stats->total_rows);
+    printf("\n=== 各列统计 ===\n");
+
+    // 显示每列的统计信息
+    for (int i = 0; i < stats->total_columns && i < MAX_COLUMNS; i++) {
+        printf("列 %d (%s):\n", i+1, stats->columns[i].name ? stats->columns[i].name : "");
+        
+        float empty_percent = stats->total_rows > 0 ? 
+            (float)stats->columns[i].empty_count * 100.0 / stats->total_rows : 0.0;
+        printf("  空值: %lld (%.1f%%)\n", stats->columns[i].empty_count, empty_percent);
+        printf("  数据类型: %s\n", data_type_names[stats->columns[i].data_type]);
+        printf("\n");
+    }
+}
+
+void write_stats_json(const char* filename, const file_stats_t* stats) {
+    json_writer_t json;
+    json_init(&json, stdout, g_options.format == FORMAT_NDJSON);
+    
+    // json: 一个对象，列统计放在columns数组中；ndjson: 每列一行，最后一行为汇总
+    if (!json.ndjson) {
+        json_begin_object(&json, NULL);
+        json_cstring(&json, "file", filename);
+        json_cstring(&json, "delimiter", delimiter_keys[stats->delimiter]);
+        json_cstring(&json, "encoding", encoding_name(stats->encoding));
+        json_int(&json, "file_size", stats->file_size);
+        json_int(&json, "columns", stats->total_columns);
+        json_int(&json, "rows", stats->total_rows);
+        json_begin_array(&json, "column_stats");
+    }
+    for (int i = 0; i < stats->total_columns && i < MAX_COLUMNS; i++) {
+        const column_stats_t* col = &stats->columns[i];
+        json_begin_object(&json, NULL);
+        if (json.ndjson) {
+            json_cstring(&json, "type", "column");
+        }
+        json_int(&json, "index", i + 1);
+        json_cstring(&json, "name", col->name ? col->name : "");
+        json_int(&json, "empty", col->empty_count);
+        json_int(&json, "non_empty", col->non_empty_count);
+        json_int(&json, "integer", col->numeric_count);
+        json_int(&json, "float", col->float_count);
+        json_int(&json, "text", col->text_count);
+        json_cstring(&json, "data_type", data_type_keys[col->data_type]);
+        json_end_object(&json);
+    }
+    if (json.ndjson) {
+        json_begin_object(&json, NULL);
+        json_cstring(&json, "type", "summary");
+        json_cstring(&json, "file", filename);
+        json_cstring(&json, "delimiter", delimiter_keys[stats->delimiter]);
+        json_cstring(&json, "encoding", encoding_name(stats->encoding));
+        json_int(&json, "file_size", stats->file_size);
+        json_int(&json, "columns", stats->total_columns);
+        json_int(&json, "rows", stats->total_rows);
+    } else {
+        json_end_array(&json);
+    }
+    json_end_object(&json);
+}
+
+void extract_columns_by_number(const char* filename, const char* columns) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    // 解析列号，同时记录最大列号
+    int col_indices[MAX_COLUMNS];
+    int num_cols = 0;
+    int max_col = 0;
+    
+    char* cols_copy = arena_strndup(&g_run_arena, columns, strlen(columns));
+    
+    char* token = strtok(cols_copy, ",");
+    while (token != NULL && num_cols < MAX_COLUMNS) {
+        col_indices[num_cols] = atoi(token) - 1; // 转换为0基索引
+        if (col_indices[num_cols] > max_col) {
+            max_col = col_indices[num_cols];
+        }
+        num_cols++;
+        token = strtok(NULL, ",");
+    }
+
+    // 每行只切分到最大请求列为止，其余字段直接跳过。
+    // 表头按普通行处理，但只有范围包含文件开头时才输出
+    field_t* fields = xmalloc((max_col + 1) * sizeof(field_t));
+    char* line = table.header_line;
+    size_t len = table.header_len;
+    if (!table.include_header || table.num_columns == 0) {
+        line = line_reader_next(&table.reader, &len);
+    }
+    while (line != NULL) {
+        int field_count = table.kernel->split(line, len, fields, max_col + 1);
+        
+        // 按请求顺序输出指定列（可重复、可乱序）
+        for (int i = 0; i < num_cols; i++) {
+            if (i > 0) putchar(',');
+            if (col_indices[i] >= 0 && col_indices[i] < field_count) {
+                fwrite(fields[col_indices[i]].ptr, 1, fields[col_indices[i]].len, stdout);
+            }
+        }
+        putchar('\n');
+        line = line_reader_next(&table.reader, &len);
+    }
+
+    free(fields);
+    table_close(&table);
+}
+
+void extract_columns_by_name(const char* filename, const char* columns) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+    char delim_char = table.delim_char;
+    int multispace = table.multispace;
+
+    int num_target_cols = 0;
+    int found_indices[MAX_COLUMNS];
+    int max_col = 0;
+    
+    // 解析目标列名，转换为小写以便比较
+    const char* target_cols[MAX_COLUMNS];
+    char* cols_copy = arena_strndup(&g_run_arena, columns, strlen(columns));
+    
+    char* token = strtok(cols_copy, ",");
+    while (token != NULL && num_target_cols < MAX_COLUMNS) {
+        trim_whitespace(token);
+        for (int i = 0; token[i]; i++) {
+            token[i] = tolower((unsigned char)token[i]);
+        }
+        target_cols[num_target_cols] = intern_string(token, strlen(token));
+        found_indices[num_target_cols] = -1;
+        num_target_cols++;
+        token = strtok(NULL, ",");
+    }
+
+    // 在表头中找到匹配的列
+    char* line = table.header_line;
+    size_t len = table.header_len;
+    if (table.num_columns > 0) {
+        int header_cap = count_char_occurrences(line, multispace ? ' ' : delim_char) + 1;
+        field_t* header = xmalloc(header_cap * sizeof(field_t));
+        int header_count = split_fields(line, len, delim_char, multispace, header, header_cap);
+        char* field_lower = arena_alloc(&g_run_arena, len + 1);
+        
+        for (int field_index = 0; field_index < header_count; field_index++) {
+            size_t n = header[field_index].len;
+            
+            // 转换为小写
+            for (size_t i = 0; i < n; i++) {
+                field_lower[i] = tolower((unsigned char)header[field_index].ptr[i]);
+            }
+            field_lower[n] = '\0';
+            
+            // 检查是否匹配任何目标列名
+            for (int i = 0; i < num_target_cols; i++) {
+                if (strstr(field_lower, target_cols[i]) != NULL) {
+                    found_indices[i] = field_index;
+                }
+            }
+        }
+        
+        // 输出表头（范围不包含文件开头时省略）
+        for (int i = 0; i < num_target_cols; i++) {
+            if (i > 0 && table.include_header) putchar(',');
+            if (found_indices[i] >= 0) {
+                if (table.include_header) {
+                    fwrite(header[found_indices[i]].ptr, 1, header[found_indices[i]].len, stdout);
+                }
+                if (found_indices[i] > max_col) {
+                    max_col = found_indices[i];
+                }
+            }
+        }
+        if (table.include_header) putchar('\n');
+        free(header);
+    }
+
+    // 处理数据行，只切分到最右侧的匹配列
+    field_t* fields = xmalloc((max_col + 1) * sizeof(field_t));
+    const parse_kernel_t* kernel = parse_kernel_select(delim_char, multispace);
+    while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+        int field_count = kernel->split(line, len, fields, max_col + 1);
+        
+        // 输出匹配的列
+        for (int i = 0; i < num_target_cols; i++) {
+            if (i > 0) putchar(',');
+            if (found_indices[i] >= 0 && found_indices[i] < field_count) {
+                fwrite(fields[found_indices[i]].ptr, 1, fields[found_indices[i]].len, stdout);
+            }
+        }
+        putchar('\n');
+    }
+
+    free(fields);
+    table_close(&table);
+}
+
+void filter_rows(const char* filename, const char* expression, const char* columns) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    // 表达式只编译一次，之后对每行直接求值
+    const char* cursor = expression;
+    pred_node_t* pred = pred_parse_or(&table, &cursor);
+    if (pred) {
+        while (isspace((unsigned char)*cursor)) cursor++;
+        if (*cursor) {
+            fprintf(stderr, "错误: 表达式解析失败，位置: %s\n", cursor);
+            pred_free(pred);
+            pred = NULL;
+        }
+    }
+    if (!pred) {
+        g_exit_status = 1;
+        table_close(&table);
+        return;
+    }
+
+    // 可选的列投影
+    int col_indices[MAX_COLUMNS];
+    int num_cols = 0;
+    if (columns) {
+        num_cols = table_parse_columns(&table, columns, col_indices, MAX_COLUMNS);
+        if (num_cols < 0) {
+            g_exit_status = 1;
+            pred_free(pred);
+            table_close(&table);
+            return;
+        }
+    }
+
+    // 只需切分到谓词和投影中用到的最右一列
+    int max_col = pred_max_column(pred);
+    for (int i = 0; i < num_cols; i++) {
+        if (col_indices[i] > max_col) max_col = col_indices[i];
+    }
+    field_t* fields = xmalloc((max_col + 1) * sizeof(field_t));
+
+    // 输出表头（范围不包含文件开头时省略，便于直接拼接各部分的结果）
+    if (table.include_header && num_cols > 0) {
+        for (int i = 0; i < num_cols; i++) {
+            if (i > 0) putchar(',');
+            if (col_indices[i] < table.num_columns) {
+                fputs(table.names[col_indices[i]], stdout);
+            }
+        }
+        putchar('\n');
+    } else if (table.include_header) {
+        fwrite(table.header_line, 1, table.header_len, stdout);
+        putchar('\n');
+    }
+
+    char* line;
+    size_t len;
+    while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+        int field_count = table.kernel->split(line, len, fields, max_col + 1);
+        if (!pred_eval(pred, fields, field_count)) {
+            continue;
+        }
+        
+        if (num_cols == 0) {
+            // split_fields不修改行内容，可直接输出原始行
+            fwrite(line, 1, len, stdout);
+        } else {
+            for (int i = 0; i < num_cols; i++) {
+                if (i > 0) putchar(',');
+                if (col_indices[i] < field_count) {
+                    fwrite(fields[col_indices[i]].ptr, 1, fields[col_indices[i]].len, stdout);
+                }
+            }
+        }
+        putchar('\n');
+    }
+
+    free(fields);
+    pred_free(pred);
+    table_close(&table);
+}
+
+// 跳过空白后检查是否以指定记号开头，是则消费该记号
+int pred_accept(const char** cursor, const char* token) {
+    const char* p = *cursor;
+    while (isspace((unsigned char)*p)) p++;
+    size_t n = strlen(token);
+    if (strncmp(p, token, n) != 0) {
+        return 0;
+    }
+    // 关键字（and/or/in）后必须是分隔字符
+    if (isalpha((unsigned char)token[0]) && (isalnum((unsigned char)p[n]) || p[n] == '_')) {
+        return 0;
+    }
+    *cursor = p + n;
+    return 1;
+}
+
+// 读取一个词：引号字符串或连续的非分隔字符，返回新分配的字符串
+char* pred_read_word(const char** cursor) {
+    const char* p = *cursor;
+    while (isspace((unsigned char)*p)) p++;
+    
+    const char* start = p;
+    size_t n;
+    if (*p == '"' || *p == '\'') {
+        char quote = *p++;
+        start = p;
+        while (*p && *p != quote) p++;
+        if (*p != quote) {
+            return NULL;
+        }
+        n = p - start;
+        p++;
+    } else {
+        while (*p && !isspace((unsigned char)*p) && !strchr("()!=<>~,&|", *p)) p++;
+        n = p - start;
+        if (n == 0) {
+            return NULL;
+        }
+    }
+    
+    char* word = arena_strndup(&g_run_arena, start, n);
+    *cursor = p;
+    return word;
+}
+
+// 读取正则操作数：引号字符串，或到空白、未配对的右括号、&&、|| 为止，
+// 因此不加引号的 ^BRCA(1|2) 也能整体读入；转义字符和 [...] 中的字符不参与判断
+char* pred_read_regex(const char** cursor) {
+    const char* p = *cursor;
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '"' || *p == '\'') {
+        return pred_read_word(cursor);
+    }
+    
+    const char* start = p;
+    int depth = 0;
+    while (*p && !isspace((unsigned char)*p)) {
+        if (*p == '\\' && p[1]) {
+            p += 2;
+            continue;
+        }
+        if (*p == '[') {
+            // 方括号表达式：开头的 ] 或 ^] 是普通字符
+            const char* q = p + 1;
+            if (*q == '^') q++;
+            if (*q == ']') q++;
+            while (*q && *q != ']') q++;
+            if (*q == ']') {
+                p = q + 1;
+                continue;
+            }
+        }
+        if (depth == 0 && (strncmp(p, "&&", 2) == 0 || strncmp(p, "||", 2) == 0)) break;
+        if (*p == '(') depth++;
+        if (*p == ')') {
+            if (depth == 0) break;
+            depth--;
+        }
+        p++;
+    }
+    size_t n = p - start;
+    if (n == 0) {
+        return NULL;
+    }
+    
+    char* word = arena_strndup(&g_run_arena, start, n);
+    *cursor = p;
+    return word;
+}
+
+int pred_compare_strings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+pred_node_t* pred_new(pred_kind_t kind) {
+    pred_node_t* node = arena_alloc(&g_run_arena, sizeof(pred_node_t));
+    memset(node, 0, sizeof(pred_node_t));
+    node->kind = kind;
+    return node;
+}
+
+pred_node_t* pred_parse_or(const table_reader_t* table, const char** cursor) {
+    pred_node_t* left = pred_parse_and(table, cursor);
+    while (left && (pred_accept(cursor, "||") || pred_accept(cursor, "or"))) {
+        pred_node_t* right = pred_parse_and(table, cursor);
+        if (!right) {
+            pred_free(left);
+            return NULL;
+        }
+        pred_node_t* node = pred_new(PRED_OR);
+        node->left = left;
+        node->right = right;
+        left = node;
+    }
+    return left;
+}
+
+pred_node_t* pred_parse_and(const table_reader_t* table, const char** cursor) {
+    pred_node_t* left = pred_parse_unary(table, cursor);
+    while (left && (pred_accept(cursor, "&&") || pred_accept(cursor, "and"))) {
+        pred_node_t* right = pred_parse_unary(table, cursor);
+        if (!right) {
+            pred_free(left);
+            return NULL;
+        }
+        pred_node_t* node = pred_new(PRED_AND);
+        node->left = left;
+        node->right = right;
+        left = node;
+    }
+    return left;
+}
+
+pred_node_t* pred_parse_unary(const table_reader_t* table, const char** cursor) {
+    if (pred_accept(cursor, "!") || pred_accept(cursor, "not")) {
+        pred_node_t* child = pred_parse_unary(table, cursor);
+        if (!child) {
+            return NULL;
+        }
+        pred_node_t* node = pred_new(PRED_NOT);
+        node->left = child;
+        return node;
+    }
+    if (pred_accept(cursor, "(")) {
+        pred_node_t* node = pred_parse_or(table, cursor);
+        if (node && !pred_accept(cursor, ")")) {
+            fprintf(stderr, "错误: 表达式缺少右括号\n");
+            pred_free(node);
+            return NULL;
+        }
+        return node;
+    }
+    return pred_parse_comparison(table, cursor);
+}
+
+pred_node_t* pred_parse_comparison(const table_reader_t* table, const char** cursor) {
+    char* column_name = pred_read_word(cursor);
+    if (!column_name) {
+        fprintf(stderr, "错误: 表达式中缺少列名: %s\n", *cursor);
+        return NULL;
+    }
+    int column = table_find_column(table, column_name);
+    if (column < 0) {
+        fprintf(stderr, "错误: 找不到列: %s\n", column_name);
+        return NULL;
+    }
+
+    pred_node_t* node;
+    if (pred_accept(cursor, "in")) {
+        // 集合匹配：col in (a,b,c)，排序后二分查找
+        node = pred_new(PRED_IN);
+        node->column = column;
+        if (!pred_accept(cursor, "(") && !pred_accept(cursor, "{")) {
+            fprintf(stderr, "错误: in 之后需要 (值1,值2,...)\n");
+            pred_free(node);
+            return NULL;
+        }
+        int cap = 8;
+        node->set = arena_alloc(&g_run_arena, cap * sizeof(char*));
+        do {
+            char* value = pred_read_word(cursor);
+            if (!value) {
+                fprintf(stderr, "错误: in 集合中的值无效\n");
+                pred_free(node);
+                return NULL;
+            }
+            if (node->set_size == cap) {
+                char** bigger = arena_alloc(&g_run_arena, 2 * cap * sizeof(char*));
+                memcpy(bigger, node->set, cap * sizeof(char*));
+                node->set = bigger;
+                cap *= 2;
+            }
+            node->set[node->set_size++] = value;
+        } while (pred_accept(cursor, ","));
+        if (!pred_accept(cursor, ")") && !pred_accept(cursor, "}")) {
+            fprintf(stderr, "错误: in 集合缺少右括号\n");
+            pred_free(node);
+            return NULL;
+        }
+        qsort(node->set, node->set_size, sizeof(char*), pred_compare_strings);
+        return node;
+    }
+
+    int is_regex = 0;
+    int negate = 0;
+    cmp_op_t op = CMP_EQ;
+    if (pred_accept(cursor, "!~")) { is_regex = 1; negate = 1; }
+    else if (pred_accept(cursor, "~")) { is_regex = 1; }
+    else if (pred_accept(cursor, "==")) { op = CMP_EQ; }
+    else if (pred_accept(cursor, "!=")) { op = CMP_NE; }
+    else if (pred_accept(cursor, "<=")) { op = CMP_LE; }
+    else if (pred_accept(cursor, ">=")) { op = CMP_GE; }
+    else if (pred_accept(cursor, "<")) { op = CMP_LT; }
+    else if (pred_accept(cursor, ">")) { op = CMP_GT; }
+    else if (pred_accept(cursor, "=")) { op = CMP_EQ; }
+    else {
+        fprintf(stderr, "错误: 无法识别的比较运算符: %s\n", *cursor);
+        return NULL;
+    }
+
+    char* value = is_regex ? pred_read_regex(cursor) : pred_read_word(cursor);
+    if (!value) {
+        fprintf(stderr, "错误: 比较运算符之后缺少值\n");
+        return NULL;
+    }
+
+    if (is_regex) {
+        node = pred_new(PRED_REGEX);
+        node->column = column;
+        node->negate = negate;
+        int rc = regcomp(&node->regex, value, REG_EXTENDED | REG_NOSUB);
+        if (rc != 0) {
+            char msg[256];
+            regerror(rc, &node->regex, msg, sizeof(msg));
+            fprintf(stderr, "错误: 正则表达式无效 '%s': %s\n", value, msg);
+            return NULL;
+        }
+        node->has_regex = 1;
+        return node;
+    }
+
+    // 值能解析为数字时按数值比较，否则按字符串比较
+    node = pred_new(PRED_CMP);
+    node->column = column;
+    node->op = op;
+    node->str = value;
+    node->str_len = strlen(value);
+    char* endptr;
+    node->num = strtod(value, &endptr);
+    node->is_numeric = (endptr != value && *endptr == '\0');
+    return node;
+}
+
+int pred_max_column(const pred_node_t* node) {
+    if (!node) {
+        return 0;
+    }
+    if (node->kind == PRED_AND || node->kind == PRED_OR || node->kind == PRED_NOT) {
+        int left = pred_max_column(node->left);
+        int right = pred_max_column(node->right);
+        return left > right ? left : right;
+    }
+    return node->column;
+}
+
+// 将字段解析为数字（字段不一定以'\0'结尾，临时截断后再恢复）
+int field_to_double(const field_t* field, double* value) {
+    if (field->len == 0) {
+        return 0;
+    }
+    char saved = field->ptr[field->len];
+    field->ptr[field->len] = '\0';
+    char* endptr;
+    *value = strtod(field->ptr, &endptr);
+    while (isspace((unsigned char)*endptr)) endptr++;
+    int ok = (endptr != field->ptr && *endptr == '\0');
+    field->ptr[field->len] = saved;
+    return ok;
+}
+
+int field_compare(const field_t* field, const char* str, size_t str_len) {
+    size_t n = field->len < str_len ? field->len : str_len;
+    int cmp = memcmp(field->ptr, str, n);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (field->len > str_len) - (field->len < str_len);
+}
+
+int pred_eval(const pred_node_t* node, field_t* fields, int field_count) {
+    switch (node->kind) {
+        case PRED_AND:
+            return pred_eval(node->left, fields, field_count) && pred_eval(node->right, fields, field_count);
+        case PRED_OR:
+            return pred_eval(node->left, fields, field_count) || pred_eval(node->right, fields, field_count);
+        case PRED_NOT:
+            return !pred_eval(node->left, fields, field_count);
+        default:
+            break;
+    }
+
+    // 行中缺失的列按空字符串处理
+    static char empty[1] = "";
+    field_t missing = { empty, 0 };
+    field_t* field = node->column < field_count ? &fields[node->column] : &missing;
+
+    if (node->kind == PRED_REGEX) {
+        char saved = field->ptr[field->len];
+        field->ptr[field->len] = '\0';
+        int matched = (regexec(&node->regex, field->ptr, 0, NULL, 0) == 0);
+        field->ptr[field->len] = saved;
+        return matched != node->negate;
+    }
+
+    if (node->kind == PRED_IN) {
+        int lo = 0, hi = node->set_size - 1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            int cmp = field_compare(field, node->set[mid], strlen(node->set[mid]));
+            if (cmp == 0) return 1;
+            if (cmp < 0) hi = mid - 1; else lo = mid + 1;
+        }
+        return 0;
+    }
+
+    int cmp;
+    if (node->is_numeric) {
+        double value;
+        if (!field_to_double(field, &value)) {
+            // 非数值字段：只有不等比较成立
+            return node->op == CMP_NE;
+        }
+        cmp = (value > node->num) - (value < node->num);
+    } else {
+        cmp = field_compare(field, node->str, node->str_len);
+    }
+
+    switch (node->op) {
+        case CMP_EQ: return cmp == 0;
+        case CMP_NE: return cmp != 0;
+        case CMP_LT: return cmp < 0;
+        case CMP_LE: return cmp <= 0;
+        case CMP_GT: return cmp > 0;
+        case CMP_GE: return cmp >= 0;
+    }
+    return 0;
+}
+
+void pred_free(pred_node_t* node) {
+    if (!node) {
+        return;
+    }
+    pred_free(node->left);
+    pred_free(node->right);
+    // 节点本身在运行期内存池中，这里只释放正则
+    if (node->has_regex) {
+        regfree(&node->regex);
+    }
+}
+
+void groupby_file(const char* filename, const char* key_spec, const char* agg_spec) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        return;
+    }
+
+    groupby_plan_t plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.delim_char = table.delim_char;
+    plan.multispace = table.multispace;
+    plan.kernel = table.kernel;
+    plan.num_keys = table_parse_columns(&table, key_spec, plan.key_cols, MAX_COLUMNS);
+    if (plan.num_keys <= 0 || groupby_parse_aggs(&table, agg_spec, &plan) != 0) {
+        g_exit_status = 1;
+        table_close(&table);
+        return;
+    }
+    for (int i = 0; i < plan.num_keys; i++) {
+        if (plan.key_cols[i] > plan.max_col) plan.max_col = plan.key_cols[i];
+    }
+    for (int i = 0; i < plan.num_aggs; i++) {
+        if (plan.aggs[i].column > plan.max_col) plan.max_col = plan.aggs[i].column;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    // 按线程数划分数据区间（区间边界由读取器对齐到行首）
+    long long data_start = table.data_start;
+    long long data_end = table.data_end;
+    // 转码输入的偏移只能顺序解码得到，不分块
+    int threads = data_end >= 0 ? choose_thread_count(data_end - data_start) : 1;
+    plan.mem_budget = g_options.mem_budget / threads;
+
+    // 输出表头
+    for (int i = 0; i < plan.num_keys; i++) {
+        if (i > 0) putchar(',');
+        if (plan.key_cols[i] < table.num_columns) fputs(table.names[plan.key_cols[i]], stdout);
+    }
+    for (int i = 0; i < plan.num_aggs; i++) {
+        printf(",%s", agg_names[plan.aggs[i].kind]);
+        if (plan.aggs[i].kind != AGG_COUNT) {
+            printf("(%s)", plan.aggs[i].column < table.num_columns ? table.names[plan.aggs[i].column] : "");
+        }
+    }
+    putchar('\n');
+    table_close(&table);
+
+    groupby_worker_t* workers = xmalloc(threads * sizeof(groupby_worker_t));
+    long long chunk = (data_end - data_start) / threads;
+    for (int t = 0; t < threads; t++) {
+        memset(&workers[t], 0, sizeof(groupby_worker_t));
+        workers[t].plan = &plan;
+        workers[t].filename = filename;
+        workers[t].start = data_start + chunk * t;
+        workers[t].end = (t == threads - 1) ? data_end : data_start + chunk * (t + 1);
+    }
+    run_workers(groupby_worker_main, workers, sizeof(groupby_worker_t), threads);
+
+    // 各线程的局部结果按区间顺序合并，保持分组首次出现的顺序
+    group_table_t* merged = &workers[0].table;
+    for (int t = 1; t < threads; t++) {
+        for (size_t i = 0; i < workers[t].table.count; i++) {
+            group_merge_entry(merged, &workers[t].table.entries[i]);
+        }
+        group_table_free(&workers[t].table);
+    }
+
+    // 处理溢出到磁盘的分区；各分区的结果与内存中的分组都写成按首行偏移排序的有序段，
+    // 最后归并输出，使分组顺序与 --mem 无关，始终按首次出现排列
+    offset_runs_t output;
+    offset_runs_init(&output);
+    for (int p = 0; p < GROUPBY_PARTITIONS; p++) {
+        FILE* files[MAX_THREADS];
+        int num_files = 0;
+        for (int t = 0; t < threads; t++) {
+            if (workers[t].spill[p]) files[num_files++] = workers[t].spill[p];
+        }
+        if (num_files == 0) continue;
+        groupby_process_spill(&plan, merged, files, num_files, 1, &output);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        if (workers[t].failed) {
+            fprintf(stderr, "无法打开文件: %s\n", filename);
+            g_exit_status = 1;
+        }
+    }
+    if (output.num_runs == 0) {
+        // 没有溢出：各线程按区间顺序合并的结果已是首次出现的顺序
+        groupby_print(&plan, merged, stdout, 0);
+    } else {
+        groupby_add_run(&plan, merged, &output);
+        offset_runs_merge(&output, stdout);
+    }
+
+    group_table_free(merged);
+    free(workers);
+}
+
+int groupby_parse_aggs(const table_reader_t* table, const char* spec, groupby_plan_t* plan) {
+    char* spec_copy = arena_strndup(&g_run_arena, spec, strlen(spec));
+    
+    char* token = strtok(spec_copy, ",");
+    while (token != NULL && plan->num_aggs < MAX_COLUMNS) {
+        trim_whitespace(token);
+        char* column = strchr(token, ':');
+        if (column) *column++ = '\0';
+        
+        int kind = -1;
+        for (int k = 0; k <= AGG_DISTINCT; k++) {
+            if (strcasecmp(token, agg_names[k]) == 0) kind = k;
+        }
+        if (kind < 0) {
+            fprintf(stderr, "错误: 不支持的聚合函数: %s (可用: count,sum,mean,min,max,distinct)\n", token);
+            return -1;
+        }
+        
+        agg_spec_t* agg = &plan->aggs[plan->num_aggs];
+        agg->kind = kind;
+        agg->column = 0;
+        if (kind != AGG_COUNT) {
+            if (!column || !*column) {
+                fprintf(stderr, "错误: 聚合函数 %s 需要指定列，如 %s:列名\n", token, token);
+                return -1;
+            }
+            agg->column = table_find_column(table, column);
+            if (agg->column < 0) {
+                fprintf(stderr, "错误: 找不到列: %s\n", column);
+                return -1;
+            }
+        }
+        plan->num_aggs++;
+        token = strtok(NULL, ",");
+    }
+    return 0;
+}
+
+void* groupby_worker_main(void* arg) {
+    groupby_worker_t* worker = arg;
+    const groupby_plan_t* plan = worker->plan;
+    group_table_init(&worker->table, plan->num_aggs);
+
+    line_reader_t reader;
+    if (line_reader_open_range(&reader, worker->filename, worker->start, worker->end) != 0) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    groupby_scratch_t scratch;
+    groupby_scratch_init(&scratch, plan);
+    char* line;
+    size_t len;
+    long long offset = line_reader_tell(&reader);
+    while ((line = line_reader_next(&reader, &len)) != NULL) {
+        groupby_consume(plan, &scratch, NULL, &worker->table, worker->spill, 0, line, len, offset);
+        offset = line_reader_tell(&reader);
+    }
+    groupby_scratch_free(&scratch);
+    line_reader_close(&reader);
+    return NULL;
+}
+
+void groupby_scratch_init(groupby_scratch_t* scratch, const groupby_plan_t* plan) {
+    scratch->fields = xmalloc((plan->max_col + 1) * sizeof(field_t));
+    scratch->key_cap = 256;
+    scratch->key = xmalloc(scratch->key_cap);
+}
+
+void groupby_scratch_free(groupby_scratch_t* scratch) {
+    free(scratch->fields);
+    free(scratch->key);
+}
+
+void groupby_consume(const groupby_plan_t* plan, groupby_scratch_t* scratch, group_table_t* primary,
+                     group_table_t* table, FILE** spill, int level, char* line, size_t len, long long offset) {
+    int field_count = plan->kernel->split(line, len, scratch->fields, plan->max_col + 1);
+
+    // 拼接分组键，各键列之间用\x1f分隔
+    size_t key_len = 0;
+    for (int i = 0; i < plan->num_keys; i++) {
+        int col = plan->key_cols[i];
+        size_t n = col < field_count ? scratch->fields[col].len : 0;
+        if (key_len + n + 1 > scratch->key_cap) {
+            while (key_len + n + 1 > scratch->key_cap) scratch->key_cap *= 2;
+            scratch->key = xrealloc(scratch->key, scratch->key_cap);
+        }
+        if (i > 0) scratch->key[key_len++] = '\x1f';
+        if (n > 0) memcpy(scratch->key + key_len, scratch->fields[col].ptr, n);
+        key_len += n;
+    }
+    uint64_t hash = hash_bytes(scratch->key, key_len, 0);
+
+    group_entry_t* entry = NULL;
+    if (primary) {
+        entry = group_find(primary, hash, scratch->key, key_len);
+        if (entry) {
+            // 溢出文件来自多个线程，偏移不是递增的，首次出现的位置取最小值
+            if (offset < entry->first) entry->first = offset;
+            group_accumulate(primary, entry, plan, scratch->fields, field_count);
+            return;
+        }
+    }
+    entry = group_find(table, hash, scratch->key, key_len);
+    if (entry) {
+        if (offset < entry->first) entry->first = offset;
+    } else {
+        if (spill && table->memory >= plan->mem_budget) {
+            // 内存预算已满：新分组的行按哈希高位写入溢出分区，行前带上原始偏移
+            int part = (int)((hash >> (60 - 4 * level)) & (GROUPBY_PARTITIONS - 1));
+            if (!spill[part]) {
+                spill[part] = create_temp_file();
+                if (!spill[part]) {
+                    fprintf(stderr, "错误: 无法创建临时文件\n");
+                    exit(1);
+                }
+            }
+            fprintf(spill[part], "%lld,", offset);
+            fwrite(line, 1, len, spill[part]);
+            fputc('\n', spill[part]);
+            return;
+        }
+        entry = group_insert(table, hash, scratch->key, key_len);
+        entry->first = offset;
+    }
+    group_accumulate(table, entry, plan, scratch->fields, field_count);
+}
+
+void groupby_process_spill(const groupby_plan_t* plan, group_table_t* primary, FILE** files, int num_files,
+                           int level, offset_runs_t* output) {
+    group_table_t table;
+    group_table_init(&table, plan->num_aggs);
+    FILE* sub_spill[GROUPBY_PARTITIONS] = { NULL };
+    FILE** spill = (level < GROUPBY_MAX_LEVEL) ? sub_spill : NULL;
+
+    groupby_scratch_t scratch;
+    groupby_scratch_init(&scratch, plan);
+    for (int i = 0; i < num_files; i++) {
+        rewind(files[i]);
+        line_reader_t reader;
+        line_reader_init(&reader, files[i], READ_BUFFER_SIZE);
+        char* line;
+        size_t len;
+        while ((line = line_reader_next(&reader, &len)) != NULL) {
+            char* rest;
+            long long offset = strtoll(line, &rest, 10);
+            rest++;
+            groupby_consume(plan, &scratch, primary, &table, spill, level, rest, len - (size_t)(rest - line), offset);
+        }
+        line_reader_close(&reader);
+    }
+    groupby_scratch_free(&scratch);
+
+    // 本分区的分组已完整，写成有序段后释放
+    groupby_add_run(plan, &table, output);
+    group_table_free(&table);
+
+    for (int p = 0; p < GROUPBY_PARTITIONS; p++) {
+        if (sub_spill[p]) {
+            groupby_process_spill(plan, NULL, &sub_spill[p], 1, level + 1, output);
+        }
+    }
+}
+
+void groupby_add_run(const groupby_plan_t* plan, group_table_t* table, offset_runs_t* output) {
+    if (table->count == 0) {
+        return;
+    }
+    // 排序打乱了条目下标，之后只能输出，不能再查找
+    qsort(table->entries, table->count, sizeof(group_entry_t), group_entry_compare);
+    groupby_print(plan, table, offset_runs_add(output), 1);
+}
+
+int group_entry_compare(const void* a, const void* b) {
+    const group_entry_t* ea = a;
+    const group_entry_t* eb = b;
+    if (ea->first != eb->first) {
+        return ea->first < eb->first ? -1 : 1;
+    }
+    return 0;
+}
+
+void groupby_print(const groupby_plan_t* plan, const group_table_t* table, FILE* out, int with_first) {
+    for (size_t i = 0; i < table->count; i++) {
+        const group_entry_t* entry = &table->entries[i];
+        if (with_first) fprintf(out, "%lld,", entry->first);
+        for (uint32_t k = 0; k < entry->key_len; k++) {
+            fputc(entry->key[k] == '\x1f' ? ',' : entry->key[k], out);
+        }
+        for (int a = 0; a < plan->num_aggs; a++) {
+            const agg_state_t* state = &entry->aggs[a];
+            fputc(',', out);
+            switch (plan->aggs[a].kind) {
+                case AGG_COUNT: fprintf(out, "%lld", entry->rows); break;
+                case AGG_SUM: fprintf(out, "%.15g", state->sum); break;
+                case AGG_MEAN: if (state->count > 0) fprintf(out, "%.15g", state->sum / state->count); break;
+                case AGG_MIN: if (state->count > 0) fprintf(out, "%.15g", state->min); break;
+                case AGG_MAX: if (state->count > 0) fprintf(out, "%.15g", state->max); break;
+                case AGG_DISTINCT: fprintf(out, "%u", state->distinct_size); break;
+            }
+        }
+        fputc('\n', out);
+    }
+}
+
+void group_table_init(group_table_t* table, int num_aggs) {
+    memset(table, 0, sizeof(group_table_t));
+    table->num_aggs = num_aggs;
+    table->slot_cap = 1024;
+    table->slots = xmalloc(table->slot_cap * sizeof(group_slot_t));
+    memset(table->slots, 0, table->slot_cap * sizeof(group_slot_t));
+    table->entry_cap = 256;
+    table->entries = xmalloc(table->entry_cap * sizeof(group_entry_t));
+    table->memory = table->slot_cap * sizeof(group_slot_t) + table->entry_cap * sizeof(group_entry_t);
+}
+
+group_entry_t* group_find(const group_table_t* table, uint64_t hash, const char* key, size_t key_len) {
+    size_t mask = table->slot_cap - 1;
+    for (size_t i = hash & mask; table->slots[i].index != 0; i = (i + 1) & mask) {
+        if (table->slots[i].hash == hash) {
+            group_entry_t* entry = &table->entries[table->slots[i].index - 1];
+            if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+                return entry;
+            }
+        }
+    }
+    return NULL;
+}
+
+group_entry_t* group_insert(group_table_t* table, uint64_t hash, const char* key, size_t key_len) {
+    // 负载因子超过0.7时扩容，槽位中保存了哈希值，无需重新计算
+    if ((table->count + 1) * 10 > table->slot_cap * 7) {
+        size_t new_cap = table->slot_cap * 2;
+        group_slot_t* slots = xmalloc(new_cap * sizeof(group_slot_t));
+        memset(slots, 0, new_cap * sizeof(group_slot_t));
+        for (size_t i = 0; i < table->slot_cap; i++) {
+            if (table->slots[i].index == 0) continue;
+            size_t j = table->slots[i].hash & (new_cap - 1);
+            while (slots[j].index != 0) j = (j + 1) & (new_cap - 1);
+            slots[j] = table->slots[i];
+        }
+        free(table->slots);
+        table->memory += (new_cap - table->slot_cap) * sizeof(group_slot_t);
+        table->slots = slots;
+        table->slot_cap = new_cap;
+    }
+    if (table->count == table->entry_cap) {
+        table->memory += table->entry_cap * sizeof(group_entry_t);
+        table->entry_cap *= 2;
+        table->entries = xrealloc(table->entries, table->entry_cap * sizeof(group_entry_t));
+    }
+
+    group_entry_t* entry = &table->entries[table->count++];
+    entry->hash = hash;
+    entry->key_len = (uint32_t)key_len;
+    entry->key = arena_alloc(&table->arena, key_len + 1);
+    memcpy(entry->key, key, key_len);
+    entry->key[key_len] = '\0';
+    entry->rows = 0;
+    entry->aggs = arena_alloc(&table->arena, table->num_aggs * sizeof(agg_state_t));
+    memset(entry->aggs, 0, table->num_aggs * sizeof(agg_state_t));
+    table->memory += key_len + 1 + table->num_aggs * sizeof(agg_state_t);
+
+    size_t mask = table->slot_cap - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index != 0) i = (i + 1) & mask;
+    table->slots[i].hash = hash;
+    table->slots[i].index = (uint32_t)table->count;
+    return entry;
+}
+
+void group_accumulate(group_table_t* table, group_entry_t* entry, const groupby_plan_t* plan,
+                      field_t* fields, int field_count) {
+    entry->rows++;
+    for (int a = 0; a < plan->num_aggs; a++) {
+        const agg_spec_t* agg = &plan->aggs[a];
+        if (agg->kind == AGG_COUNT) continue;
+        
+        agg_state_t* state = &entry->aggs[a];
+        if (agg->column >= field_count) continue;
+        field_t* field = &fields[agg->column];
+        
+        if (agg->kind == AGG_DISTINCT) {
+            table->memory += agg_distinct_add(state, hash_bytes(field->ptr, field->len, 0));
+            continue;
+        }
+        
+        double value;
+        if (!field_to_double(field, &value)) continue;
+        if (state->count == 0 || value < state->min) state->min = value;
+        if (state->count == 0 || value > state->max) state->max = value;
+        state->sum += value;
+        state->count++;
+    }
+}
+
+size_t agg_distinct_add(agg_state_t* state, uint64_t hash) {
+    size_t grown = 0;
+    if (hash == 0) hash = 1;  // 0 表示空槽
+    if ((state->distinct_size + 1) * 4 > state->distinct_cap * 3) {
+        uint32_t new_cap = state->distinct_cap ? state->distinct_cap * 2 : 8;
+        uint64_t* set = xmalloc(new_cap * sizeof(uint64_t));
+        memset(set, 0, new_cap * sizeof(uint64_t));
+        for (uint32_t i = 0; i < state->distinct_cap; i++) {
+            if (!state->distinct[i]) continue;
+            uint32_t j = state->distinct[i] & (new_cap - 1);
+            while (set[j]) j = (j + 1) & (new_cap - 1);
+            set[j] = state->distinct[i];
+        }
+        free(state->distinct);
+        grown = (new_cap - state->distinct_cap) * sizeof(uint64_t);
+        state->distinct = set;
+        state->distinct_cap = new_cap;
+    }
+    uint32_t mask = state->distinct_cap - 1;
+    uint32_t i = hash & mask;
+    while (state->distinct[i]) {
+        if (state->distinct[i] == hash) return grown;
+        i = (i + 1) & mask;
+    }
+    state->distinct[i] = hash;
+    state->distinct_size++;
+    return grown;
+}
+
+void group_merge_entry(group_table_t* table, const group_entry_t* src) {
+    group_entry_t* dst = group_find(table, src->hash, src->key, src->key_len);
+    if (!dst) {
+        dst = group_insert(table, src->hash, src->key, src->key_len);
+        dst->first = src->first;
+    }
+    if (src->first < dst->first) dst->first = src->first;
+    dst->rows += src->rows;
+    for (int a = 0; a < table->num_aggs; a++) {
+        agg_state_t* d = &dst->aggs[a];
+        const agg_state_t* s = &src->aggs[a];
+        if (s->count > 0) {
+            if (d->count == 0 || s->min < d->min) d->min = s->min;
+            if (d->count == 0 || s->max > d->max) d->max = s->max;
+            d->sum += s->sum;
+            d->count += s->count;
+        }
+        for (uint32_t i = 0; i < s->distinct_cap; i++) {
+            if (s->distinct[i]) table->memory += agg_distinct_add(d, s->distinct[i]);
+        }
+    }
+}
+
+void group_table_free(group_table_t* table) {
+    for (size_t i = 0; i < table->count; i++) {
+        for (int a = 0; a < table->num_aggs; a++) {
+            free(table->entries[i].aggs[a].distinct);
+        }
+    }
+    free(table->slots);
+    free(table->entries);
+    arena_free(&table->arena);
+    memset(table, 0, sizeof(group_table_t));
+}
+
+void sort_file(const char* filename, const char* key_spec) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        return;
+    }
+
+    sort_plan_t plan;
+    if (sort_parse_keys(&table, key_spec, &plan) != 0 || table_apply_window(&table) != 0) {
+        g_exit_status = 1;
+        table_close(&table);
+        return;
+    }
+
+    // 表头保留在第一行（范围不包含文件开头时省略）
+    if (table.include_header) {
+        fwrite(table.header_line, 1, table.header_len, stdout);
+        putchar('\n');
+    }
+
+    int threads = choose_thread_count(table_data_size(&table));
+    size_t budget = g_options.mem_budget;
+
+    FILE* runs[MAX_SORT_RUNS];
+    int num_runs = 0;
+    sort_record_t* records = NULL;
+    size_t record_cap = 0;
+    
+    for (;;) {
+        // 读入一批数据直到内存预算用完
+        arena_t arena = { NULL, 0 };
+        size_t count = 0;
+        size_t run_bytes = 0;
+        char* line;
+        size_t len;
+        while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+            if (count == record_cap) {
+                record_cap = record_cap ? record_cap * 2 : 65536;
+                records = xrealloc(records, record_cap * sizeof(sort_record_t));
+            }
+            char* copy = arena_alloc(&arena, len + 1);
+            memcpy(copy, line, len + 1);
+            sort_make_record(&plan, copy, len, &records[count++]);
+            run_bytes += len + 1 + sizeof(sort_record_t);
+            if (run_bytes >= budget) {
+                break;
+            }
+        }
+        int at_end = (line == NULL);
+        
+        sort_records_parallel(&plan, records, count, threads);
+        
+        if (at_end && num_runs == 0) {
+            // 数据全部装入内存，直接输出
+            for (size_t i = 0; i < count; i++) {
+                fwrite(records[i].line, 1, records[i].len, stdout);
+                putchar('\n');
+            }
+            arena_free(&arena);
+            break;
+        }
+        
+        if (count > 0) {
+            if (num_runs == MAX_SORT_RUNS) {
+                num_runs = sort_merge_cascade(&plan, runs, num_runs);
+            }
+            FILE* run = create_temp_file();
+            if (!run) {
+                fprintf(stderr, "错误: 无法创建临时文件\n");
+                exit(1);
+            }
+            for (size_t i = 0; i < count; i++) {
+                fwrite(records[i].line, 1, records[i].len, run);
+                fputc('\n', run);
+            }
+            runs[num_runs++] = run;
+        }
+        arena_free(&arena);
+        
+        if (at_end) {
+            // 多路归并所有有序段
+            while (num_runs > MAX_MERGE_FANIN) {
+                num_runs = sort_merge_cascade(&plan, runs, num_runs);
+            }
+            sort_merge_runs(&plan, runs, num_runs, stdout);
+            for (int i = 0; i < num_runs; i++) {
+                fclose(runs[i]);
+            }
+            break;
+        }
+    }
+
+    free(records);
+    table_close(&table);
+}
+
+int sort_parse_keys(const table_reader_t* table, const char* spec, sort_plan_t* plan) {
+    memset(plan, 0, sizeof(sort_plan_t));
+    plan->delim_char = table->delim_char;
+    plan->multispace = table->multispace;
+    plan->kernel = table->kernel;
+
+    char* spec_copy = arena_strndup(&g_run_arena, spec, strlen(spec));
+    
+    char* token = strtok(spec_copy, ",");
+    while (token != NULL) {
+        if (plan->num_keys == MAX_SORT_KEYS) {
+            fprintf(stderr, "错误: 排序键最多 %d 个\n", MAX_SORT_KEYS);
+            return -1;
+        }
+        trim_whitespace(token);
+        
+        // 列名后可跟 :n（数值）、:r（降序）或 :nr
+        sort_key_t* key = &plan->keys[plan->num_keys];
+        key->numeric = 0;
+        key->reverse = 0;
+        char* flags = strrchr(token, ':');
+        if (flags && flags[1] && strspn(flags + 1, "nr") == strlen(flags + 1)) {
+            key->numeric = (strchr(flags + 1, 'n') != NULL);
+            key->reverse = (strchr(flags + 1, 'r') != NULL);
+            *flags = '\0';
+        }
+        
+        key->column = table_find_column(table, token);
+        if (key->column < 0) {
+            fprintf(stderr, "错误: 找不到列: %s\n", token);
+            return -1;
+        }
+        if (key->column > plan->max_col) {
+            plan->max_col = key->column;
+        }
+        plan->num_keys++;
+        token = strtok(NULL, ",");
+    }
+    
+    if (plan->num_keys == 0) {
+        fprintf(stderr, "错误: 请指定排序列\n");
+        return -1;
+    }
+    return 0;
+}
+
+void sort_make_record(const sort_plan_t* plan, char* line, size_t len, sort_record_t* record) {
+    const sort_key_t* key = &plan->keys[0];
+    field_t field;
+    plan->kernel->field_at(line, len, key->column, &field);
+
+    record->line = line;
+    record->len = (uint32_t)len;
+    record->key_off = (uint32_t)(field.ptr - line);
+    record->key_len = (uint32_t)field.len;
+    
+    // 把第一个排序键归一化为可直接按无符号整数比较的前缀
+    uint64_t prefix = 0;
+    if (key->numeric) {
+        double value;
+        if (field_to_double(&field, &value)) {
+            prefix = double_sort_key(value);
+        }
+    } else {
+        for (size_t i = 0; i < 8; i++) {
+            prefix <<= 8;
+            if (i < field.len) prefix |= (unsigned char)field.ptr[i];
+        }
+    }
+    record->prefix = key->reverse ? ~prefix : prefix;
+}
+
+uint64_t double_sort_key(double value) {
+    // 非数值记为0排在最前，数值映射后保证大于0
+    uint64_t bits;
+    if (value == 0) value = 0.0;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits >> 63) {
+        bits = ~bits;
+    } else {
+        bits |= (uint64_t)1 << 63;
+    }
+    return bits == 0 ? 1 : bits;
+}
+
+int sort_compare(const sort_plan_t* plan, const sort_record_t* a, const sort_record_t* b) {
+    if (a->prefix != b->prefix) {
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+    
+    // 前缀相同：文本键比较剩余部分，数值键的前缀已是精确值
+    const sort_key_t* key = &plan->keys[0];
+    if (!key->numeric && (a->key_len > 8 || b->key_len > 8)) {
+        field_t fa = { a->line + a->key_off, a->key_len };
+        int cmp = field_compare(&fa, b->line + b->key_off, b->key_len);
+        if (cmp != 0) {
+            return key->reverse ? -cmp : cmp;
+        }
+    }
+    
+    for (int k = 1; k < plan->num_keys; k++) {
+        key = &plan->keys[k];
+        field_t fa, fb;
+        plan->kernel->field_at(a->line, a->len, key->column, &fa);
+        plan->kernel->field_at(b->line, b->len, key->column, &fb);
+        int cmp;
+        if (key->numeric) {
+            double va = 0, vb = 0;
+            uint64_t ka = field_to_double(&fa, &va) ? double_sort_key(va) : 0;
+            uint64_t kb = field_to_double(&fb, &vb) ? double_sort_key(vb) : 0;
+            cmp = (ka > kb) - (ka < kb);
+        } else {
+            cmp = field_compare(&fa, fb.ptr, fb.len);
+        }
+        if (cmp != 0) {
+            return key->reverse ? -cmp : cmp;
+        }
+    }
+    return 0;
+}
+
+void sort_records(const sort_plan_t* plan, sort_record_t* records, sort_record_t* tmp, size_t count) {
+    // 自顶向下归并排序（稳定），小区间用插入排序
+    if (count <= 16) {
+        for (size_t i = 1; i < count; i++) {
+            sort_record_t item = records[i];
+            size_t j = i;
+            while (j > 0 && sort_compare(plan, &item, &records[j - 1]) < 0) {
+                records[j] = records[j - 1];
+                j--;
+            }
+            records[j] = item;
+        }
+        return;
+    }
+    size_t half = count / 2;
+    sort_records(plan, records, tmp, half);
+    sort_records(plan, records + half, tmp, count - half);
+    sort_merge_sorted(plan, records, half, records + half, count - half, tmp);
+    memcpy(records, tmp, count * sizeof(sort_record_t));
+}
+
+void sort_merge_sorted(const sort_plan_t* plan, const sort_record_t* a, size_t na,
+                       const sort_record_t* b, size_t nb, sort_record_t* out) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        // 相等时取前一段的记录，保持稳定
+        if (sort_compare(plan, &b[j], &a[i]) < 0) {
+            out[k++] = b[j++];
+        } else {
+            out[k++] = a[i++];
+        }
+    }
+    while (i < na) out[k++] = a[i++];
+    while (j < nb) out[k++] = b[j++];
+}
+
+void* sort_worker_main(void* arg) {
+    sort_worker_t* worker = arg;
+    sort_records(worker->plan, worker->records, worker->tmp, worker->count);
+    return NULL;
+}
+
+void sort_records_parallel(const sort_plan_t* plan, sort_record_t* records, size_t count, int threads) {
+    if (count < 2) {
+        return;
+    }
+    if ((size_t)threads > count / 1024 + 1) {
+        threads = (int)(count / 1024 + 1);
+    }
+    sort_record_t* tmp = xmalloc(count * sizeof(sort_record_t));
+
+    // 各线程分别排序一段，再两两归并
+    sort_worker_t workers[MAX_THREADS];
+    size_t offsets[MAX_THREADS + 1];
+    for (int t = 0; t <= threads; t++) {
+        offsets[t] = count * t / threads;
+    }
+    for (int t = 0; t < threads; t++) {
+        workers[t].plan = plan;
+        workers[t].records = records + offsets[t];
+        workers[t].tmp = tmp + offsets[t];
+        workers[t].count = offsets[t + 1] - offsets[t];
+    }
+    run_workers(sort_worker_main, workers, sizeof(sort_worker_t), threads);
+
+    for (int width = 1; width < threads; width *= 2) {
+        for (int t = 0; t + width < threads; t += 2 * width) {
+            int end = (t + 2 * width < threads) ? t + 2 * width : threads;
+            size_t lo = offsets[t], mid = offsets[t + width], hi = offsets[end];
+            sort_merge_sorted(plan, records + lo, mid - lo, records + mid, hi - mid, tmp + lo);
+            memcpy(records + lo, tmp + lo, (hi - lo) * sizeof(sort_record_t));
+        }
+    }
+    free(tmp);
+}
+
+int sort_merge_less(const sort_plan_t* plan, sort_merge_input_t* inputs, int a, int b) {
+    // 已读完的输入视为无穷大；相等时取编号小的段，保持稳定
+    if (inputs[a].done) return 0;
+    if (inputs[b].done) return 1;
+    int cmp = sort_compare(plan, &inputs[a].record, &inputs[b].record);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+void sort_merge_advance(const sort_plan_t* plan, sort_merge_input_t* input) {
+    size_t len;
+    char* line = line_reader_next(&input->reader, &len);
+    if (!line) {
+        input->done = 1;
+        return;
+    }
+    sort_make_record(plan, line, len, &input->record);
+}
+
+void sort_merge_runs(const sort_plan_t* plan, FILE** runs, int num_runs, FILE* out) {
+    if (num_runs <= 0) {
+        return;
+    }
+    sort_merge_input_t* inputs = xmalloc(num_runs * sizeof(sort_merge_input_t));
+    int* tree = xmalloc(num_runs * sizeof(int));
+    
+    // 各路读缓冲区共同分摊内存预算
+    size_t buffer_size = g_options.mem_budget / num_runs;
+    if (buffer_size > READ_BUFFER_SIZE) buffer_size = READ_BUFFER_SIZE;
+    if (buffer_size < 65536) buffer_size = 65536;
+    for (int i = 0; i < num_runs; i++) {
+        rewind(runs[i]);
+        line_reader_init(&inputs[i].reader, runs[i], buffer_size);
+        inputs[i].done = 0;
+        sort_merge_advance(plan, &inputs[i]);
+        tree[i] = -1;
+    }
+    
+    // 败者树：内部结点记录败者，tree[0]为当前最小值所在的段
+    for (int i = num_runs - 1; i >= 0; i--) {
+        sort_loser_adjust(plan, inputs, tree, num_runs, i);
+    }
+    
+    while (!inputs[tree[0]].done) {
+        int winner = tree[0];
+        fwrite(inputs[winner].record.line, 1, inputs[winner].record.len, out);
+        fputc('\n', out);
+        sort_merge_advance(plan, &inputs[winner]);
+        sort_loser_adjust(plan, inputs, tree, num_runs, winner);
+    }
+
+    for (int i = 0; i < num_runs; i++) {
+        // 段文件由调用方关闭
+        free(inputs[i].reader.buf);
+    }
+    free(inputs);
+    free(tree);
+}
+
+void sort_loser_adjust(const sort_plan_t* plan, sort_merge_input_t* inputs, int* tree, int k, int s) {
+    for (int t = (s + k) / 2; t > 0; t /= 2) {
+        if (tree[t] == -1) {
+            // 初始化阶段：结点还没有败者
+            tree[t] = s;
+            return;
+        }
+        if (sort_merge_less(plan, inputs, tree[t], s)) {
+            int winner = tree[t];
+            tree[t] = s;
+            s = winner;
+        }
+    }
+    tree[0] = s;
+}
+
+int sort_merge_cascade(const sort_plan_t* plan, FILE** runs, int num_runs) {
+    // 有序段过多时，按顺序每MAX_MERGE_FANIN个合并成一个新段
+    int out = 0;
+    for (int i = 0; i < num_runs; i += MAX_MERGE_FANIN) {
+        int n = (num_runs - i < MAX_MERGE_FANIN) ? num_runs - i : MAX_MERGE_FANIN;
+        FILE* merged = create_temp_file();
+        if (!merged) {
+            fprintf(stderr, "错误: 无法创建临时文件\n");
+            exit(1);
+        }
+        sort_merge_runs(plan, runs + i, n, merged);
+        for (int j = 0; j < n; j++) {
+            fclose(runs[i + j]);
+        }
+        runs[out++] = merged;
+    }
+    return out;
+}
+
+void offset_runs_init(offset_runs_t* runs) {
+    memset(runs, 0, sizeof(offset_runs_t));
+    runs->order.delim_char = ',';
+    runs->order.kernel = parse_kernel_select(',', 0);
+    runs->order.keys[0].numeric = 1;
+    runs->order.num_keys = 1;
+}
+
+FILE* offset_runs_add(offset_runs_t* runs) {
+    if (runs->num_runs == MAX_SORT_RUNS) {
+        runs->num_runs = sort_merge_cascade(&runs->order, runs->runs, runs->num_runs);
+    }
+    FILE* run = create_temp_file();
+    if (!run) {
+        fprintf(stderr, "错误: 无法创建临时文件\n");
+        exit(1);
+    }
+    runs->runs[runs->num_runs++] = run;
+    return run;
+}
+
+void offset_runs_merge(offset_runs_t* runs, FILE* out) {
+    while (runs->num_runs > MAX_MERGE_FANIN) {
+        runs->num_runs = sort_merge_cascade(&runs->order, runs->runs, runs->num_runs);
+    }
+    int num_runs = runs->num_runs;
+    if (num_runs <= 0) {
+        return;
+    }
+    // 与 sort_merge_runs 相同的败者树归并，偏移相同的行来自同一段，保持段内顺序；输出时去掉行首的偏移
+    sort_merge_input_t* inputs = xmalloc(num_runs * sizeof(sort_merge_input_t));
+    int* tree = xmalloc(num_runs * sizeof(int));
+    for (int i = 0; i < num_runs; i++) {
+        rewind(runs->runs[i]);
+        line_reader_init(&inputs[i].reader, runs->runs[i], 65536);
+        inputs[i].done = 0;
+        sort_merge_advance(&runs->order, &inputs[i]);
+        tree[i] = -1;
+    }
+    for (int i = num_runs - 1; i >= 0; i--) {
+        sort_loser_adjust(&runs->order, inputs, tree, num_runs, i);
+    }
+    while (!inputs[tree[0]].done) {
+        int winner = tree[0];
+        const sort_record_t* record = &inputs[winner].record;
+        size_t skip = record->key_off + record->key_len + 1;
+        fwrite(record->line + skip, 1, record->len - skip, out);
+        fputc('\n', out);
+        sort_merge_advance(&runs->order, &inputs[winner]);
+        sort_loser_adjust(&runs->order, inputs, tree, num_runs, winner);
+    }
+    for (int i = 0; i < num_runs; i++) {
+        free(inputs[i].reader.buf);
+        fclose(runs->runs[i]);
+    }
+    free(inputs);
+    free(tree);
+    runs->num_runs = 0;
+}
+
+void offset_runs_add_unsorted(offset_runs_t* runs, FILE* in) {
+    // 读入未排序的 "偏移," 行，按内存预算分批稳定排序，每批写成一个有序段；
+    // 偏移相同的行在归并时取编号小的段，所以跨批次也保持原来的先后
+    rewind(in);
+    line_reader_t reader;
+    line_reader_init(&reader, in, READ_BUFFER_SIZE);
+    sort_record_t* records = NULL;
+    size_t record_cap = 0;
+    char* line = NULL;
+    do {
+        arena_t arena = { NULL, 0 };
+        size_t count = 0;
+        size_t run_bytes = 0;
+        size_t len;
+        while ((line = line_reader_next(&reader, &len)) != NULL) {
+            if (count == record_cap) {
+                record_cap = record_cap ? record_cap * 2 : 65536;
+                records = xrealloc(records, record_cap * sizeof(sort_record_t));
+            }
+            char* copy = arena_alloc(&arena, len + 1);
+            memcpy(copy, line, len + 1);
+            sort_make_record(&runs->order, copy, len, &records[count++]);
+            run_bytes += len + 1 + sizeof(sort_record_t);
+            if (run_bytes >= g_options.mem_budget) {
+                break;
+            }
+        }
+        if (count > 0) {
+            sort_records_parallel(&runs->order, records, count, 1);
+            FILE* run = offset_runs_add(runs);
+            for (size_t i = 0; i < count; i++) {
+                fwrite(records[i].line, 1, records[i].len, run);
+                fputc('\n', run);
+            }
+        }
+        arena_free(&arena);
+    } while (line != NULL);
+    line_reader_close(&reader);
+    free(records);
+}
+
+void join_files(const char* left_file, const char* right_file, const char* key_spec, const char* mode_name) {
+    join_mode_t mode = JOIN_INNER;
+    if (mode_name) {
+        if (strcmp(mode_name, "inner") == 0) mode = JOIN_INNER;
+        else if (strcmp(mode_name, "left") == 0) mode = JOIN_LEFT;
+        else if (strcmp(mode_name, "anti") == 0) mode = JOIN_ANTI;
+        else {
+            fprintf(stderr, "错误: 不支持的连接方式: %s (可用: inner,left,anti)\n", mode_name);
+            g_exit_status = 1;
+            return;
+        }
+    }
+
+    // 两个文件分别检测分隔符，TSV与CSV可以直接连接
+    table_reader_t left, right;
+    if (table_open(&left, left_file) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", left_file);
+        g_exit_status = 1;
+        return;
+    }
+    if (table_open(&right, right_file) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", right_file);
+        g_exit_status = 1;
+        table_close(&left);
+        return;
+    }
+
+    join_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.mode = mode;
+    // --range/--rows 只作用于左表，右表总是完整读取
+    if (join_parse_keys(&left, &right, key_spec, &ctx) != 0 || table_apply_window(&left) != 0) {
+        g_exit_status = 1;
+        table_close(&left);
+        table_close(&right);
+        return;
+    }
+    ctx.left_fields = xmalloc((ctx.left.num_columns + 1) * sizeof(field_t));
+    ctx.right_fields = xmalloc((ctx.right.num_columns + 1) * sizeof(field_t));
+    ctx.key_cap = 256;
+    ctx.key = xmalloc(ctx.key_cap);
+    // 输出沿用左表的分隔符（多空格改用制表符），左表只有一列时沿用右表的
+    ctx.out_delim = left.multispace ? '\t' : left.delim_char;
+    if (ctx.out_delim == '\0') ctx.out_delim = right.multispace ? '\t' : right.delim_char;
+    if (ctx.out_delim == '\0') ctx.out_delim = ',';
+
+    // 输出表头：anti 模式原样输出左表，其他模式输出左表各列加右表非键列
+    if (!left.include_header) {
+        // 左表范围不包含文件开头，省略表头
+    } else if (mode == JOIN_ANTI) {
+        fwrite(left.header_line, 1, left.header_len, stdout);
+        putchar('\n');
+    } else {
+        for (int i = 0; i < left.num_columns; i++) {
+            if (i > 0) putchar(ctx.out_delim);
+            fputs(left.names[i], stdout);
+        }
+        for (int j = 0; j < right.num_columns; j++) {
+            if (!ctx.right_is_key[j]) printf("%c%s", ctx.out_delim, right.names[j]);
+        }
+        putchar('\n');
+    }
+
+    // 较小的文件作为构建端，另一侧流式探测。输出总是按左表的行顺序：
+    // 左表是探测端时直接按顺序输出；左表是构建端时输出行带上左表行的偏移，按偏移稳定排序后输出
+    long long left_size = table_data_size(&left);
+    long long right_size = table_data_size(&right);
+    ctx.build_is_left = (left_size < right_size);
+    line_reader_t* build = ctx.build_is_left ? &left.reader : &right.reader;
+    line_reader_t* probe = ctx.build_is_left ? &right.reader : &left.reader;
+    long long build_size = ctx.build_is_left ? left_size : right_size;
+
+    offset_runs_t output;
+    offset_runs_init(&output);
+    if ((size_t)build_size * 2 <= g_options.mem_budget) {
+        if (!ctx.build_is_left) {
+            join_partition(&ctx, build, probe, stdout, 0);
+        } else {
+            FILE* unsorted = create_temp_file();
+            if (!unsorted) {
+                fprintf(stderr, "错误: 无法创建临时文件\n");
+                exit(1);
+            }
+            join_partition(&ctx, build, probe, unsorted, 0);
+            offset_runs_add_unsorted(&output, unsorted);
+        }
+    } else {
+        // 构建端放不进内存：两边按键哈希分区写入临时文件，再逐对连接。
+        // 左表行带上原始偏移，各分区的输出按偏移有序，最后归并恢复左表顺序
+        int parts = (int)(build_size * 2 / g_options.mem_budget) + 1;
+        if (parts < 2) parts = 2;
+        if (parts > MAX_JOIN_PARTITIONS) parts = MAX_JOIN_PARTITIONS;
+        
+        FILE* build_parts[MAX_JOIN_PARTITIONS];
+        FILE* probe_parts[MAX_JOIN_PARTITIONS];
+        join_write_partitions(&ctx, build, ctx.build_is_left ? &ctx.left : &ctx.right, build_parts, parts,
+                              ctx.build_is_left);
+        join_write_partitions(&ctx, probe, ctx.build_is_left ? &ctx.right : &ctx.left, probe_parts, parts,
+                              !ctx.build_is_left);
+        
+        for (int p = 0; p < parts; p++) {
+            line_reader_t build_reader, probe_reader;
+            rewind(build_parts[p]);
+            rewind(probe_parts[p]);
+            line_reader_init(&build_reader, build_parts[p], READ_BUFFER_SIZE);
+            line_reader_init(&probe_reader, probe_parts[p], READ_BUFFER_SIZE);
+            if (!ctx.build_is_left) {
+                join_partition(&ctx, &build_reader, &probe_reader, offset_runs_add(&output), 1);
+            } else {
+                // 同一左表行只出现在一个分区里，各分区分别排序后归并即可
+                FILE* unsorted = create_temp_file();
+                if (!unsorted) {
+                    fprintf(stderr, "错误: 无法创建临时文件\n");
+                    exit(1);
+                }
+                join_partition(&ctx, &build_reader, &probe_reader, unsorted, 1);
+                offset_runs_add_unsorted(&output, unsorted);
+            }
+            line_reader_close(&build_reader);
+            line_reader_close(&probe_reader);
+        }
+    }
+    offset_runs_merge(&output, stdout);
+
+    free(ctx.left_fields);
+    free(ctx.right_fields);
+    free(ctx.key);
+    table_close(&left);
+    table_close(&right);
+}
+
+int join_parse_keys(const table_reader_t* left, const table_reader_t* right, const char* spec, join_ctx_t* ctx) {
+    ctx->left.delim_char = left->delim_char;
+    ctx->left.multispace = left->multispace;
+    ctx->left.kernel = left->kernel;
+    ctx->left.num_columns = left->num_columns;
+    ctx->right.delim_char = right->delim_char;
+    ctx->right.multispace = right->multispace;
+    ctx->right.kernel = right->kernel;
+    ctx->right.num_columns = right->num_columns;
+    memset(ctx->right_is_key, 0, sizeof(ctx->right_is_key));
+
+    char* spec_copy = arena_strndup(&g_run_arena, spec, strlen(spec));
+    
+    // 每个键写作 列名 或 左表列名=右表列名
+    char* token = strtok(spec_copy, ",");
+    while (token != NULL && ctx->num_keys < MAX_COLUMNS) {
+        char* right_name = strchr(token, '=');
+        if (right_name) *right_name++ = '\0';
+        trim_whitespace(token);
+        if (right_name) trim_whitespace(right_name);
+        
+        int left_col = table_find_column(left, token);
+        int right_col = table_find_column(right, right_name ? right_name : token);
+        if (left_col < 0 || right_col < 0) {
+            fprintf(stderr, "错误: 找不到连接列: %s\n", (left_col < 0) ? token : (right_name ? right_name : token));
+            return -1;
+        }
+        ctx->left.key_cols[ctx->num_keys] = left_col;
+        ctx->right.key_cols[ctx->num_keys] = right_col;
+        if (right_col < MAX_COLUMNS) ctx->right_is_key[right_col] = 1;
+        ctx->num_keys++;
+        token = strtok(NULL, ",");
+    }
+    
+    if (ctx->num_keys == 0) {
+        fprintf(stderr, "错误: 请指定连接列\n");
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t join_make_key(join_ctx_t* ctx, const join_side_t* side, char* line, size_t len, size_t* key_len) {
+    // 各键列以\x1f连接，只定位键列，不切分整行
+    size_t n = 0;
+    for (int i = 0; i < ctx->num_keys; i++) {
+        field_t field;
+        side->kernel->field_at(line, len, side->key_cols[i], &field);
+        while (n + field.len + 1 > ctx->key_cap) {
+            ctx->key_cap *= 2;
+            ctx->key = xrealloc(ctx->key, ctx->key_cap);
+        }
+        if (i > 0) ctx->key[n++] = '\x1f';
+        memcpy(ctx->key + n, field.ptr, field.len);
+        n += field.len;
+    }
+    *key_len = n;
+    return hash_bytes(ctx->key, n, 0);
+}
+
+void join_write_partitions(join_ctx_t* ctx, line_reader_t* reader, const join_side_t* side, FILE** parts, int num_parts,
+                           int with_offset) {
+    for (int p = 0; p < num_parts; p++) {
+        parts[p] = create_temp_file();
+        if (!parts[p]) {
+            fprintf(stderr, "错误: 无法创建临时文件\n");
+            exit(1);
+        }
+    }
+    char* line;
+    size_t len;
+    long long offset = line_reader_tell(reader);
+    while ((line = line_reader_next(reader, &len)) != NULL) {
+        size_t key_len;
+        uint64_t hash = join_make_key(ctx, side, line, len, &key_len);
+        FILE* part = parts[(hash >> 32) % num_parts];
+        if (with_offset) fprintf(part, "%lld,", offset);
+        offset = line_reader_tell(reader);
+        fwrite(line, 1, len, part);
+        fputc('\n', part);
+    }
+}
+
+void join_partition(join_ctx_t* ctx, line_reader_t* build, line_reader_t* probe, FILE* out, int with_offset) {
+    // with_offset 时左表一侧（分区文件）的行以 "偏移," 开头；构建端是左表时输出行总是带上偏移，由调用方排序
+    const join_side_t* build_side = ctx->build_is_left ? &ctx->left : &ctx->right;
+    const join_side_t* probe_side = ctx->build_is_left ? &ctx->right : &ctx->left;
+
+    // 构建阶段：键 -> 同键行链表（保持文件顺序）
+    join_table_t table;
+    join_table_init(&table);
+    char* line;
+    size_t len;
+    long long offset = line_reader_tell(build);
+    while ((line = line_reader_next(build, &len)) != NULL) {
+        long long row_offset = offset;
+        offset = line_reader_tell(build);
+        if (ctx->build_is_left && with_offset) {
+            char* comma = memchr(line, ',', len);
+            row_offset = strtoll(line, NULL, 10);
+            len -= (size_t)(comma + 1 - line);
+            line = comma + 1;
+        }
+        size_t key_len;
+        uint64_t hash = join_make_key(ctx, build_side, line, len, &key_len);
+        join_key_t* key = join_table_find(&table, hash, ctx->key, key_len);
+        if (!key) {
+            key = join_table_insert(&table, hash, ctx->key, key_len);
+        }
+        join_table_add_row(&table, key, line, len, row_offset);
+    }
+
+    // 探测阶段：逐行流式处理较大的一侧
+    while ((line = line_reader_next(probe, &len)) != NULL) {
+        size_t prefix = 0;
+        if (!ctx->build_is_left && with_offset) {
+            prefix = (size_t)((char*)memchr(line, ',', len) - line) + 1;
+        }
+        char* row = line + prefix;
+        size_t row_len = len - prefix;
+        size_t key_len;
+        uint64_t hash = join_make_key(ctx, probe_side, row, row_len, &key_len);
+        join_key_t* key = join_table_find(&table, hash, ctx->key, key_len);
+        
+        if (!ctx->build_is_left) {
+            // 探测端是左表，按左表顺序直接输出，分区文件中的偏移原样带上
+            if (ctx->mode == JOIN_ANTI) {
+                if (!key) {
+                    fwrite(line, 1, len, out);
+                    fputc('\n', out);
+                }
+            } else if (key) {
+                for (int32_t r = key->head; r >= 0; r = table.rows[r].next) {
+                    fwrite(line, 1, prefix, out);
+                    join_emit(ctx, out, row, row_len, table.rows[r].line, table.rows[r].len);
+                }
+            } else if (ctx->mode == JOIN_LEFT) {
+                fwrite(line, 1, prefix, out);
+                join_emit(ctx, out, row, row_len, NULL, 0);
+            }
+        } else if (key) {
+            // 探测端是右表：同一左表行的匹配按右表顺序依次写出，稳定排序后保持这个顺序
+            key->matched = 1;
+            if (ctx->mode != JOIN_ANTI) {
+                for (int32_t r = key->head; r >= 0; r = table.rows[r].next) {
+                    fprintf(out, "%lld,", table.rows[r].offset);
+                    join_emit(ctx, out, table.rows[r].line, table.rows[r].len, row, row_len);
+                }
+            }
+        }
+    }
+
+    // 左表在构建端时，最后补充输出未匹配的左表行
+    if (ctx->build_is_left && ctx->mode != JOIN_INNER) {
+        for (size_t k = 0; k < table.num_keys; k++) {
+            if (table.keys[k].matched) continue;
+            for (int32_t r = table.keys[k].head; r >= 0; r = table.rows[r].next) {
+                fprintf(out, "%lld,", table.rows[r].offset);
+                if (ctx->mode == JOIN_ANTI) {
+                    fwrite(table.rows[r].line, 1, table.rows[r].len, out);
+                    fputc('\n', out);
+                } else {
+                    join_emit(ctx, out, table.rows[r].line, table.rows[r].len, NULL, 0);
+                }
+            }
+        }
+    }
+
+    join_table_free(&table);
+}
+
+void join_emit(join_ctx_t* ctx, FILE* out, char* left_line, size_t left_len, char* right_line, size_t right_len) {
+    int n = ctx->left.kernel->split(left_line, left_len, ctx->left_fields, ctx->left.num_columns);
+    for (int i = 0; i < ctx->left.num_columns; i++) {
+        if (i > 0) fputc(ctx->out_delim, out);
+        if (i < n) fwrite(ctx->left_fields[i].ptr, 1, ctx->left_fields[i].len, out);
+    }
+    
+    int m = 0;
+    if (right_line) {
+        m = ctx->right.kernel->split(right_line, right_len, ctx->right_fields, ctx->right.num_columns);
+    }
+    for (int j = 0; j < ctx->right.num_columns; j++) {
+        if (ctx->right_is_key[j]) continue;
+        fputc(ctx->out_delim, out);
+        if (j < m) fwrite(ctx->right_fields[j].ptr, 1, ctx->right_fields[j].len, out);
+    }
+    fputc('\n', out);
+}
+
+void join_table_init(join_table_t* table) {
+    memset(table, 0, sizeof(join_table_t));
+    table->slot_cap = 1024;
+    table->slots = xmalloc(table->slot_cap * sizeof(group_slot_t));
+    memset(table->slots, 0, table->slot_cap * sizeof(group_slot_t));
+}
+
+join_key_t* join_table_find(const join_table_t* table, uint64_t hash, const char* key, size_t key_len) {
+    size_t mask = table->slot_cap - 1;
+    for (size_t i = hash & mask; table->slots[i].index != 0; i = (i + 1) & mask) {
+        if (table->slots[i].hash == hash) {
+            join_key_t* entry = &table->keys[table->slots[i].index - 1];
+            if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+                return entry;
+            }
+        }
+    }
+    return NULL;
+}
+
+join_key_t* join_table_insert(join_table_t* table, uint64_t hash, const char* key, size_t key_len) {
+    if ((table->num_keys + 1) * 10 > table->slot_cap * 7) {
+        size_t new_cap = table->slot_cap * 2;
+        group_slot_t* slots = xmalloc(new_cap * sizeof(group_slot_t));
+        memset(slots, 0, new_cap * sizeof(group_slot_t));
+        for (size_t i = 0; i < table->slot_cap; i++) {
+            if (table->slots[i].index == 0) continue;
+            size_t j = table->slots[i].hash & (new_cap - 1);
+            while (slots[j].index != 0) j = (j + 1) & (new_cap - 1);
+            slots[j] = table->slots[i];
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->slot_cap = new_cap;
+    }
+    if (table->num_keys == table->key_cap) {
+        table->key_cap = table->key_cap ? table->key_cap * 2 : 1024;
+        table->keys = xrealloc(table->keys, table->key_cap * sizeof(join_key_t));
+    }
+
+    join_key_t* entry = &table->keys[table->num_keys++];
+    entry->hash = hash;
+    entry->key = arena_alloc(&table->arena, key_len + 1);
+    memcpy(entry->key, key, key_len);
+    entry->key[key_len] = '\0';
+    entry->key_len = (uint32_t)key_len;
+    entry->matched = 0;
+    entry->head = entry->tail = -1;
+
+    size_t mask = table->slot_cap - 1;
+    size_t i = hash & mask;
+    while (table->slots[i].index != 0) i = (i + 1) & mask;
+    table->slots[i].hash = hash;
+    table->slots[i].index = (uint32_t)table->num_keys;
+    return entry;
+}
+
+void join_table_add_row(join_table_t* table, join_key_t* key, const char* line, size_t len, long long offset) {
+    if (table->num_rows == table->row_cap) {
+        table->row_cap = table->row_cap ? table->row_cap * 2 : 1024;
+        table->rows = xrealloc(table->rows, table->row_cap * sizeof(join_row_t));
+    }
+    int32_t index = (int32_t)table->num_rows++;
+    join_row_t* row = &table->rows[index];
+    row->line = arena_alloc(&table->arena, len + 1);
+    memcpy(row->line, line, len + 1);
+    row->offset = offset;
+    row->len = (uint32_t)len;
+    row->next = -1;
+    
+    if (key->tail >= 0) {
+        table->rows[key->tail].next = index;
+    } else {
+        key->head = index;
+    }
+    key->tail = index;
+}
+
+void join_table_free(join_table_t* table) {
+    free(table->slots);
+    free(table->keys);
+    free(table->rows);
+    arena_free(&table->arena);
+}
+
+void convert_to_csv(const char* filename) {
+    if (columnar_is_file(filename)) {
+        columnar_export_csv(filename);
+        return;
+    }
+
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    // 表头按普通行处理，但只有范围包含文件开头时才输出
+    char* line = table.header_line;
+    size_t len = table.header_len;
+    if (!table.include_header || table.num_columns == 0) {
+        line = line_reader_next(&table.reader, &len);
+    }
+    while (line != NULL) {
+        // 替换分隔符为逗号
+        for (size_t i = 0; i < len; i++) {
+            if (line[i] == table.delim_char) {
+                line[i] = ',';
+            }
+        }
+        fwrite(line, 1, len, stdout);
+        putchar('\n');
+        line = line_reader_next(&table.reader, &len);
+    }
+
+    table_close(&table);
+}
+
+void convert_file(const char* filename, const char* output) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // 数值缓冲区按内存布局直接写出，文件格式规定为小端
+    fprintf(stderr, "错误: 列存文件为小端字节序，当前平台不支持\n");
+    g_exit_status = 1;
+    return;
+#endif
+    // 输出文件以 wb 打开会先清空，和输入是同一个文件（包括链接）时转换前就丢了数据
+    struct stat in_st, out_st;
+    if (stat(filename, &in_st) == 0 && stat(output, &out_st) == 0 &&
+        in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+        fprintf(stderr, "错误: 输出文件和输入文件是同一个文件: %s\n", output);
+        g_exit_status = 1;
+        return;
+    }
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        return;
+    }
+    if (table.num_columns == 0) {
+        fprintf(stderr, "错误: 文件没有表头: %s\n", filename);
+        g_exit_status = 1;
+        table_close(&table);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    convert_plan_t plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.kernel = table.kernel;
+    plan.num_columns = table.num_columns;
+    plan.names = table.names;
+    plan.types = xmalloc(plan.num_columns * sizeof(column_type_t));
+    long long data_start = table.data_start;
+    long long data_end = table.data_end;
+    convert_infer_schema(&table, &plan, 0);
+    table_close(&table);
+
+    // 转码输入的偏移只能顺序解码得到，不分块
+    int threads = data_end >= 0 ? choose_thread_count(data_end - data_start) : 1;
+    // 每个线程同时只缓存一个行组，列很多时按内存预算缩小行组
+    size_t budget = g_options.mem_budget / threads / 2;
+    plan.group_rows = CONVERT_GROUP_ROWS;
+    while (plan.group_rows > 1024 && (size_t)plan.group_rows * plan.num_columns * 16 > budget) {
+        plan.group_rows /= 2;
+    }
+
+    FILE* out = fopen(output, "wb");
+    if (!out) {
+        fprintf(stderr, "无法创建文件: %s\n", output);
+        g_exit_status = 1;
+        free(plan.types);
+        return;
+    }
+    fwrite(COLUMNAR_MAGIC, 1, 8, out);
+
+    convert_worker_t* workers = xmalloc(threads * sizeof(convert_worker_t));
+    long long chunk = data_end >= 0 ? (data_end - data_start) / threads : 0;
+    for (int t = 0; t < threads; t++) {
+        memset(&workers[t], 0, sizeof(convert_worker_t));
+        workers[t].plan = &plan;
+        workers[t].filename = filename;
+        workers[t].start = data_start + chunk * t;
+        workers[t].end = (t == threads - 1) ? data_end : data_start + chunk * (t + 1);
+        workers[t].out = (t == 0) ? out : create_temp_file();
+        if (!workers[t].out) {
+            fprintf(stderr, "错误: 无法创建临时文件\n");
+            exit(1);
+        }
+        workers[t].mismatched = xmalloc(plan.num_columns * sizeof(long long));
+        memset(workers[t].mismatched, 0, plan.num_columns * sizeof(long long));
+    }
+    run_workers(convert_worker_main, workers, sizeof(convert_worker_t), threads);
+
+    // 其余线程的临时文件按区间顺序接在后面，列块偏移加上各自在输出文件中的起点
+    long long* bases = xmalloc(threads * sizeof(long long));
+    uint64_t total_rows = 0;
+    int num_groups = 0;
+    int failed = 0;
+    for (int t = 0; t < threads; t++) {
+        failed |= workers[t].failed;
+        total_rows += workers[t].rows;
+        num_groups += workers[t].num_groups;
+        bases[t] = 0;
+        if (t > 0) {
+            bases[t] = ftello(out);
+            copy_stream(workers[t].out, out);
+            fclose(workers[t].out);
+        }
+    }
+    if (!failed) {
+        convert_write_footer(out, &plan, workers, threads, bases, total_rows);
+    }
+    long long file_size = ftello(out);
+    failed |= ferror(out);
+    if (fclose(out) != 0 || failed) {
+        fprintf(stderr, "错误: 写入失败: %s\n", output);
+        g_exit_status = 1;
+        unlink(output);
+    } else {
+        printf("已转换: %s -> %s\n", filename, output);
+        printf("行数: %llu, 行组: %d, 文件大小: %lld 字节\n", (unsigned long long)total_rows, num_groups, file_size);
+        printf("列结构:\n");
+        for (int c = 0; c < plan.num_columns; c++) {
+            long long mismatched = 0;
+            for (int t = 0; t < threads; t++) {
+                mismatched += workers[t].mismatched[c];
+            }
+            printf("  %d. %s: %s", c + 1, plan.names[c] ? plan.names[c] : "", column_type_names[plan.types[c]]);
+            if (mismatched > 0) {
+                printf(" (%lld 个值与类型不符，已存为空值)", mismatched);
+            }
+            putchar('\n');
+        }
+    }
+
+    for (int t = 0; t < threads; t++) {
+        for (int g = 0; g < workers[t].num_groups; g++) {
+            free(workers[t].groups[g].chunks);
+        }
+        free(workers[t].groups);
+        free(workers[t].mismatched);
+    }
+    free(workers);
+    free(bases);
+    free(plan.types);
+}
+
+int convert_infer_schema(table_reader_t* table, convert_plan_t* plan, double tolerance) {
+    // 统计样本中每列的整数、浮点数和文本个数。文本超过非空值的 tolerance 比例时为 string，
+    // 否则浮点数超过该比例时为 double，其余为 int64；没有值的列为 string。
+    // convert 不允许例外（tolerance 为0），check 允许少量错误值，以便把它们报告出来
+    int n = plan->num_columns;
+    long long* seen = xmalloc(n * 3 * sizeof(long long));
+    memset(seen, 0, n * 3 * sizeof(long long));
+    field_t* fields = xmalloc(n * sizeof(field_t));
+    char* line;
+    size_t len;
+    int sampled = 0;
+    while (sampled < CONVERT_SAMPLE_ROWS && (line = line_reader_next(&table->reader, &len)) != NULL) {
+        if (len == 0) {
+            continue;
+        }
+        int count = plan->kernel->split(line, len, fields, n);
+        for (int c = 0; c < count; c++) {
+            int64_t int_value;
+            double double_value;
+            data_type_t type = convert_classify(fields[c].ptr, fields[c].len, &int_value, &double_value);
+            if (type == DATA_INTEGER) seen[c * 3]++;
+            else if (type == DATA_FLOAT) seen[c * 3 + 1]++;
+            else if (type == DATA_TEXT) seen[c * 3 + 2]++;
+        }
+        sampled++;
+    }
+    for (int c = 0; c < n; c++) {
+        long long values = seen[c * 3] + seen[c * 3 + 1] + seen[c * 3 + 2];
+        double allowed = tolerance * values;
+        if (values == 0 || seen[c * 3 + 2] > allowed) {
+            plan->types[c] = COLUMN_STRING;
+        } else if (seen[c * 3 + 1] > allowed) {
+            plan->types[c] = COLUMN_DOUBLE;
+        } else {
+            plan->types[c] = COLUMN_INT64;
+        }
+    }
+    free(fields);
+    free(seen);
+    return sampled;
+}
+
+data_type_t convert_classify(const char* value, size_t len, int64_t* int_value, double* double_value) {
+    // 与 detect_data_type 的规则相同：去掉首尾空白后能完整解析为整数或浮点数；
+    // 超出 int64 范围的整数按浮点数处理
+    while (len > 0 && isspace((unsigned char)*value)) {
+        value++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)value[len - 1])) {
+        len--;
+    }
+    if (len == 0) {
+        return DATA_EMPTY;
+    }
+    char buffer[64];
+    if (len >= sizeof(buffer)) {
+        return DATA_TEXT;
+    }
+    memcpy(buffer, value, len);
+    buffer[len] = '\0';
+
+    PROF_SAMPLE_BEGIN(classify_start, PROF_CLASSIFY);
+    data_type_t type = DATA_TEXT;
+    char* endptr;
+    errno = 0;
+    long long parsed = strtoll(buffer, &endptr, 10);
+    if (*endptr == '\0' && errno == 0) {
+        *int_value = parsed;
+        type = DATA_INTEGER;
+    } else {
+        double real = strtod(buffer, &endptr);
+        if (*endptr == '\0') {
+            *double_value = real;
+            type = DATA_FLOAT;
+        }
+    }
+    PROF_SAMPLE_END(classify_start, PROF_CLASSIFY, len);
+    return type;
+}
+
+void* convert_worker_main(void* arg) {
+    convert_worker_t* worker = arg;
+    const convert_plan_t* plan = worker->plan;
+
+    line_reader_t reader;
+    if (line_reader_open_range(&reader, worker->filename, worker->start, worker->end) != 0) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    int n = plan->num_columns;
+    column_builder_t* cols = xmalloc(n * sizeof(column_builder_t));
+    for (int c = 0; c < n; c++) {
+        column_builder_init(&cols[c], plan->types[c], plan->group_rows);
+    }
+    field_t* fields = xmalloc(n * sizeof(field_t));
+
+    // 行数或原文字节数达到上限时写出一个行组；缺少的列为空值，多出的列忽略
+    uint32_t rows = 0;
+    size_t group_bytes = 0;
+    char* line;
+    size_t len;
+    while ((line = line_reader_next(&reader, &len)) != NULL) {
+        if (len == 0) {
+            continue;
+        }
+        int count = plan->kernel->split(line, len, fields, n);
+        for (int c = 0; c < n; c++) {
+            column_builder_add(&cols[c], plan->types[c], rows, c < count ? fields[c].ptr : "", c < count ? fields[c].len : 0,
+                               &worker->mismatched[c]);
+        }
+        rows++;
+        group_bytes += len;
+        if (rows == plan->group_rows || group_bytes >= CONVERT_GROUP_BYTES) {
+            convert_flush_group(worker, cols, rows);
+            rows = 0;
+            group_bytes = 0;
+        }
+    }
+    if (rows > 0) {
+        convert_flush_group(worker, cols, rows);
+    }
+    if (ferror(worker->out)) {
+        worker->failed = 1;
+    }
+
+    for (int c = 0; c < n; c++) {
+        column_builder_free(&cols[c]);
+    }
+    free(cols);
+    free(fields);
+    line_reader_close(&reader);
+    return NULL;
+}
+
+void column_builder_init(column_builder_t* col, column_type_t type, uint32_t rows) {
+    memset(col, 0, sizeof(*col));
+    col->validity = xmalloc((rows + 7) / 8);
+    if (type == COLUMN_INT64) {
+        col->ints = xmalloc(rows * sizeof(int64_t));
+    } else if (type == COLUMN_DOUBLE) {
+        col->doubles = xmalloc(rows * sizeof(double));
+    } else {
+        col->indices = xmalloc(rows * sizeof(uint32_t));
+        col->dict_offsets = xmalloc((rows + 1) * sizeof(uint32_t));
+        col->dict_cap = 4096;
+        col->dict_bytes = xmalloc(col->dict_cap);
+        col->slot_cap = 1024;
+        col->slots = xmalloc(col->slot_cap * sizeof(uint32_t));
+    }
+    column_builder_reset(col, rows);
+}
+
+void column_builder_reset(column_builder_t* col, uint32_t rows) {
+    memset(col->validity, 0, (rows + 7) / 8);
+    col->null_count = 0;
+    col->has_value = 0;
+    if (col->slots) {
+        memset(col->slots, 0, col->slot_cap * sizeof(uint32_t));
+        col->dict_len = 0;
+        col->dict_count = 0;
+        col->dict_offsets[0] = 0;
+    }
+}
+
+void column_builder_free(column_builder_t* col) {
+    free(col->validity);
+    free(col->ints);
+    free(col->doubles);
+    free(col->indices);
+    free(col->dict_bytes);
+    free(col->dict_offsets);
+    free(col->slots);
+}
+
+void column_builder_add(column_builder_t* col, column_type_t type, uint32_t row, const char* value, size_t len,
+                        long long* mismatched) {
+    if (type == COLUMN_STRING) {
+        // 字符串保留原文，只有空白的字段为空值
+        size_t i = 0;
+        while (i < len && isspace((unsigned char)value[i])) i++;
+        if (i == len) {
+            col->indices[row] = 0;
+            col->null_count++;
+            return;
+        }
+        col->indices[row] = column_dict_index(col, value, len);
+        col->validity[row >> 3] |= (uint8_t)(1 << (row & 7));
+        return;
+    }
+
+    int64_t int_value = 0;
+    double double_value = 0;
+    data_type_t kind = convert_classify(value, len, &int_value, &double_value);
+    if (kind == DATA_EMPTY || kind == DATA_TEXT || (type == COLUMN_INT64 && kind == DATA_FLOAT)) {
+        // 样本之后才出现的其他类型的值存为空值并计数
+        if (kind != DATA_EMPTY) {
+            (*mismatched)++;
+        }
+        if (type == COLUMN_INT64) col->ints[row] = 0;
+        else col->doubles[row] = 0;
+        col->null_count++;
+        return;
+    }
+    col->validity[row >> 3] |= (uint8_t)(1 << (row & 7));
+    if (type == COLUMN_INT64) {
+        col->ints[row] = int_value;
+        if (!col->has_value || int_value < col->int_min) col->int_min = int_value;
+        if (!col->has_value || int_value > col->int_max) col->int_max = int_value;
+        col->has_value = 1;
+    } else {
+        if (kind == DATA_INTEGER) double_value = (double)int_value;
+        col->doubles[row] = double_value;
+        if (double_value == double_value) {
+            if (!col->has_value || double_value < col->double_min) col->double_min = double_value;
+            if (!col->has_value || double_value > col->double_max) col->double_max = double_value;
+            col->has_value = 1;
+        }
+    }
+}
+
+uint32_t column_dict_index(column_builder_t* col, const char* value, size_t len) {
+    if ((size_t)(col->dict_count + 1) * 2 > col->slot_cap) {
+        // 扩容后按字典中的字符串重新放入槽位
+        col->slot_cap *= 2;
+        col->slots = xrealloc(col->slots, col->slot_cap * sizeof(uint32_t));
+        memset(col->slots, 0, col->slot_cap * sizeof(uint32_t));
+        for (uint32_t k = 0; k < col->dict_count; k++) {
+            uint32_t start = col->dict_offsets[k];
+            size_t i = hash_bytes(col->dict_bytes + start, col->dict_offsets[k + 1] - start, 0) & (col->slot_cap - 1);
+            while (col->slots[i]) i = (i + 1) & (col->slot_cap - 1);
+            col->slots[i] = k + 1;
+        }
+    }
+    size_t i = hash_bytes(value, len, 0) & (col->slot_cap - 1);
+    while (col->slots[i]) {
+        uint32_t k = col->slots[i] - 1;
+        uint32_t start = col->dict_offsets[k];
+        if (col->dict_offsets[k + 1] - start == len && memcmp(col->dict_bytes + start, value, len) == 0) {
+            return k;
+        }
+        i = (i + 1) & (col->slot_cap - 1);
+    }
+    if (col->dict_len + len > col->dict_cap) {
+        while (col->dict_len + len > col->dict_cap) col->dict_cap *= 2;
+        col->dict_bytes = xrealloc(col->dict_bytes, col->dict_cap);
+    }
+    memcpy(col->dict_bytes + col->dict_len, value, len);
+    col->dict_len += len;
+    uint32_t k = col->dict_count++;
+    col->dict_offsets[col->dict_count] = (uint32_t)col->dict_len;
+    col->slots[i] = k + 1;
+    return k;
+}
+
+void convert_flush_group(convert_worker_t* worker, column_builder_t* cols, uint32_t rows) {
+    const convert_plan_t* plan = worker->plan;
+    if (worker->num_groups == worker->group_cap) {
+        worker->group_cap = worker->group_cap ? worker->group_cap * 2 : 16;
+        worker->groups = xrealloc(worker->groups, worker->group_cap * sizeof(row_group_meta_t));
+    }
+    row_group_meta_t* group = &worker->groups[worker->num_groups++];
+    group->rows = rows;
+    group->chunks = xmalloc(plan->num_columns * sizeof(column_chunk_meta_t));
+
+    // 列块：有效位图，然后是数值数组，或字典（个数、偏移、字符串）加每行的字典下标；各部分按8字节对齐
+    PROF_BEGIN(write_start);
+    FILE* out = worker->out;
+    for (int c = 0; c < plan->num_columns; c++) {
+        column_builder_t* col = &cols[c];
+        column_chunk_meta_t* meta = &group->chunks[c];
+        memset(meta, 0, sizeof(*meta));
+        meta->offset = ftello(out);
+        meta->null_count = col->null_count;
+        fwrite(col->validity, 1, (rows + 7) / 8, out);
+        write_padding(out);
+        if (plan->types[c] == COLUMN_INT64) {
+            fwrite(col->ints, sizeof(int64_t), rows, out);
+            if (col->has_value) {
+                meta->stats[0] = (uint64_t)col->int_min;
+                meta->stats[1] = (uint64_t)col->int_max;
+            }
+        } else if (plan->types[c] == COLUMN_DOUBLE) {
+            fwrite(col->doubles, sizeof(double), rows, out);
+            if (col->has_value) {
+                memcpy(&meta->stats[0], &col->double_min, sizeof(double));
+                memcpy(&meta->stats[1], &col->double_max, sizeof(double));
+            }
+        } else {
+            write_u32(out, col->dict_count);
+            write_u32(out, 0);
+            fwrite(col->dict_offsets, sizeof(uint32_t), col->dict_count + 1, out);
+            write_padding(out);
+            fwrite(col->dict_bytes, 1, col->dict_len, out);
+            write_padding(out);
+            fwrite(col->indices, sizeof(uint32_t), rows, out);
+            write_padding(out);
+            meta->stats[0] = col->dict_count;
+        }
+        meta->length = ftello(out) - meta->offset;
+        column_builder_reset(col, plan->group_rows);
+    }
+    PROF_END(write_start, PROF_WRITE, 0);
+    worker->rows += rows;
+}
+
+void convert_write_footer(FILE* out, const convert_plan_t* plan, const convert_worker_t* workers, int threads,
+                          const long long* bases, uint64_t total_rows) {
+    // 页脚：列定义和各行组的列块位置，最后是页脚长度和魔数，读取时从文件末尾找到页脚
+    long long start = ftello(out);
+    uint32_t num_groups = 0;
+    for (int t = 0; t < threads; t++) {
+        num_groups += workers[t].num_groups;
+    }
+    write_u32(out, plan->num_columns);
+    write_u32(out, num_groups);
+    write_u64(out, total_rows);
+    for (int c = 0; c < plan->num_columns; c++) {
+        const char* name = plan->names[c] ? plan->names[c] : "";
+        write_u32(out, plan->types[c]);
+        write_u32(out, (uint32_t)strlen(name));
+        fputs(name, out);
+    }
+    for (int t = 0; t < threads; t++) {
+        for (int g = 0; g < workers[t].num_groups; g++) {
+            const row_group_meta_t* group = &workers[t].groups[g];
+            write_u64(out, group->rows);
+            for (int c = 0; c < plan->num_columns; c++) {
+                const column_chunk_meta_t* meta = &group->chunks[c];
+                write_u64(out, meta->offset + bases[t]);
+                write_u64(out, meta->length);
+                write_u64(out, meta->null_count);
+                write_u64(out, meta->stats[0]);
+                write_u64(out, meta->stats[1]);
+            }
+        }
+    }
+    write_u64(out, ftello(out) - start);
+    fwrite(COLUMNAR_MAGIC, 1, 8, out);
+}
+
+void write_padding(FILE* out) {
+    static const char zeros[8] = { 0 };
+    long long pos = ftello(out);
+    if (pos % 8) {
+        fwrite(zeros, 1, 8 - pos % 8, out);
+    }
+}
+
+void write_u32(FILE* out, uint32_t value) {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    }
+    fwrite(bytes, 1, 4, out);
+}
+
+void write_u64(FILE* out, uint64_t value) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    }
+    fwrite(bytes, 1, 8, out);
+}
+
+uint32_t read_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+uint64_t read_u64(const unsigned char* p) {
+    return (uint64_t)read_u32(p) | (uint64_t)read_u32(p + 4) << 32;
+}
+
+int columnar_is_file(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    char magic[8];
+    int result = fread(magic, 1, 8, file) == 8 && memcmp(magic, COLUMNAR_MAGIC, 8) == 0;
+    fclose(file);
+    return result;
+}
+
+void columnar_export_csv(const char* filename) {
+    FILE* in = fopen(filename, "rb");
+    if (!in) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        return;
+    }
+    // 先从文件末尾读出页脚，所有长度和偏移都先检查再使用
+    long long size = get_file_size(filename);
+    unsigned char tail[16];
+    unsigned char* footer = NULL;
+    unsigned char** chunks = NULL;
+    int num_columns = 0;
+    int corrupted = 1;
+    uint64_t footer_len = 0;
+    if (size >= 8 + 16 && fseeko(in, size - 16, SEEK_SET) == 0 && fread(tail, 1, 16, in) == 16 &&
+        memcmp(tail + 8, COLUMNAR_MAGIC, 8) == 0) {
+        footer_len = read_u64(tail);
+    }
+    long long data_end = size - 16 - (long long)footer_len;
+    if (footer_len >= 16 && footer_len <= (uint64_t)(size - 8 - 16)) {
+        footer = xmalloc(footer_len);
+        if (fseeko(in, data_end, SEEK_SET) == 0 && fread(footer, 1, footer_len, in) == footer_len) {
+            corrupted = 0;
+        }
+    }
+
+    const unsigned char* p = footer;
+    const unsigned char* end = footer + footer_len;
+    uint32_t num_groups = 0;
+    column_type_t* types = NULL;
+    if (!corrupted) {
+        num_columns = (int)read_u32(p);
+        num_groups = read_u32(p + 4);
+        p += 16;
+        corrupted = num_columns <= 0 || num_columns > MAX_COLUMNS;
+    }
+    if (!corrupted) {
+        types = xmalloc(num_columns * sizeof(column_type_t));
+        chunks = xmalloc(num_columns * sizeof(unsigned char*));
+        memset(chunks, 0, num_columns * sizeof(unsigned char*));
+        // 表头
+        for (int c = 0; c < num_columns && !corrupted; c++) {
+            if (end - p < 8) {
+                corrupted = 1;
+                break;
+            }
+            uint32_t type = read_u32(p);
+            uint32_t name_len = read_u32(p + 4);
+            p += 8;
+            if (type > COLUMN_STRING || (uint64_t)(end - p) < name_len) {
+                corrupted = 1;
+                break;
+            }
+            types[c] = (column_type_t)type;
+            if (c > 0) putchar(',');
+            fwrite(p, 1, name_len, stdout);
+            p += name_len;
+        }
+        if (!corrupted) {
+            putchar('\n');
+        }
+        if ((uint64_t)(end - p) != (uint64_t)num_groups * (8 + (uint64_t)num_columns * 40)) {
+            corrupted = 1;
+        }
+    }
+
+    for (uint32_t g = 0; g < num_groups && !corrupted; g++) {
+        uint64_t rows = read_u64(p);
+        p += 8;
+        size_t validity_len = ((rows + 7) / 8 + 7) & ~(size_t)7;
+        const uint8_t* validity[MAX_COLUMNS];
+        const unsigned char* values[MAX_COLUMNS];
+        const uint32_t* offsets[MAX_COLUMNS];
+        const char* dict[MAX_COLUMNS];
+        uint32_t dict_count[MAX_COLUMNS];
+        for (int c = 0; c < num_columns && !corrupted; c++, p += 40) {
+            uint64_t offset = read_u64(p);
+            uint64_t length = read_u64(p + 8);
+            if (rows > UINT32_MAX || offset < 8 || offset > (uint64_t)data_end || length > (uint64_t)data_end - offset) {
+                corrupted = 1;
+                break;
+            }
+            chunks[c] = xrealloc(chunks[c], length ? length : 1);
+            if (fseeko(in, (off_t)offset, SEEK_SET) != 0 || fread(chunks[c], 1, length, in) != length) {
+                corrupted = 1;
+                break;
+            }
+            // 列块布局见 convert_flush_group
+            unsigned char* chunk = chunks[c];
+            validity[c] = chunk;
+            if (types[c] != COLUMN_STRING) {
+                values[c] = chunk + validity_len;
+                corrupted = length < validity_len + rows * 8;
+                continue;
+            }
+            if (length < validity_len + 8) {
+                corrupted = 1;
+                break;
+            }
+            dict_count[c] = read_u32(chunk + validity_len);
+            uint64_t offsets_len = ((uint64_t)(dict_count[c] + 1) * 4 + 7) & ~(uint64_t)7;
+            uint64_t pos = validity_len + 8;
+            if (dict_count[c] > rows || length - pos < offsets_len) {
+                corrupted = 1;
+                break;
+            }
+            offsets[c] = (const uint32_t*)(chunk + pos);
+            pos += offsets_len;
+            uint64_t bytes_len = ((uint64_t)offsets[c][dict_count[c]] + 7) & ~(uint64_t)7;
+            for (uint32_t k = 0; k < dict_count[c] && !corrupted; k++) {
+                corrupted = offsets[c][k] > offsets[c][k + 1];
+            }
+            if (corrupted || offsets[c][0] != 0 || length - pos < bytes_len || length - pos - bytes_len < rows * 4) {
+                corrupted = 1;
+                break;
+            }
+            dict[c] = (const char*)(chunk + pos);
+            values[c] = chunk + pos + bytes_len;
+        }
+
+        for (uint64_t r = 0; r < rows && !corrupted; r++) {
+            for (int c = 0; c < num_columns; c++) {
+                if (c > 0) putchar(',');
+                if (!(validity[c][r >> 3] & (1 << (r & 7)))) {
+                    continue;
+                }
+                if (types[c] == COLUMN_INT64) {
+                    int64_t value;
+                    memcpy(&value, values[c] + r * 8, 8);
+                    printf("%lld", (long long)value);
+                } else if (types[c] == COLUMN_DOUBLE) {
+                    double value;
+                    memcpy(&value, values[c] + r * 8, 8);
+                    columnar_print_double(value);
+                } else {
+                    uint32_t k;
+                    memcpy(&k, values[c] + r * 4, 4);
+                    if (k >= dict_count[c]) {
+                        corrupted = 1;
+                        break;
+                    }
+                    fwrite(dict[c] + offsets[c][k], 1, offsets[c][k + 1] - offsets[c][k], stdout);
+                }
+            }
+            putchar('\n');
+        }
+    }
+    if (corrupted) {
+        fprintf(stderr, "错误: 列存文件已损坏: %s\n", filename);
+        g_exit_status = 1;
+    }
+
+    for (int c = 0; chunks && c < num_columns; c++) {
+        free(chunks[c]);
+    }
+    free(chunks);
+    free(types);
+    free(footer);
+    fclose(in);
+}
+
+void columnar_print_double(double value) {
+    // 用能还原出同一个值的最短写法
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.15g", value);
+    if (strtod(buffer, NULL) != value) {
+        snprintf(buffer, sizeof(buffer), "%.17g", value);
+    }
+    fputs(buffer, stdout);
+}
+
+void check_file_consistency(const char* filename) {
+    if (g_options.check_summary) {
+        check_file_profile(filename);
+        return;
+    }
+
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    check_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.delim_type = table.delim_type;
+    state.delim_char = table.delim_char;
+    state.kernel = table.kernel;
+
+    // 结构化输出时每个不一致行立即写出一条记录
+    json_writer_t json;
+    json_writer_t* out = NULL;
+    if (g_options.format != FORMAT_TEXT) {
+        out = &json;
+        check_begin_output(filename, state.delim_type, out);
+    }
+
+    // 表头决定期望列数；之后把行号移到范围的实际起点
+    char* line;
+    size_t len;
+    if (table.num_columns > 0) {
+        check_consume_line(&state, out, table.header_line, table.header_len);
+        if (table.first_row > 0) {
+            state.lines += table.first_row;
+        } else if (table.first_row < 0) {
+            fprintf(stderr, "注意: 范围起点之前的行数未知，行号从范围起点开始计算\n");
+        }
+    }
+    while (!state.stopped && (line = line_reader_next(&table.reader, &len)) != NULL) {
+        check_consume_line(&state, out, line, len);
+        state.stopped = (g_options.max_errors > 0 && state.inconsistent_lines == g_options.max_errors);
+    }
+    table_close(&table);
+
+    if (state.stopped && !out) {
+        printf("已达到 --max-errors 上限 (%lld)，在第 %lld 行停止检查\n", g_options.max_errors, state.lines);
+    }
+    check_print_summary(filename, &state, out);
+}
+
+void check_file_profile(const char* filename) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table.num_columns == 0) {
+        fprintf(stderr, "错误: 文件没有表头: %s\n", filename);
+        table_close(&table);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    check_profile_t* profile = xmalloc(sizeof(check_profile_t));
+    memset(profile, 0, sizeof(check_profile_t));
+    profile->kernel = table.kernel;
+    profile->delim_type = table.delim_type;
+    profile->max_examples = g_options.examples;
+    profile->schema.kernel = table.kernel;
+    profile->schema.num_columns = table.num_columns;
+    profile->schema.names = table.names;
+    profile->schema.types = xmalloc(table.num_columns * sizeof(column_type_t));
+
+    // 与 convert 相同的规则推断列类型，样本读完后重新打开，从范围起点开始检查
+    convert_infer_schema(&table, &profile->schema, CHECK_TYPE_TOLERANCE);
+    table_close(&table);
+    if (table_open(&table, filename) != 0 || table_apply_window(&table) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        free(profile->schema.types);
+        free(profile);
+        return;
+    }
+    profile->max_typed_col = -1;
+    for (int c = 0; c < table.num_columns; c++) {
+        if (profile->schema.types[c] != COLUMN_STRING) profile->max_typed_col = c;
+    }
+    profile->types = xmalloc(table.num_columns * sizeof(check_bucket_t));
+    memset(profile->types, 0, table.num_columns * sizeof(check_bucket_t));
+    profile->nulls = xmalloc(table.num_columns * sizeof(long long));
+    memset(profile->nulls, 0, table.num_columns * sizeof(long long));
+    profile->fields = xmalloc((profile->max_typed_col + 2) * sizeof(field_t));
+
+    profile->lines = 1;
+    if (table.first_row > 0) {
+        profile->lines += table.first_row;
+    } else if (table.first_row < 0) {
+        fprintf(stderr, "注意: 范围起点之前的行数未知，行号从范围起点开始计算\n");
+    }
+    char* line;
+    size_t len;
+    while (!profile->stopped && (line = line_reader_next(&table.reader, &len)) != NULL) {
+        check_profile_line(profile, line, len);
+    }
+    table_close(&table);
+
+    check_print_profile(filename, profile);
+
+    for (int k = 0; k < MAX_COLUMNS + 2; k++) {
+        free(profile->counts[k].examples);
+    }
+    for (int c = 0; c < profile->schema.num_columns; c++) {
+        free(profile->types[c].examples);
+    }
+    free(profile->types);
+    free(profile->nulls);
+    free(profile->fields);
+    free(profile->schema.types);
+    free(profile);
+}
+
+void check_profile_line(check_profile_t* profile, char* line, size_t len) {
+    profile->lines++;
+    profile->rows++;
+    int expected = profile->schema.num_columns;
+    int column_count = profile->kernel->count(line, len);
+    check_bucket_t* bucket = &profile->counts[column_count <= MAX_COLUMNS ? column_count : MAX_COLUMNS + 1];
+    bucket->lines++;
+
+    int invalid = 0;
+    if (column_count != expected) {
+        // 列数不对时字段无法对齐，不再检查类型
+        check_add_example(bucket, profile->max_examples, profile->lines, line, len);
+        profile->count_lines++;
+        invalid = 1;
+    } else if (profile->max_typed_col >= 0) {
+        // 只切分到最后一个需要检查类型的列，字符串列不做检查
+        int count = profile->kernel->split(line, len, profile->fields, profile->max_typed_col + 1);
+        for (int c = 0; c < count; c++) {
+            int match = check_value_type(profile->schema.types[c], profile->fields[c].ptr, profile->fields[c].len);
+            if (match == 0) {
+                profile->nulls[c]++;
+            } else if (match < 0) {
+                check_add_example(&profile->types[c], profile->max_examples, profile->lines, profile->fields[c].ptr,
+                                  profile->fields[c].len);
+                profile->types[c].lines++;
+                invalid = 1;
+            }
+        }
+        if (invalid) {
+            profile->type_lines++;
+        }
+    }
+    if (invalid && ++profile->invalid_lines == g_options.max_errors) {
+        profile->stopped = 1;
+    }
+}
+
+int check_value_type(column_type_t type, const char* value, size_t len) {
+    // 返回 0 为空值，1 为符合类型，-1 为不符合
+    while (len > 0 && isspace((unsigned char)*value)) {
+        value++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)value[len - 1])) {
+        len--;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    if (type == COLUMN_STRING) {
+        return 1;
+    }
+
+    // 常见写法直接扫描：可选符号，整数列为不超过18位数字，浮点列还允许一个小数点和指数；
+    // 其他写法（很长的整数、inf、十六进制等）交给 convert_classify 判断
+    size_t i = (value[0] == '+' || value[0] == '-') ? 1 : 0;
+    size_t digits = 0;
+    int dot = 0;
+    for (; i < len; i++) {
+        if (value[i] >= '0' && value[i] <= '9') {
+            digits++;
+        } else if (value[i] == '.' && type == COLUMN_DOUBLE && !dot) {
+            dot = 1;
+        } else {
+            break;
+        }
+    }
+    if (digits > 0 && type == COLUMN_DOUBLE && i < len && (value[i] == 'e' || value[i] == 'E')) {
+        size_t exp = i + 1;
+        if (exp < len && (value[exp] == '+' || value[exp] == '-')) exp++;
+        size_t exp_digits = 0;
+        while (exp < len && value[exp] >= '0' && value[exp] <= '9') {
+            exp++;
+            exp_digits++;
+        }
+        if (exp_digits > 0) i = exp;
+    }
+    if (i == len && digits > 0 && (type == COLUMN_DOUBLE || digits <= 18)) {
+        return 1;
+    }
+
+    int64_t int_value;
+    double double_value;
+    data_type_t kind = convert_classify(value, len, &int_value, &double_value);
+    if (kind == DATA_INTEGER || (kind == DATA_FLOAT && type == COLUMN_DOUBLE)) {
+        return 1;
+    }
+    return -1;
+}
+
+void check_add_example(check_bucket_t* bucket, int max_examples, long long line, const char* text, size_t len) {
+    if (bucket->num_examples >= max_examples) {
+        return;
+    }
+    if (!bucket->examples) {
+        bucket->examples = xmalloc(max_examples * sizeof(check_example_t));
+    }
+    // 过长的内容截断在UTF-8字符边界上
+    check_example_t* example = &bucket->examples[bucket->num_examples++];
+    example->line = line;
+    example->truncated = len > CHECK_EXAMPLE_BYTES;
+    if (example->truncated) {
+        len = CHECK_EXAMPLE_BYTES;
+        while (len > 0 && ((unsigned char)text[len] & 0xC0) == 0x80) len--;
+    }
+    memcpy(example->text, text, len);
+    example->len = (int)len;
+}
+
+void check_print_profile(const char* filename, const check_profile_t* profile) {
+    const convert_plan_t* schema = &profile->schema;
+    int expected = schema->num_columns;
+    if (g_options.format != FORMAT_TEXT) {
+        // 结构化输出：ndjson 为每个列数一条、每列一条、最后汇总一条；json 为一个对象
+        json_writer_t json;
+        json_init(&json, stdout, g_options.format == FORMAT_NDJSON);
+        if (!json.ndjson) {
+            json_begin_object(&json, NULL);
+            json_cstring(&json, "file", filename);
+            json_cstring(&json, "delimiter", delimiter_keys[profile->delim_type]);
+            json_begin_array(&json, "column_counts");
+        }
+        for (int k = 0; k < MAX_COLUMNS + 2; k++) {
+            const check_bucket_t* bucket = &profile->counts[k];
+            if (bucket->lines == 0) continue;
+            json_begin_object(&json, NULL);
+            if (json.ndjson) json_cstring(&json, "type", "column_count");
+            json_int(&json, "columns", k <= MAX_COLUMNS ? k : MAX_COLUMNS + 1);
+            json_int(&json, "lines", bucket->lines);
+            json_bool(&json, "expected", k == expected);
+            check_print_examples(bucket, &json);
+            json_end_object(&json);
+        }
+        if (!json.ndjson) {
+            json_end_array(&json);
+            json_begin_array(&json, "columns");
+        }
+        for (int c = 0; c < expected; c++) {
+            json_begin_object(&json, NULL);
+            if (json.ndjson) json_cstring(&json, "type", "column");
+            json_cstring(&json, "name", schema->names[c] ? schema->names[c] : "");
+            json_cstring(&json, "data_type", column_type_names[schema->types[c]]);
+            json_int(&json, "nulls", profile->nulls[c]);
+            json_int(&json, "type_violations", profile->types[c].lines);
+            check_print_examples(&profile->types[c], &json);
+            json_end_object(&json);
+        }
+        if (json.ndjson) {
+            json_begin_object(&json, NULL);
+            json_cstring(&json, "type", "summary");
+            json_cstring(&json, "file", filename);
+            json_cstring(&json, "delimiter", delimiter_keys[profile->delim_type]);
+        } else {
+            json_end_array(&json);
+        }
+        json_int(&json, "expected_columns", expected);
+        json_int(&json, "lines", profile->lines);
+        json_int(&json, "rows", profile->rows);
+        json_int(&json, "invalid_lines", profile->invalid_lines);
+        json_int(&json, "column_count_violations", profile->count_lines);
+        json_int(&json, "type_violation_lines", profile->type_lines);
+        json_bool(&json, "consistent", profile->invalid_lines == 0);
+        json_bool(&json, "stopped_early", profile->stopped);
+        json_end_object(&json);
+        return;
+    }
+
+    printf("=== 数据校验结果 ===\n");
+    printf("分隔符: ");
+    switch (profile->delim_type) {
+        case DELIM_TAB: printf("TAB"); break;
+        case DELIM_COMMA: printf(","); break;
+        case DELIM_SEMICOLON: printf(";"); break;
+        case DELIM_PIPE: printf("|"); break;
+        case DELIM_SPACE: printf("空格"); break;
+        case DELIM_MULTISPACE: printf("多空格"); break;
+        default: printf("未知"); break;
+    }
+    printf("\n期望列数: %d, 已检查 %lld 行数据\n\n", expected, profile->rows);
+
+    printf("列数分布:\n");
+    for (int k = 0; k < MAX_COLUMNS + 2; k++) {
+        const check_bucket_t* bucket = &profile->counts[k];
+        if (bucket->lines == 0) continue;
+        if (k <= MAX_COLUMNS) {
+            printf("  %d 列: %lld 行%s\n", k, bucket->lines, k == expected ? "" : " (不一致)");
+        } else {
+            printf("  超过 %d 列: %lld 行 (不一致)\n", MAX_COLUMNS, bucket->lines);
+        }
+        check_print_examples(bucket, NULL);
+    }
+
+    printf("\n各列类型（按前%d行推断）:\n", CONVERT_SAMPLE_ROWS);
+    for (int c = 0; c < expected; c++) {
+        // 字符串列不检查，没有空值统计
+        printf("  %d. %s: %s", c + 1, schema->names[c] ? schema->names[c] : "", column_type_names[schema->types[c]]);
+        if (schema->types[c] != COLUMN_STRING) {
+            printf(", 空值 %lld", profile->nulls[c]);
+        }
+        if (profile->types[c].lines > 0) {
+            printf(", 类型不符 %lld", profile->types[c].lines);
+        }
+        putchar('\n');
+        check_print_examples(&profile->types[c], NULL);
+    }
+
+    printf("\n");
+    if (profile->stopped) {
+        printf("已达到 --max-errors 上限 (%lld)，在第 %lld 行停止检查\n", g_options.max_errors, profile->lines);
+    }
+    if (profile->invalid_lines == 0) {
+        printf("所有行列数和类型均一致\n");
+    } else {
+        printf("共有 %lld 行存在问题 (列数不同 %lld 行, 类型不符 %lld 行)\n", profile->invalid_lines,
+               profile->count_lines, profile->type_lines);
+    }
+}
+
+void check_print_examples(const check_bucket_t* bucket, json_writer_t* json) {
+    if (json) {
+        json_begin_array(json, "examples");
+    }
+    for (int i = 0; i < bucket->num_examples; i++) {
+        const check_example_t* example = &bucket->examples[i];
+        if (json) {
+            json_begin_object(json, NULL);
+            json_int(json, "line", example->line);
+            json_string(json, "content", example->text, example->len);
+            json_bool(json, "truncated", example->truncated);
+            json_end_object(json);
+        } else {
+            printf("    行 %lld: %.*s%s\n", example->line, example->len, example->text, example->truncated ? "..." : "");
+        }
+    }
+    if (json) {
+        json_end_array(json);
+    }
+}
+
+void check_begin_output(const char* filename, delimiter_type_t delim_type, json_writer_t* json) {
+    json_init(json, stdout, g_options.format == FORMAT_NDJSON);
+    if (!json->ndjson) {
+        json_begin_object(json, NULL);
+        json_cstring(json, "file", filename);
+        json_cstring(json, "delimiter", delimiter_keys[delim_type]);
+        json_begin_array(json, "inconsistent");
+    }
+}
+
+void check_consume_line(check_state_t* state, json_writer_t* json, char* line, size_t len) {
+    int column_count = state->kernel->count(line, len);
+    state->lines++;
+    
+    if (state->lines == 1) {
+        state->expected_columns = column_count;
+        return;
+    }
+    if (column_count == state->expected_columns) {
+        return;
+    }
+    
+    state->inconsistent_lines++;
+    if (state->record_file) {
+        // 部分状态：记录范围内的相对行号，合并时再换算成文件中的行号
+        fprintf(state->record_file, "bad %lld %d ", state->lines, column_count);
+        fwrite(line, 1, len, state->record_file);
+        fputc('\n', state->record_file);
+        return;
+    }
+    check_emit_inconsistent(json, state->lines, column_count, state->expected_columns, line, len);
+}
+
+void check_emit_inconsistent(json_writer_t* json, long long line_number, int column_count, int expected,
+                             const char* line, size_t len) {
+    if (!json) {
+        printf("不一致行号:%lld, 列数:%d, 内容: %s\n", line_number, column_count, line);
+        return;
+    }
+    json_begin_object(json, NULL);
+    if (json->ndjson) {
+        json_cstring(json, "type", "inconsistent");
+    }
+    json_int(json, "line", line_number);
+    json_int(json, "columns", column_count);
+    json_int(json, "expected", expected);
+    json_string(json, "content", line, len);
+    json_end_object(json);
+}
+
+void check_print_summary(const char* filename, const check_state_t* state, json_writer_t* json) {
+    if (json) {
+        if (json->ndjson) {
+            json_begin_object(json, NULL);
+            json_cstring(json, "type", "summary");
+            json_cstring(json, "file", filename);
+            json_cstring(json, "delimiter", delimiter_keys[state->delim_type]);
+        } else {
+            json_end_array(json);
+        }
+        json_int(json, "expected_columns", state->expected_columns);
+        json_int(json, "lines", state->lines);
+        json_int(json, "inconsistent_lines", state->inconsistent_lines);
+        json_bool(json, "consistent", state->inconsistent_lines == 0);
+        if (state->stopped) {
+            json_bool(json, "stopped_early", 1);
+        }
+        json_end_object(json);
+        return;
+    }
+
+    if (state->inconsistent_lines == 0) {
+        printf("所有行列数相同 (分隔符: ");
+        switch (state->delim_type) {
+            case DELIM_TAB: printf("TAB"); break;
+            case DELIM_COMMA: printf(","); break;
+            case DELIM_SEMICOLON: printf(";"); break;
+            case DELIM_PIPE: printf("|"); break;
+            case DELIM_SPACE: printf("空格"); break;
+            case DELIM_MULTISPACE: printf("多空格"); break;
+            default: printf("未知"); break;
+        }
+        printf(")\n");
+    } else {
+        printf("共有 %lld 行列数不同\n", state->inconsistent_lines);
+    }
+}
+
+void follow_file(const char* filename, const char* command) {
+    scan_state_t state;
+    scan_state_init(&state, strcmp(command, "check") == 0);
+
+    // 从检查点恢复；文件被替换或截断时从头开始
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        free(state.stats);
+        return;
+    }
+    if (g_options.checkpoint && access(g_options.checkpoint, F_OK) == 0) {
+        if (scan_state_load(&state, g_options.checkpoint) != 0) {
+            free(state.stats);
+            return;
+        }
+        if (state.inode != (unsigned long long)st.st_ino || state.offset > (long long)st.st_size) {
+            fprintf(stderr, "警告: 文件已被替换或截断，从头开始统计\n");
+            scan_state_reset(&state);
+        }
+    }
+    state.inode = (unsigned long long)st.st_ino;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0 || lseek(fd, state.offset, SEEK_SET) < 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        if (fd >= 0) close(fd);
+        free(state.stats);
+        return;
+    }
+
+    // 跟踪模式下 json 没有结尾，改为每条记录一行
+    json_writer_t json;
+    json_writer_t* out = NULL;
+    if (g_options.format != FORMAT_TEXT) {
+        out = &json;
+        json_init(&json, stdout, g_options.format == FORMAT_NDJSON || (state.is_check && g_options.follow));
+    }
+    if (out && !out->ndjson && state.is_check) {
+        json_begin_object(out, NULL);
+        json_cstring(out, "file", filename);
+        json_begin_array(out, "inconsistent");
+    }
+
+    int watch_fd = -1;
+#ifdef __linux__
+    int inotify_fd = -1;
+    if (g_options.follow) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd >= 0) {
+            watch_fd = inotify_add_watch(inotify_fd, filename,
+                                         IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+        }
+    }
+#endif
+    if (g_options.follow) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = follow_signal_handler;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    field_t* fields = xmalloc(MAX_COLUMNS * sizeof(field_t));
+    size_t cap = READ_BUFFER_SIZE;
+    char* buf = xmalloc(cap);
+    size_t used = 0;              // 缓冲区中尚未构成完整行的字节
+    int dirty = 0;                // 上次输出后是否处理过新数据
+    int partial_saved = 0;        // 检查点已在处理末尾不完整的行之前保存
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long last_emit_ms = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    while (!g_follow_stop) {
+        // 读取新追加的字节，只处理以换行结束的完整行，不完整的行留到下次；
+        // 不跟踪时没有下次，文件末尾没有换行的最后一行补上换行一起处理
+        ssize_t got = read(fd, buf + used, cap - used - 1);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        int last_partial = (got == 0 && !g_options.follow && used > 0);
+        if (got > 0 || last_partial) {
+            if (last_partial) {
+                // 这一行可能还在写入，检查点停在最后一个完整行之后，写完后下次从行首重新读取；
+                // 本次输出仍然包含这一行
+                if (g_options.checkpoint) {
+                    scan_state_save(&state, filename, g_options.checkpoint);
+                    partial_saved = 1;
+                }
+                buf[used++] = '\n';
+            } else {
+                used += (size_t)got;
+            }
+            char* start = buf;
+            char* end = buf + used;
+            char* nl;
+            while ((nl = memchr(start, '\n', end - start)) != NULL) {
+                size_t len = nl - start;
+                state.offset += (long long)len + 1;
+                if (len > 0 && start[len - 1] == '\r') len--;
+                start[len] = '\0';
+                if (state.lines_pending_detect) {
+                    // 首次有完整数据时才检测分隔符，文件可能在启动时还是空的
+                    delimiter_type_t type;
+                    char delim_char;
+                    type = detect_delimiter(filename, &delim_char);
+                    const parse_kernel_t* kernel = parse_kernel_select(delim_char, type == DELIM_MULTISPACE);
+                    if (state.is_check) {
+                        state.check.delim_type = type;
+                        state.check.delim_char = delim_char;
+                        state.check.kernel = kernel;
+                    } else {
+                        state.stats->delimiter = type;
+                        state.stats->delimiter_char = delim_char;
+                        state.stats->kernel = kernel;
+                    }
+                    state.lines_pending_detect = 0;
+                }
+                scan_consume_line(&state, out, start, len, fields);
+                start = nl + 1;
+            }
+            if (last_partial) {
+                // 补上的换行不在文件中
+                state.offset--;
+            }
+            used = end - start;
+            memmove(buf, start, used);
+            if (used + 1 >= cap) {
+                cap *= 2;
+                buf = xrealloc(buf, cap);
+            }
+            dirty = 1;
+            continue;
+        }
+        
+        // 已读到文件末尾
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long now_ms = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+        if (!g_options.follow) {
+            break;
+        }
+        if (dirty && now_ms - last_emit_ms >= g_options.interval_ms) {
+            scan_emit(filename, &state, out);
+            if (g_options.checkpoint) {
+                scan_state_save(&state, filename, g_options.checkpoint);
+            }
+            last_emit_ms = now_ms;
+            dirty = 0;
+        }
+        
+        // 文件被截断或被替换（日志轮转）时重新开始
+        if (stat(filename, &st) == 0 &&
+            ((unsigned long long)st.st_ino != state.inode || (long long)st.st_size < state.offset)) {
+            fprintf(stderr, "警告: 文件已被替换或截断，从头开始统计\n");
+            int new_fd = open(filename, O_RDONLY);
+            if (new_fd >= 0) {
+                close(fd);
+                fd = new_fd;
+                scan_state_reset(&state);
+                state.inode = (unsigned long long)st.st_ino;
+                used = 0;
+#ifdef __linux__
+                if (inotify_fd >= 0) {
+                    if (watch_fd >= 0) inotify_rm_watch(inotify_fd, watch_fd);
+                    watch_fd = inotify_add_watch(inotify_fd, filename,
+                                                 IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+                }
+#endif
+                continue;
+            }
+        }
+        
+        // 等待文件变化：有inotify时等待事件，否则定时轮询；有未输出的数据时在到期时醒来
+        int timeout = 1000;
+        if (dirty) {
+            long long remain = g_options.interval_ms - (now_ms - last_emit_ms);
+            if (remain < timeout) timeout = remain > 0 ? (int)remain : 0;
+        }
+#ifdef __linux__
+        if (watch_fd >= 0) {
+            struct pollfd pfd = { inotify_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, timeout) > 0) {
+                char events[4096];
+                while (read(inotify_fd, events, sizeof(events)) > 0) {
+                    // 只需要知道有变化，事件内容不重要
+                }
+            }
+            continue;
+        }
+#endif
+        poll(NULL, 0, timeout);
+    }
+
+    // 输出最终结果并保存检查点
+    if (out && !out->ndjson && state.is_check) {
+        check_print_summary(filename, &state.check, out);
+    } else {
+        scan_emit(filename, &state, out);
+    }
+    if (g_options.checkpoint && !partial_saved) {
+        scan_state_save(&state, filename, g_options.checkpoint);
+    }
+
+#ifdef __linux__
+    if (inotify_fd >= 0) close(inotify_fd);
+#endif
+    close(fd);
+    free(buf);
+    free(fields);
+    free(state.stats);
+}
+
+void scan_state_init(scan_state_t* state, int is_check) {
+    memset(state, 0, sizeof(*state));
+    state->is_check = is_check;
+    state->stats = xmalloc(sizeof(file_stats_t));
+    scan_state_reset(state);
+}
+
+void scan_state_reset(scan_state_t* state) {
+    state->offset = 0;
+    state->lines_pending_detect = 1;
+    memset(state->stats, 0, sizeof(file_stats_t));
+    memset(&state->check, 0, sizeof(check_state_t));
+    state->stats->delimiter = DELIM_UNKNOWN;
+    state->check.delim_type = DELIM_UNKNOWN;
+    state->stats->kernel = state->check.kernel = &parse_kernels[DELIM_UNKNOWN];
+}
+
+void scan_consume_line(scan_state_t* state, json_writer_t* json, char* line, size_t len, field_t* fields) {
+    if (state->is_check) {
+        check_consume_line(&state->check, json, line, len);
+    } else {
+        stats_consume_line(state->stats, line, len, fields);
+    }
+}
+
+void scan_emit(const char* filename, scan_state_t* state, json_writer_t* json) {
+    if (!json) {
+        // 文本输出前加时间戳，便于区分每次输出
+        time_t t = time(NULL);
+        char stamp[64];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        printf("\n--- %s 已处理 %lld 字节 ---\n", stamp, state->offset);
+    }
+    if (state->is_check) {
+        check_print_summary(filename, &state->check, json);
+    } else {
+        state->stats->file_size = (long)state->offset;
+        print_file_stats(filename, state->stats);
+    }
+    fflush(stdout);
+}
+
+int scan_state_save(const scan_state_t* state, const char* filename, const char* path) {
+    FILE* file = scan_state_begin(state, filename, path);
+    if (!file) {
+        return -1;
+    }
+    return scan_state_finish(file, state, path);
+}
+
+FILE* scan_state_begin(const scan_state_t* state, const char* filename, const char* path) {
+    // 先写临时文件再改名，进程中途被杀也不会留下不完整的检查点
+    char tmp_path[MAX_FILENAME * 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "w");
+    if (!file) {
+        fprintf(stderr, "无法写入检查点文件: %s\n", path);
+        return NULL;
+    }
+    fprintf(file, "detect_delim-state %d\n", STATE_FILE_VERSION);
+    fprintf(file, "command %s\n", state->is_check ? "check" : "stats");
+    fprintf(file, "file %s\n", filename);
+    fprintf(file, "offset %lld\n", state->offset);
+    fprintf(file, "inode %llu\n", state->inode);
+    if (state->file_size > 0) {
+        fprintf(file, "range %lld %lld\n", state->range_start, state->range_end);
+        fprintf(file, "file_size %lld\n", state->file_size);
+    }
+    return file;
+}
+
+int scan_state_finish(FILE* file, const scan_state_t* state, const char* path) {
+    char tmp_path[MAX_FILENAME * 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (state->is_check) {
+        const check_state_t* check = &state->check;
+        fprintf(file, "delimiter %d %d\n", (int)check->delim_type, (int)(unsigned char)check->delim_char);
+        fprintf(file, "lines %lld\n", check->lines);
+        fprintf(file, "expected %d\n", check->expected_columns);
+        fprintf(file, "inconsistent %lld\n", check->inconsistent_lines);
+    } else {
+        const file_stats_t* stats = state->stats;
+        fprintf(file, "delimiter %d %d\n", (int)stats->delimiter, (int)(unsigned char)stats->delimiter_char);
+        fprintf(file, "lines %lld\n", stats->lines);
+        fprintf(file, "rows %lld\n", stats->total_rows);
+        fprintf(file, "encoding %d\n", (int)stats->encoding);
+        fprintf(file, "columns %d\n", stats->total_columns);
+        // 每列一行，列名放在最后（可能含空格）
+        for (int i = 0; i < stats->total_columns && i < MAX_COLUMNS; i++) {
+            const column_stats_t* col = &stats->columns[i];
+            fprintf(file, "column %d %lld %lld %lld %lld %lld %s\n", i + 1, col->empty_count,
+                    col->non_empty_count, col->numeric_count, col->float_count, col->text_count, col->name ? col->name : "");
+        }
+    }
+    fprintf(file, "end\n");
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "无法写入检查点文件: %s\n", path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int scan_state_load(scan_state_t* state, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "无法打开检查点文件: %s\n", path);
+        return -1;
+    }
+    // 部分状态中的不一致行可能很长，按行动态读取
+    char* line = NULL;
+    size_t line_cap = 0;
+    int version = 0;
+    int complete = 0;
+    scan_state_reset(state);
+    state->lines_pending_detect = 0;
+    
+    while (getline(&line, &line_cap, file) != -1) {
+        if (strncmp(line, "bad ", 4) == 0) {
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = 0;
+        char key[32];
+        int pos = 0;
+        if (sscanf(line, "%31s %n", key, &pos) < 1) {
+            continue;
+        }
+        const char* value = line + pos;
+        if (strcmp(key, "detect_delim-state") == 0) {
+            version = atoi(value);
+        } else if (strcmp(key, "command") == 0) {
+            if (state->is_check < 0) {
+                state->is_check = (strcmp(value, "check") == 0);
+            } else if ((strcmp(value, "check") == 0) != state->is_check) {
+                fprintf(stderr, "错误: 检查点文件属于 %s 命令: %s\n", value, path);
+                free(line);
+                fclose(file);
+                return -1;
+            }
+        } else if (strcmp(key, "file") == 0) {
+            snprintf(state->file, sizeof(state->file), "%s", value);
+        } else if (strcmp(key, "range") == 0) {
+            sscanf(value, "%lld %lld", &state->range_start, &state->range_end);
+        } else if (strcmp(key, "file_size") == 0) {
+            state->file_size = atoll(value);
+        } else if (strcmp(key, "offset") == 0) {
+            state->offset = atoll(value);
+        } else if (strcmp(key, "inode") == 0) {
+            state->inode = strtoull(value, NULL, 10);
+        } else if (strcmp(key, "delimiter") == 0) {
+            int type = DELIM_UNKNOWN, ch = 0;
+            sscanf(value, "%d %d", &type, &ch);
+            if (type < DELIM_TAB || type > DELIM_UNKNOWN) type = DELIM_UNKNOWN;
+            state->check.delim_type = state->stats->delimiter = (delimiter_type_t)type;
+            state->check.delim_char = state->stats->delimiter_char = (char)ch;
+            state->check.kernel = state->stats->kernel = parse_kernel_select((char)ch, type == DELIM_MULTISPACE);
+        } else if (strcmp(key, "lines") == 0) {
+            state->check.lines = state->stats->lines = atoll(value);
+        } else if (strcmp(key, "expected") == 0) {
+            state->check.expected_columns = atoi(value);
+        } else if (strcmp(key, "inconsistent") == 0) {
+            state->check.inconsistent_lines = atoll(value);
+        } else if (strcmp(key, "rows") == 0) {
+            state->stats->total_rows = atoll(value);
+        } else if (strcmp(key, "encoding") == 0) {
+            int encoding = atoi(value);
+            state->stats->encoding = (encoding >= ENC_UTF8 && encoding <= ENC_UNKNOWN) ? (encoding_t)encoding : ENC_UNKNOWN;
+        } else if (strcmp(key, "columns") == 0) {
+            state->stats->total_columns = atoi(value);
+        } else if (strcmp(key, "column") == 0) {
+            int index = 0, name_pos = 0;
+            column_stats_t col;
+            memset(&col, 0, sizeof(col));
+            if (sscanf(value, "%d %lld %lld %lld %lld %lld %n", &index, &col.empty_count, &col.non_empty_count,
+                       &col.numeric_count, &col.float_count, &col.text_count, &name_pos) >= 6 &&
+                index >= 1 && index <= MAX_COLUMNS) {
+                col.name = intern_string(value + name_pos, strlen(value + name_pos));
+                state->stats->columns[index - 1] = col;
+            }
+        } else if (strcmp(key, "end") == 0) {
+            complete = 1;
+        }
+    }
+    free(line);
+    fclose(file);
+    
+    if (version != STATE_FILE_VERSION || !complete) {
+        fprintf(stderr, "错误: 检查点文件格式不正确: %s\n", path);
+        return -1;
+    }
+    // 只有表头行时分隔符可能尚未检测
+    if (state->check.lines == 0) {
+        state->lines_pending_detect = 1;
+    }
+    return 0;
+}
+
+void follow_signal_handler(int sig) {
+    (void)sig;
+    g_follow_stop = 1;
+}
+
+void scan_partial(const char* filename, const char* command) {
+    scan_state_t state;
+    scan_state_init(&state, strcmp(command, "check") == 0);
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        free(state.stats);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        free(state.stats);
+        return;
+    }
+
+    // 包含表头的范围从0开始，这样相邻范围首尾相接，合并时可以检查是否有遗漏
+    state.range_start = table.include_header ? 0 : table.data_start;
+    state.file_size = table.file_size;
+    state.range_end = table.data_end >= 0 ? table.data_end : state.file_size;
+    state.offset = state.range_end;
+    state.lines_pending_detect = 0;
+    state.stats->delimiter = state.check.delim_type = table.delim_type;
+    state.stats->delimiter_char = state.check.delim_char = table.delim_char;
+    state.stats->kernel = state.check.kernel = table.kernel;
+    state.stats->encoding = table.reader.encoding;
+
+    FILE* out = scan_state_begin(&state, filename, g_options.state);
+    if (!out) {
+        table_close(&table);
+        free(state.stats);
+        return;
+    }
+    state.check.record_file = out;
+
+    // 每个范围都先处理表头（得到列名和期望列数），行号相对于范围计算
+    field_t* fields = xmalloc(MAX_COLUMNS * sizeof(field_t));
+    char* line;
+    size_t len;
+    if (table.num_columns > 0) {
+        scan_consume_line(&state, NULL, table.header_line, table.header_len, fields);
+    }
+    while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+        scan_consume_line(&state, NULL, line, len, fields);
+    }
+    free(fields);
+    table_close(&table);
+
+    scan_state_finish(out, &state, g_options.state);
+    free(state.stats);
+}
+
+void merge_states(int count, char** paths) {
+    merge_input_t* inputs = xmalloc(count * sizeof(merge_input_t));
+    int loaded = 0;
+    for (int i = 0; i < count; i++) {
+        inputs[i].path = paths[i];
+        scan_state_init(&inputs[i].state, i == 0 ? -1 : inputs[0].state.is_check);
+        loaded++;
+        if (scan_state_load(&inputs[i].state, paths[i]) != 0) {
+            for (int j = 0; j < loaded; j++) free(inputs[j].state.stats);
+            free(inputs);
+            return;
+        }
+    }
+    qsort(inputs, count, sizeof(merge_input_t), merge_compare);
+
+    // 各范围应来自同一文件，且首尾相接覆盖整个文件
+    const scan_state_t* first = &inputs[0].state;
+    long long covered = 0;
+    int contiguous = 1;
+    for (int i = 0; i < count; i++) {
+        const scan_state_t* part = &inputs[i].state;
+        if (strcmp(part->file, first->file) != 0 || part->file_size != first->file_size) {
+            fprintf(stderr, "警告: 状态文件来自不同的文件: %s\n", inputs[i].path);
+        }
+        if (part->range_start != covered) contiguous = 0;
+        covered = part->range_end;
+    }
+    if (!contiguous || covered != first->file_size) {
+        fprintf(stderr, "警告: 状态文件的范围不连续，结果可能不完整\n");
+    }
+
+    if (!first->is_check) {
+        // 计数直接相加；列名和列数取自表头，各部分相同
+        file_stats_t* total = first->stats;
+        for (int i = 1; i < count; i++) {
+            const file_stats_t* part = inputs[i].state.stats;
+            total->total_rows += part->total_rows;
+            total->lines += part->total_rows;
+            for (int c = 0; c < total->total_columns && c < MAX_COLUMNS; c++) {
+                total->columns[c].empty_count += part->columns[c].empty_count;
+                total->columns[c].non_empty_count += part->columns[c].non_empty_count;
+                total->columns[c].numeric_count += part->columns[c].numeric_count;
+                total->columns[c].float_count += part->columns[c].float_count;
+                total->columns[c].text_count += part->columns[c].text_count;
+            }
+        }
+        total->file_size = (long)first->file_size;
+        print_file_stats(first->file, total);
+    } else {
+        // 按范围顺序重读各状态文件中的不一致行，相对行号加上之前各范围的数据行数
+        check_state_t total = first->check;
+        total.inconsistent_lines = 0;
+        json_writer_t json;
+        json_writer_t* out = NULL;
+        if (g_options.format != FORMAT_TEXT) {
+            out = &json;
+            check_begin_output(first->file, total.delim_type, out);
+        }
+        long long base = 0;
+        char* line = NULL;
+        size_t line_cap = 0;
+        for (int i = 0; i < count; i++) {
+            FILE* file = fopen(inputs[i].path, "r");
+            if (!file) {
+                fprintf(stderr, "无法打开文件: %s\n", inputs[i].path);
+                continue;
+            }
+            ssize_t n;
+            while ((n = getline(&line, &line_cap, file)) != -1) {
+                long long rel;
+                int columns, pos = 0;
+                if (strncmp(line, "bad ", 4) != 0 || sscanf(line + 4, "%lld %d%n", &rel, &columns, &pos) < 2) {
+                    continue;
+                }
+                // 内容与列数之间正好一个空格，内容本身的前导空白要保留
+                pos += 5;
+                if (n > 0 && line[n - 1] == '\n') line[--n] = '\0';
+                if (pos > n) pos = (int)n;
+                check_emit_inconsistent(out, base + rel, columns, total.expected_columns, line + pos, (size_t)(n - pos));
+            }
+            fclose(file);
+            const check_state_t* part = &inputs[i].state.check;
+            total.inconsistent_lines += part->inconsistent_lines;
+            if (part->lines > 0) base += part->lines - 1;
+        }
+        free(line);
+        total.lines = base + 1;
+        check_print_summary(first->file, &total, out);
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(inputs[i].state.stats);
+    }
+    free(inputs);
+}
+
+int merge_compare(const void* a, const void* b) {
+    const merge_input_t* x = (const merge_input_t*)a;
+    const merge_input_t* y = (const merge_input_t*)b;
+    if (x->state.range_start != y->state.range_start) {
+        return x->state.range_start < y->state.range_start ? -1 : 1;
+    }
+    return 0;
+}
+
+void show_column_headers(const char* filename) {
+    line_reader_t reader;
+    if (line_reader_open(&reader, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+
+    char delim[2] = { '\0', '\0' };
+    detect_delimiter(filename, &delim[0]);
+
+    size_t len;
+    char* line = line_reader_next(&reader, &len);
+    if (line) {
+        printf("列名和对应的列号:\n");
+        
+        char* token = strtok(line, delim);
+        int column_number = 1;
+        
+        while (token != NULL) {
+            printf("%d: %s\n", column_number, token);
+            token = strtok(NULL, delim);
+            column_number++;
+        }
+    }
+
+    line_reader_close(&reader);
+}
+
+void remove_duplicates(const char* filename) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    // 输出表头（范围不包含文件开头时省略）
+    if (table.include_header && table.num_columns > 0) {
+        fwrite(table.header_line, 1, table.header_len, stdout);
+        putchar('\n');
+    }
+
+    // 与 duplicates 共用整行哈希表，只保存哈希不保存内容；首次出现的行立即输出
+    dup_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    dup_table_t seen;
+    dup_table_init(&seen);
+    dup_record_t rec;
+    uint64_t line_number = 1;
+    char* line;
+    size_t len;
+    while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+        line_number++;
+        dup_hash_row(&ctx, line, len, &rec);
+        dup_slot_t* slot = dup_table_find(&seen, rec.hash, rec.check);
+        if (slot->first_line) {
+            continue;
+        }
+        slot->hash = rec.hash;
+        slot->check = rec.check;
+        slot->first_line = line_number;
+        slot->group = -1;
+        if (++seen.count * 10 > seen.slot_cap * 7) {
+            dup_table_grow(&seen);
+        }
+        fwrite(line, 1, len, stdout);
+        putchar('\n');
+    }
+
+    free(seen.slots);
+    table_close(&table);
+}
+
+void show_duplicates(const char* filename) {
+    if (g_options.fuzzy > 0) {
+        show_fuzzy_duplicates(filename);
+        return;
+    }
+
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        return;
+    }
+
+    dup_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.delim_char = table.delim_char;
+    ctx.multispace = table.multispace;
+    ctx.kernel = table.kernel;
+    if (g_options.by_columns) {
+        ctx.num_keys = table_parse_columns(&table, g_options.by_columns, ctx.key_cols, MAX_COLUMNS);
+        if (ctx.num_keys <= 0) {
+            g_exit_status = 1;
+            table_close(&table);
+            return;
+        }
+        for (int i = 0; i < ctx.num_keys; i++) {
+            if (ctx.key_cols[i] > ctx.max_col) ctx.max_col = ctx.key_cols[i];
+        }
+        ctx.fields = xmalloc((ctx.max_col + 1) * sizeof(field_t));
+    }
+    if (table_apply_window(&table) != 0) {
+        free(ctx.fields);
+        table_close(&table);
+        return;
+    }
+    if (table.first_row < 0) {
+        fprintf(stderr, "注意: 范围起点之前的行数未知，行号从范围起点开始计算\n");
+    }
+    // 转码输入的偏移不能在原文件中定位，第一遍顺带把转码后的行写入临时副本，偏移按副本计算
+    int transcoded = (table.reader.raw != NULL);
+    ctx.source = transcoded ? create_temp_file() : fopen(filename, "rb");
+    if (!ctx.source) {
+        fprintf(stderr, transcoded ? "错误: 无法创建临时文件\n" : "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        free(ctx.fields);
+        table_close(&table);
+        return;
+    }
+
+    int structured = (g_options.format != FORMAT_TEXT);
+    json_writer_t json;
+    if (structured) {
+        json_init(&json, stdout, g_options.format == FORMAT_NDJSON);
+        if (!json.ndjson) {
+            json_begin_object(&json, NULL);
+            json_cstring(&json, "file", filename);
+            json_cstring(&json, "delimiter", delimiter_keys[table.delim_type]);
+            json_string(&json, "header", table.header_line, table.header_len);
+            json_begin_array(&json, "groups");
+        }
+    } else {
+        printf("=== 重复行检测结果 ===\n");
+        printf("分隔符: ");
+        switch (table.delim_type) {
+            case DELIM_TAB: printf("TAB\n"); break;
+            case DELIM_COMMA: printf(",\n"); break;
+            case DELIM_SEMICOLON: printf(";\n"); break;
+            case DELIM_PIPE: printf("|\n"); break;
+            case DELIM_SPACE: printf("空格\n"); break;
+            case DELIM_MULTISPACE: printf("多空格\n"); break;
+            default: printf("未知\n"); break;
+        }
+        printf("\n");
+        printf("表头: %s\n\n", table.header_line);
+    }
+
+    // 第一遍：只记录每行的哈希和首次出现位置，超出内存预算后新出现的行溢出到分区文件
+    dup_table_t primary;
+    dup_table_init(&primary);
+    FILE* spill[DUP_PARTITIONS] = { NULL };
+    dup_record_t rec;
+    uint64_t line_count = 0;
+    uint64_t line_number = 1 + (table.first_row > 0 ? table.first_row : 0);
+    char* line;
+    size_t len;
+    long long offset = transcoded ? 0 : line_reader_tell(&table.reader);
+    while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+        line_number++;
+        line_count++;
+        if (transcoded) {
+            if (ctx.source_read) {
+                fseeko(ctx.source, 0, SEEK_END);
+                ctx.source_read = 0;
+            }
+            fwrite(line, 1, len, ctx.source);
+            fputc('\n', ctx.source);
+        }
+        dup_hash_row(&ctx, line, len, &rec);
+        rec.line = line_number;
+        rec.offset = offset;
+        dup_consume(&ctx, &primary, spill, 0, &rec, line, len);
+        offset = transcoded ? offset + (long long)len + 1 : line_reader_tell(&table.reader);
+    }
+    free(primary.slots);
+    for (int p = 0; p < DUP_PARTITIONS; p++) {
+        if (spill[p]) {
+            dup_process_spill(&ctx, spill[p], 1);
+        }
+    }
+    table_close(&table);
+    free(ctx.fields);
+    free(ctx.row);
+    free(ctx.key);
+    free(ctx.first_key);
+
+    // 第二遍：重复组按首次出现排序，按偏移回读首行内容后输出
+    qsort(ctx.groups, ctx.num_groups, sizeof(dup_group_t), dup_group_compare);
+    uint64_t total_duplicates = 0;
+    for (size_t g = 0; g < ctx.num_groups; g++) {
+        dup_group_t* group = &ctx.groups[g];
+        total_duplicates += group->count;
+        
+        size_t n;
+        char* content = dup_read_row(&ctx, group->first_offset, &ctx.first, &ctx.first_cap, &n);
+        
+        if (structured) {
+            // 每个重复组写出一条记录
+            json_begin_object(&json, NULL);
+            if (json.ndjson) {
+                json_cstring(&json, "type", "group");
+            }
+            json_int(&json, "group", (long long)g + 1);
+            json_int(&json, "count", (long long)group->count);
+            json_begin_array(&json, "lines");
+        } else {
+            printf("重复组 %zu (出现 %llu 次):\n", g + 1, (unsigned long long)group->count);
+            printf("行号: ");
+        }
+        
+        // 解码行号差值
+        uint64_t current = group->first_line;
+        size_t pos = 0;
+        for (uint64_t k = 0; k < group->count; k++) {
+            if (k > 0) {
+                uint64_t delta = 0;
+                int shift = 0;
+                unsigned char byte;
+                do {
+                    byte = group->deltas[pos++];
+                    delta |= (uint64_t)(byte & 0x7F) << shift;
+                    shift += 7;
+                } while (byte & 0x80);
+                current += delta;
+            }
+            if (structured) {
+                json_int(&json, NULL, (long long)current);
+            } else {
+                printf(k > 0 ? ",%llu" : "%llu", (unsigned long long)current);
+            }
+        }
+        
+        if (structured) {
+            json_end_array(&json);
+            json_string(&json, "content", content, n);
+            json_end_object(&json);
+        } else {
+            printf("\n内容: %s\n\n", content);
+        }
+        free(group->deltas);
+        free(group->key);
+    }
+    free(ctx.first);
+    fclose(ctx.source);
+    free(ctx.groups);
+
+    long long duplicate_groups = (long long)ctx.num_groups;
+    long long unique_lines = (long long)line_count - ((long long)total_duplicates - duplicate_groups);
+    double duplicate_rate = line_count > 0 ?
+        ((long long)total_duplicates - duplicate_groups) * 100.0 / line_count : 0.0;
+    if (structured) {
+        if (json.ndjson) {
+            json_begin_object(&json, NULL);
+            json_cstring(&json, "type", "summary");
+            json_cstring(&json, "file", filename);
+        } else {
+            json_end_array(&json);
+        }
+        json_int(&json, "rows", (long long)line_count);
+        json_int(&json, "duplicate_groups", duplicate_groups);
+        json_int(&json, "duplicate_rows", (long long)total_duplicates);
+        json_int(&json, "unique_rows", unique_lines);
+        json_double(&json, "duplicate_rate", duplicate_rate);
+        json_end_object(&json);
+        return;
+    }
+
+    if (duplicate_groups == 0) {
+        printf("没有发现重复行\n");
+    } else {
+        printf("总结: 共有 %lld 个重复组，涉及 %llu 行数据\n", duplicate_groups, (unsigned long long)total_duplicates);
+        printf("唯一行数: %lld\n", unique_lines);
+        printf("重复率: %.2f%%\n", duplicate_rate);
+    }
+}
+
+void dup_hash_row(dup_ctx_t* ctx, char* line, size_t len, dup_record_t* rec) {
+    if (ctx->num_keys == 0) {
+        rec->hash = hash_bytes(line, len, 0);
+        rec->check = hash_bytes(line, len, 0x5bd1e995);
+        return;
+    }
+    // 按键列判断：逐列链式哈希，列长度参与哈希，避免 "a,bc" 与 "ab,c" 相同
+    int count = ctx->kernel->split(line, len, ctx->fields, ctx->max_col + 1);
+    uint64_t hash = 0;
+    uint64_t check = 0x5bd1e995;
+    for (int i = 0; i < ctx->num_keys; i++) {
+        int col = ctx->key_cols[i];
+        const char* ptr = col < count ? ctx->fields[col].ptr : "";
+        size_t n = col < count ? ctx->fields[col].len : 0;
+        hash = hash_bytes(ptr, n, hash);
+        check = hash_bytes(ptr, n, check);
+    }
+    rec->hash = hash;
+    rec->check = check;
+}
+
+void dup_consume(dup_ctx_t* ctx, dup_table_t* table, FILE** spill, int level, const dup_record_t* rec,
+                 char* line, size_t len) {
+    dup_slot_t* slot = dup_table_find(table, rec->hash, rec->check);
+    while (slot->first_line && !dup_same_row(ctx, slot, rec, line, len)) {
+        // 哈希相同但内容不同：继续探测
+        slot = dup_table_next(table, slot, rec->hash, rec->check);
+    }
+    if (slot->first_line) {
+        dup_group_t* group = &ctx->groups[slot->group];
+        size_t before = group->deltas_cap;
+        dup_group_add(group, rec->line);
+        ctx->group_memory += group->deltas_cap - before;
+        return;
+    }
+    
+    // 扩容时新旧槽位数组同时存在，约为当前槽位内存的3倍
+    int need_grow = (table->count + 1) * 10 > table->slot_cap * 7;
+    size_t grow_memory = table->slot_cap * 3 * sizeof(dup_slot_t) + ctx->group_memory;
+    if (spill && need_grow && grow_memory > g_options.mem_budget) {
+        // 扩容会超出内存预算：之后首次出现的行按哈希高位写入溢出分区
+        int part = (int)((rec->hash >> (60 - 4 * level)) & (DUP_PARTITIONS - 1));
+        if (!spill[part]) {
+            spill[part] = create_temp_file();
+            if (!spill[part]) {
+                fprintf(stderr, "错误: 无法创建临时文件\n");
+                exit(1);
+            }
+        }
+        fwrite(rec, sizeof(dup_record_t), 1, spill[part]);
+        return;
+    }
+    if (need_grow) {
+        dup_table_grow(table);
+        slot = dup_table_find(table, rec->hash, rec->check);
+        while (slot->first_line) {
+            slot = dup_table_next(table, slot, rec->hash, rec->check);
+        }
+    }
+    slot->hash = rec->hash;
+    slot->check = rec->check;
+    slot->first_line = rec->line;
+    slot->first_offset = rec->offset;
+    slot->group = -1;
+    table->count++;
+}
+
+int dup_same_row(dup_ctx_t* ctx, dup_slot_t* slot, const dup_record_t* rec, char* line, size_t len) {
+    // 溢出分区中的记录不带内容，按偏移回读
+    if (!line) {
+        line = dup_read_row(ctx, rec->offset, &ctx->row, &ctx->row_cap, &len);
+    }
+    size_t key_len;
+    const char* key = dup_row_key(ctx, line, len, &ctx->key, &ctx->key_cap, &key_len);
+    if (slot->group >= 0) {
+        const dup_group_t* group = &ctx->groups[slot->group];
+        return group->key_len == key_len && memcmp(group->key, key, key_len) == 0;
+    }
+
+    // 第二次出现：回读首次出现的行比较，相同时才建立重复组，并保存比较内容供之后的行使用
+    size_t first_len;
+    char* first = dup_read_row(ctx, slot->first_offset, &ctx->first, &ctx->first_cap, &first_len);
+    size_t first_key_len;
+    const char* first_key = dup_row_key(ctx, first, first_len, &ctx->first_key, &ctx->first_key_cap, &first_key_len);
+    if (first_key_len != key_len || memcmp(first_key, key, key_len) != 0) {
+        return 0;
+    }
+    if (ctx->num_groups == ctx->group_cap) {
+        ctx->group_cap = ctx->group_cap ? ctx->group_cap * 2 : 256;
+        ctx->groups = xrealloc(ctx->groups, ctx->group_cap * sizeof(dup_group_t));
+    }
+    dup_group_t* group = &ctx->groups[ctx->num_groups];
+    memset(group, 0, sizeof(dup_group_t));
+    group->first_line = slot->first_line;
+    group->first_offset = slot->first_offset;
+    group->last_line = slot->first_line;
+    group->count = 1;
+    group->key = xmalloc(key_len + 1);
+    memcpy(group->key, key, key_len);
+    group->key_len = key_len;
+    slot->group = (int64_t)ctx->num_groups++;
+    ctx->group_memory += sizeof(dup_group_t) + key_len + 1;
+    return 1;
+}
+
+const char* dup_row_key(dup_ctx_t* ctx, char* line, size_t len, char** buf, size_t* cap, size_t* key_len) {
+    // 按整行判断时比较行本身，按键列判断时比较以\x1f连接的键列
+    if (ctx->num_keys == 0) {
+        *key_len = len;
+        return line;
+    }
+    int count = ctx->kernel->split(line, len, ctx->fields, ctx->max_col + 1);
+    size_t n = 0;
+    for (int i = 0; i < ctx->num_keys; i++) {
+        int col = ctx->key_cols[i];
+        size_t field_len = col < count ? ctx->fields[col].len : 0;
+        if (n + field_len + 1 > *cap) {
+            *cap = (n + field_len + 1) * 2;
+            *buf = xrealloc(*buf, *cap);
+        }
+        if (i > 0) (*buf)[n++] = '\x1f';
+        if (field_len > 0) memcpy(*buf + n, ctx->fields[col].ptr, field_len);
+        n += field_len;
+    }
+    *key_len = n;
+    return *buf;
+}
+
+char* dup_read_row(dup_ctx_t* ctx, long long offset, char** buf, size_t* cap, size_t* len) {
+    // 回读一行，去掉行尾的换行符；读不到时文件已被改动，无法继续
+    ssize_t n = -1;
+    ctx->source_read = 1;
+    if (fseeko(ctx->source, offset, SEEK_SET) == 0) {
+        n = getline(buf, cap, ctx->source);
+    }
+    if (n < 0) {
+        fprintf(stderr, "错误: 无法回读偏移 %lld 处的行，文件可能在处理中被修改\n", offset);
+        exit(1);
+    }
+    while (n > 0 && ((*buf)[n - 1] == '\n' || (*buf)[n - 1] == '\r')) n--;
+    (*buf)[n] = '\0';
+    *len = (size_t)n;
+    return *buf;
+}
+
+void dup_process_spill(dup_ctx_t* ctx, FILE* file, int level) {
+    dup_table_t table;
+    dup_table_init(&table);
+    FILE* sub_spill[DUP_PARTITIONS] = { NULL };
+    FILE** spill = (level < DUP_MAX_LEVEL) ? sub_spill : NULL;
+    
+    // 分区文件中的记录保持原文件顺序，行号仍然递增
+    dup_record_t records[1024];
+    size_t n;
+    rewind(file);
+    while ((n = fread(records, sizeof(dup_record_t), 1024, file)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            dup_consume(ctx, &table, spill, level, &records[i], NULL, 0);
+        }
+    }
+    fclose(file);
+    free(table.slots);
+    
+    for (int p = 0; p < DUP_PARTITIONS; p++) {
+        if (sub_spill[p]) {
+            dup_process_spill(ctx, sub_spill[p], level + 1);
+        }
+    }
+}
+
+void dup_table_init(dup_table_t* table) {
+    table->slot_cap = 1024;
+    table->count = 0;
+    table->slots = xmalloc(table->slot_cap * sizeof(dup_slot_t));
+    memset(table->slots, 0, table->slot_cap * sizeof(dup_slot_t));
+}
+
+dup_slot_t* dup_table_find(const dup_table_t* table, uint64_t hash, uint64_t check) {
+    // 线性探测，返回匹配的槽位或第一个空槽
+    size_t mask = table->slot_cap - 1;
+    size_t i = (size_t)hash & mask;
+    for (;;) {
+        dup_slot_t* slot = &table->slots[i];
+        if (!slot->first_line || (slot->hash == hash && slot->check == check)) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+dup_slot_t* dup_table_next(const dup_table_t* table, const dup_slot_t* slot, uint64_t hash, uint64_t check) {
+    // 从 slot 的下一个位置继续探测
+    size_t mask = table->slot_cap - 1;
+    size_t i = ((size_t)(slot - table->slots) + 1) & mask;
+    for (;;) {
+        dup_slot_t* next = &table->slots[i];
+        if (!next->first_line || (next->hash == hash && next->check == check)) {
+            return next;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+void dup_table_grow(dup_table_t* table) {
+    dup_table_t bigger;
+    bigger.slot_cap = table->slot_cap * 2;
+    bigger.count = table->count;
+    bigger.slots = xmalloc(bigger.slot_cap * sizeof(dup_slot_t));
+    memset(bigger.slots, 0, bigger.slot_cap * sizeof(dup_slot_t));
+    // 表中的行内容各不相同（哈希相同的也是），直接放入第一个空槽
+    size_t mask = bigger.slot_cap - 1;
+    for (size_t i = 0; i < table->slot_cap; i++) {
+        if (table->slots[i].first_line) {
+            size_t j = (size_t)table->slots[i].hash & mask;
+            while (bigger.slots[j].first_line) j = (j + 1) & mask;
+            bigger.slots[j] = table->slots[i];
+        }
+    }
+    free(table->slots);
+    *table = bigger;
+}
+
+void dup_group_add(dup_group_t* group, uint64_t line) {
+    if (group->deltas_cap - group->deltas_len < 10) {
+        // 倍增扩容，旧缓冲区随即释放，计入内存预算的就是当前容量
+        group->deltas_cap = group->deltas_cap ? group->deltas_cap * 2 : 16;
+        group->deltas = xrealloc(group->deltas, group->deltas_cap);
+    }
+    // 每字节存7位，最高位表示后面还有字节
+    uint64_t delta = line - group->last_line;
+    while (delta >= 0x80) {
+        group->deltas[group->deltas_len++] = (unsigned char)((delta & 0x7F) | 0x80);
+        delta >>= 7;
+    }
+    group->deltas[group->deltas_len++] = (unsigned char)delta;
+    group->last_line = line;
+    group->count++;
+}
+
+int dup_group_compare(const void* a, const void* b) {
+    const dup_group_t* ga = a;
+    const dup_group_t* gb = b;
+    if (ga->first_line != gb->first_line) {
+        return ga->first_line < gb->first_line ? -1 : 1;
+    }
+    return 0;
+}
+
+void show_fuzzy_duplicates(const char* filename) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        g_exit_status = 1;
+        return;
+    }
+
+    fuzzy_plan_t* plan = xmalloc(sizeof(fuzzy_plan_t));
+    memset(plan, 0, sizeof(fuzzy_plan_t));
+    plan->kernel = table.kernel;
+    plan->threshold = g_options.fuzzy;
+    plan->normalize = fuzzy_parse_normalize(g_options.normalize);
+    if (plan->normalize < 0) {
+        g_exit_status = 1;
+        free(plan);
+        table_close(&table);
+        return;
+    }
+
+    // 参与比较的列：--by 指定的列，否则为全部列；再去掉 --ignore 的列
+    int ignored[MAX_COLUMNS];
+    int num_ignored = 0;
+    if (g_options.by_columns) {
+        plan->num_cols = table_parse_columns(&table, g_options.by_columns, plan->cols, MAX_COLUMNS);
+    } else {
+        for (int c = 0; c < table.num_columns && c < MAX_COLUMNS; c++) {
+            plan->cols[plan->num_cols++] = c;
+        }
+    }
+    if (plan->num_cols > 0 && g_options.ignore_columns) {
+        num_ignored = table_parse_columns(&table, g_options.ignore_columns, ignored, MAX_COLUMNS);
+        if (num_ignored < 0) {
+            plan->num_cols = -1;
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < plan->num_cols; i++) {
+        int skip = 0;
+        for (int k = 0; k < num_ignored; k++) {
+            if (ignored[k] == plan->cols[i]) skip = 1;
+        }
+        if (!skip) {
+            plan->cols[kept++] = plan->cols[i];
+            if (plan->cols[i] > plan->max_col) plan->max_col = plan->cols[i];
+        }
+    }
+    if (plan->num_cols >= 0 && kept == 0) {
+        fprintf(stderr, "错误: 去掉 --ignore 的列后没有可比较的列\n");
+    }
+    plan->num_cols = plan->num_cols < 0 ? -1 : kept;
+    if (plan->num_cols <= 0 || table_apply_window(&table) != 0) {
+        g_exit_status = 1;
+        free(plan);
+        table_close(&table);
+        return;
+    }
+    if (table.first_row < 0) {
+        fprintf(stderr, "注意: 范围起点之前的行数未知，行号从范围起点开始计算\n");
+    }
+    fuzzy_choose_bands(plan);
+
+    // 每个位置的探查顺序是固定的随机排列，与行内容无关，同一文件每次运行结果相同
+    uint64_t state = 0x6a09e667f3bcc908ULL;
+    for (int i = 0; i < FUZZY_SIG_SIZE; i++) {
+        for (int k = 0; k < FUZZY_SIG_SIZE; k++) {
+            plan->probe[i][k] = (unsigned char)k;
+        }
+        for (int k = FUZZY_SIG_SIZE - 1; k > 0; k--) {
+            int swap = (int)(splitmix64_next(&state) % (uint64_t)(k + 1));
+            unsigned char tmp = plan->probe[i][k];
+            plan->probe[i][k] = plan->probe[i][swap];
+            plan->probe[i][swap] = tmp;
+        }
+    }
+
+    long long data_start = table.data_start;
+    long long data_end = table.data_end;
+    // 分区数按数据量估算（假设每行至少32字节），使每个分区的分桶记录能放进一半内存预算
+    long long data_size = data_end >= 0 ? data_end - data_start : get_file_size(filename);
+    double estimate = (double)data_size / 32 * plan->bands * sizeof(fuzzy_band_t);
+    while (plan->part_bits < 8 && estimate / (1 << plan->part_bits) > (double)g_options.mem_budget / 2) {
+        plan->part_bits++;
+    }
+    pthread_mutex_init(&plan->parts_lock, NULL);
+
+    int structured = (g_options.format != FORMAT_TEXT);
+    json_writer_t json;
+    if (structured) {
+        json_init(&json, stdout, g_options.format == FORMAT_NDJSON);
+        if (!json.ndjson) {
+            json_begin_object(&json, NULL);
+            json_cstring(&json, "file", filename);
+            json_cstring(&json, "delimiter", delimiter_keys[table.delim_type]);
+            json_string(&json, "header", table.header_line, table.header_len);
+            json_double(&json, "threshold", plan->threshold);
+            json_begin_array(&json, "groups");
+        }
+    } else {
+        printf("=== 近似重复行检测结果 ===\n");
+        printf("分隔符: ");
+        switch (table.delim_type) {
+            case DELIM_TAB: printf("TAB\n"); break;
+            case DELIM_COMMA: printf(",\n"); break;
+            case DELIM_SEMICOLON: printf(";\n"); break;
+            case DELIM_PIPE: printf("|\n"); break;
+            case DELIM_SPACE: printf("空格\n"); break;
+            case DELIM_MULTISPACE: printf("多空格\n"); break;
+            default: printf("未知\n"); break;
+        }
+        printf("\n");
+        printf("表头: %s\n", table.header_line);
+        printf("比较列: ");
+        for (int i = 0; i < plan->num_cols; i++) {
+            printf(i > 0 ? ",%s" : "%s", table.names[plan->cols[i]]);
+        }
+        printf("\n规范化: %s%s%s\n", (plan->normalize & FUZZY_TRIM) ? "去除多余空白 " : "",
+               (plan->normalize & FUZZY_CASE) ? "忽略大小写" : "", plan->normalize ? "" : "无");
+        printf("相似度阈值: %.2f (MinHash 签名 %d 个值，分 %d 段，每段 %d 个)\n\n", plan->threshold, FUZZY_SIG_SIZE,
+               plan->bands, plan->band_rows);
+    }
+    uint64_t line_base = 2 + (table.first_row > 0 ? table.first_row : 0);
+    table_close(&table);
+
+    // 第一阶段：各线程计算每行的签名，签名写入各自的临时文件，分桶记录写入共享的分区文件
+    int threads = data_end >= 0 ? choose_thread_count(data_end - data_start) : 1;
+    int num_parts = 1 << plan->part_bits;
+    fuzzy_worker_t* workers = xmalloc(threads * sizeof(fuzzy_worker_t));
+    long long chunk = (data_end - data_start) / threads;
+    for (int t = 0; t < threads; t++) {
+        memset(&workers[t], 0, sizeof(fuzzy_worker_t));
+        workers[t].plan = plan;
+        workers[t].filename = filename;
+        workers[t].id = t;
+        workers[t].start = data_start + chunk * t;
+        workers[t].end = (t == threads - 1) ? data_end : data_start + chunk * (t + 1);
+        workers[t].sigs = create_temp_file();
+        if (!workers[t].sigs) {
+            fprintf(stderr, "错误: 无法创建临时文件\n");
+            exit(1);
+        }
+        workers[t].buffers = xmalloc((size_t)num_parts * FUZZY_BUFFER_RECORDS * sizeof(fuzzy_band_t));
+        workers[t].buffered = xmalloc(num_parts * sizeof(int));
+        memset(workers[t].buffered, 0, num_parts * sizeof(int));
+    }
+    run_workers(fuzzy_worker_main, workers, sizeof(fuzzy_worker_t), threads);
+
+    uint64_t total_rows = 0;
+    int failed = 0;
+    for (int t = 0; t < threads; t++) {
+        failed |= workers[t].failed;
+        workers[t].first_row = total_rows;
+        total_rows += workers[t].rows;
+        free(workers[t].buffers);
+        free(workers[t].buffered);
+        fflush(workers[t].sigs);
+        workers[t].sig_map_len = workers[t].rows * FUZZY_SIG_SIZE * sizeof(uint32_t);
+        if (workers[t].sig_map_len > 0) {
+            void* map = mmap(NULL, workers[t].sig_map_len, PROT_READ, MAP_PRIVATE, fileno(workers[t].sigs), 0);
+            if (map == MAP_FAILED) {
+                failed = 1;
+                workers[t].sig_map_len = 0;
+            } else {
+                workers[t].sig_map = map;
+            }
+        }
+    }
+    if (failed || total_rows > UINT32_MAX) {
+        if (failed) {
+            fprintf(stderr, "错误: 读取文件或写入临时文件失败: %s\n", filename);
+        } else {
+            fprintf(stderr, "错误: --fuzzy 最多支持 %u 个数据行\n", UINT32_MAX);
+        }
+        g_exit_status = 1;
+        total_rows = 0;
+    }
+
+    // 第二阶段：逐个分区按哈希排序，同一桶内的行比较完整签名，相似的行用并查集合并成组
+    uint32_t* parent = xmalloc((total_rows ? total_rows : 1) * sizeof(uint32_t));
+    for (uint64_t i = 0; i < total_rows; i++) {
+        parent[i] = (uint32_t)i;
+    }
+    for (int p = 0; p < num_parts; p++) {
+        if (plan->parts[p]) {
+            if (total_rows > 0) {
+                fuzzy_process_part(plan, workers, threads, plan->parts[p], parent);
+            }
+            fclose(plan->parts[p]);
+        }
+    }
+
+    // 每组以最早出现的行为根，成员按 (根, 行号) 排序即为按首次出现排列的各组
+    fuzzy_member_t* members = NULL;
+    size_t num_members = 0;
+    size_t member_cap = 0;
+    for (uint64_t i = 0; i < total_rows; i++) {
+        uint32_t root = fuzzy_find(parent, (uint32_t)i);
+        if (root == i) {
+            continue;
+        }
+        if (num_members == member_cap) {
+            member_cap = member_cap ? member_cap * 2 : 256;
+            members = xrealloc(members, member_cap * sizeof(fuzzy_member_t));
+        }
+        members[num_members].root = root;
+        members[num_members].row = (uint32_t)i;
+        num_members++;
+    }
+    free(parent);
+    qsort(members, num_members, sizeof(fuzzy_member_t), fuzzy_member_compare);
+
+    // 组内各行的内容：按行序顺序读一遍，需要的行写入临时文件，输出时按位置回读
+    size_t num_needed = 0;
+    uint32_t* needed = xmalloc((num_members * 2 + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < num_members; i++) {
+        needed[num_needed++] = members[i].root;
+        needed[num_needed++] = members[i].row;
+    }
+    qsort(needed, num_needed, sizeof(uint32_t), fuzzy_row_compare);
+    size_t unique = 0;
+    for (size_t i = 0; i < num_needed; i++) {
+        if (unique == 0 || needed[unique - 1] != needed[i]) needed[unique++] = needed[i];
+    }
+    num_needed = unique;
+    long long* content_pos = xmalloc((num_needed + 1) * sizeof(long long));
+    FILE* contents = NULL;
+    line_reader_t reader;
+    if (num_needed > 0 && line_reader_open_range(&reader, filename, data_start, data_end) == 0) {
+        contents = create_temp_file();
+        if (!contents) {
+            fprintf(stderr, "错误: 无法创建临时文件\n");
+            exit(1);
+        }
+        char* line;
+        size_t len;
+        uint64_t row = 0;
+        size_t next = 0;
+        long long pos = 0;
+        while (next < num_needed && (line = line_reader_next(&reader, &len)) != NULL) {
+            if (row++ != needed[next]) {
+                continue;
+            }
+            while (len > 0 && line[len - 1] == '\r') len--;
+            content_pos[next++] = pos;
+            fwrite(line, 1, len, contents);
+            pos += len;
+        }
+        while (next <= num_needed) {
+            content_pos[next++] = pos;
+        }
+        line_reader_close(&reader);
+    }
+
+    char* content = NULL;
+    size_t content_cap = 0;
+    size_t num_groups = 0;
+    for (size_t i = 0; i < num_members;) {
+        size_t j = i;
+        while (j < num_members && members[j].root == members[i].root) j++;
+        num_groups++;
+        uint32_t root = members[i].root;
+        const uint32_t* root_sig = fuzzy_row_signature(workers, threads, root);
+        if (structured) {
+            json_begin_object(&json, NULL);
+            if (json.ndjson) {
+                json_cstring(&json, "type", "group");
+            }
+            json_int(&json, "group", (long long)num_groups);
+            json_int(&json, "count", (long long)(j - i + 1));
+            json_begin_array(&json, "rows");
+        } else {
+            printf("近似重复组 %zu (%zu 行):\n", num_groups, j - i + 1);
+        }
+        for (size_t k = i; k <= j; k++) {
+            uint32_t row = (k == i) ? root : members[k - 1].row;
+            double similarity = (row == root) ? 1.0 : fuzzy_similarity(root_sig, fuzzy_row_signature(workers, threads, row));
+            size_t n = 0;
+            uint32_t* found = bsearch(&row, needed, num_needed, sizeof(uint32_t), fuzzy_row_compare);
+            if (contents && found) {
+                size_t index = (size_t)(found - needed);
+                n = (size_t)(content_pos[index + 1] - content_pos[index]);
+                if (content_cap < n + 1) content = xrealloc(content, content_cap = n + 1);
+                if (fseeko(contents, content_pos[index], SEEK_SET) != 0 || fread(content, 1, n, contents) != n) n = 0;
+            }
+            if (content_cap < 1) content = xrealloc(content, content_cap = 1);
+            content[n] = '\0';
+            if (structured) {
+                json_begin_object(&json, NULL);
+                json_int(&json, "line", (long long)(line_base + row));
+                json_double(&json, "similarity", similarity);
+                json_string(&json, "content", content, n);
+                json_end_object(&json);
+            } else if (row == root) {
+                printf("  行 %llu [基准]: %s\n", (unsigned long long)(line_base + row), content);
+            } else {
+                printf("  行 %llu [%.2f]: %s\n", (unsigned long long)(line_base + row), similarity, content);
+            }
+        }
+        if (structured) {
+            json_end_array(&json);
+            json_end_object(&json);
+        } else {
+            printf("\n");
+        }
+        i = j;
+    }
+    free(content);
+    if (contents) fclose(contents);
+    free(content_pos);
+    free(needed);
+    free(members);
+    for (int t = 0; t < threads; t++) {
+        if (workers[t].sig_map) munmap((void*)workers[t].sig_map, workers[t].sig_map_len);
+        fclose(workers[t].sigs);
+    }
+    free(workers);
+    pthread_mutex_destroy(&plan->parts_lock);
+
+    long long grouped_rows = (long long)(num_members + num_groups);
+    if (structured) {
+        if (json.ndjson) {
+            json_begin_object(&json, NULL);
+            json_cstring(&json, "type", "summary");
+            json_cstring(&json, "file", filename);
+            json_double(&json, "threshold", plan->threshold);
+        } else {
+            json_end_array(&json);
+        }
+        json_int(&json, "rows", (long long)total_rows);
+        json_int(&json, "near_duplicate_groups", (long long)num_groups);
+        json_int(&json, "near_duplicate_rows", grouped_rows);
+        json_end_object(&json);
+    } else if (num_groups == 0) {
+        printf("没有发现近似重复行\n");
+    } else {
+        printf("总结: 共有 %zu 个近似重复组，涉及 %lld 行数据（共 %llu 行）\n", num_groups, grouped_rows,
+               (unsigned long long)total_rows);
+    }
+    free(plan);
+}
+
+int fuzzy_parse_normalize(const char* spec) {
+    if (!spec) {
+        return FUZZY_TRIM | FUZZY_CASE;
+    }
+    char* spec_copy = arena_strndup(&g_run_arena, spec, strlen(spec));
+    int normalize = 0;
+    char* token = strtok(spec_copy, ",");
+    while (token != NULL) {
+        trim_whitespace(token);
+        if (strcmp(token, "trim") == 0) {
+            normalize |= FUZZY_TRIM;
+        } else if (strcmp(token, "case") == 0) {
+            normalize |= FUZZY_CASE;
+        } else if (strcmp(token, "none") != 0) {
+            fprintf(stderr, "错误: 不支持的规范化方式: %s (可用: trim,case,none)\n", token);
+            return -1;
+        }
+        token = strtok(NULL, ",");
+    }
+    return normalize;
+}
+
+void fuzzy_choose_bands(fuzzy_plan_t* plan) {
+    // 相似度为 s 的两行成为候选的概率为 1-(1-s^r)^b。取满足相似度恰为阈值时
+    // 概率不低于99%的最大段长 r，段越长，不相似的行落入同一个桶的机会越少
+    plan->band_rows = 1;
+    plan->bands = FUZZY_SIG_SIZE;
+    for (int r = 16; r > 1; r--) {
+        int b = FUZZY_SIG_SIZE / r;
+        double hit = 1;
+        for (int i = 0; i < r; i++) hit *= plan->threshold;
+        double miss = 1;
+        for (int i = 0; i < b; i++) miss *= 1 - hit;
+        if (miss <= 0.01) {
+            plan->band_rows = r;
+            plan->bands = b;
+            break;
+        }
+    }
+}
+
+void* fuzzy_worker_main(void* arg) {
+    fuzzy_worker_t* worker = arg;
+    const fuzzy_plan_t* plan = worker->plan;
+
+    line_reader_t reader;
+    if (line_reader_open_range(&reader, worker->filename, worker->start, worker->end) != 0) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    field_t* fields = xmalloc((plan->max_col + 1) * sizeof(field_t));
+    size_t cap = 256;
+    char* text = xmalloc(cap);
+    uint32_t sig[FUZZY_SIG_SIZE];
+    char* line;
+    size_t len;
+    while ((line = line_reader_next(&reader, &len)) != NULL) {
+        // 规范化后为空的行也写签名以保持行序，但不参与分桶
+        size_t n = fuzzy_normalize_row(plan, fields, line, len, &text, &cap);
+        fuzzy_signature(plan, text, n, sig);
+        fwrite(sig, sizeof(uint32_t), FUZZY_SIG_SIZE, worker->sigs);
+        if (n > 0) {
+            fuzzy_emit_bands(worker, sig, (uint64_t)worker->id << 40 | worker->rows);
+        }
+        worker->rows++;
+    }
+    for (int p = 0; p < (1 << plan->part_bits); p++) {
+        fuzzy_flush_part(worker, p);
+    }
+    if (ferror(worker->sigs)) {
+        worker->failed = 1;
+    }
+
+    free(fields);
+    free(text);
+    line_reader_close(&reader);
+    return NULL;
+}
+
+size_t fuzzy_normalize_row(const fuzzy_plan_t* plan, field_t* fields, char* line, size_t len, char** text, size_t* cap) {
+    // 比较列之间用\x1f分隔；trim 去掉字段首尾空白并把连续空白合并为一个空格，case 把ASCII字母转为小写
+    int count = plan->kernel->split(line, len, fields, plan->max_col + 1);
+    size_t out = 0;
+    for (int i = 0; i < plan->num_cols; i++) {
+        int col = plan->cols[i];
+        const char* p = col < count ? fields[col].ptr : "";
+        size_t n = col < count ? fields[col].len : 0;
+        if (out + n + 1 > *cap) {
+            while (out + n + 1 > *cap) *cap *= 2;
+            *text = xrealloc(*text, *cap);
+        }
+        char* buf = *text;
+        if (i > 0) {
+            buf[out++] = '\x1f';
+        }
+        if (plan->normalize & FUZZY_TRIM) {
+            while (n > 0 && isspace((unsigned char)*p)) {
+                p++;
+                n--;
+            }
+            while (n > 0 && isspace((unsigned char)p[n - 1])) n--;
+        }
+        int space = 0;
+        for (size_t k = 0; k < n; k++) {
+            unsigned char c = (unsigned char)p[k];
+            if ((plan->normalize & FUZZY_TRIM) && isspace(c)) {
+                space = 1;
+                continue;
+            }
+            if (space) {
+                buf[out++] = ' ';
+                space = 0;
+            }
+            if ((plan->normalize & FUZZY_CASE) && c >= 'A' && c <= 'Z') {
+                c = (unsigned char)(c - 'A' + 'a');
+            }
+            buf[out++] = (char)c;
+        }
+    }
+    // 所有比较列都为空时视为空行
+    if (out == (size_t)(plan->num_cols - 1)) {
+        return 0;
+    }
+    return out;
+}
+
+void fuzzy_signature(const fuzzy_plan_t* plan, const char* text, size_t len, uint32_t* sig) {
+    // 行文本取所有连续 FUZZY_SHINGLE 字节作为特征。每个特征只哈希一次：哈希最高6位选择
+    // 签名的64个位置之一，该位置保留最小值；没有特征落入的位置按与行无关的固定探查顺序
+    // 借用第一个有值的位置（densification），使两行签名相同位置相等的概率仍为 Jaccard 相似度
+    for (int i = 0; i < FUZZY_SIG_SIZE; i++) {
+        sig[i] = UINT32_MAX;
+    }
+    if (len == 0) {
+        return;
+    }
+    PROF_SAMPLE_BEGIN(hash_start, PROF_HASH);
+    uint64_t filled = 0;
+    size_t width = len < FUZZY_SHINGLE ? len : FUZZY_SHINGLE;
+    for (size_t s = 0; s + width <= len; s++) {
+        uint64_t value = 0;
+        memcpy(&value, text + s, width);
+        uint64_t h = splitmix64_next(&value);
+        int bin = (int)(h >> 58);
+        if ((uint32_t)h < sig[bin]) sig[bin] = (uint32_t)h;
+        filled |= (uint64_t)1 << bin;
+    }
+    for (int i = 0; filled != UINT64_MAX && i < FUZZY_SIG_SIZE; i++) {
+        if (filled >> i & 1) {
+            continue;
+        }
+        const unsigned char* probe = plan->probe[i];
+        while (!(filled >> *probe & 1)) probe++;
+        sig[i] = sig[*probe];
+    }
+    PROF_SAMPLE_END(hash_start, PROF_HASH, len);
+}
+
+void fuzzy_emit_bands(fuzzy_worker_t* worker, const uint32_t* sig, uint64_t row) {
+    const fuzzy_plan_t* plan = worker->plan;
+    for (int b = 0; b < plan->bands; b++) {
+        uint64_t key = hash_bytes(sig + b * plan->band_rows, plan->band_rows * sizeof(uint32_t), (uint64_t)b);
+        int part = plan->part_bits ? (int)(key >> (64 - plan->part_bits)) : 0;
+        fuzzy_band_t* rec = &worker->buffers[(size_t)part * FUZZY_BUFFER_RECORDS + worker->buffered[part]++];
+        rec->key = key;
+        rec->row = row;
+        if (worker->buffered[part] == FUZZY_BUFFER_RECORDS) {
+            fuzzy_flush_part(worker, part);
+        }
+    }
+}
+
+void fuzzy_flush_part(fuzzy_worker_t* worker, int part) {
+    if (worker->buffered[part] == 0) {
+        return;
+    }
+    fuzzy_plan_t* plan = worker->plan;
+    pthread_mutex_lock(&plan->parts_lock);
+    if (!plan->parts[part]) {
+        plan->parts[part] = create_temp_file();
+        if (!plan->parts[part]) {
+            fprintf(stderr, "错误: 无法创建临时文件\n");
+            exit(1);
+        }
+    }
+    if (fwrite(&worker->buffers[(size_t)part * FUZZY_BUFFER_RECORDS], sizeof(fuzzy_band_t), worker->buffered[part],
+               plan->parts[part]) != (size_t)worker->buffered[part]) {
+        worker->failed = 1;
+    }
+    pthread_mutex_unlock(&plan->parts_lock);
+    worker->buffered[part] = 0;
+}
+
+const uint32_t* fuzzy_row_signature(const fuzzy_worker_t* workers, int threads, uint32_t row) {
+    int t = threads - 1;
+    while (t > 0 && workers[t].first_row > row) t--;
+    return workers[t].sig_map + (size_t)(row - workers[t].first_row) * FUZZY_SIG_SIZE;
+}
+
+double fuzzy_similarity(const uint32_t* a, const uint32_t* b) {
+    // 两个签名相同位置取值相同的比例是 Jaccard 相似度的无偏估计
+    int same = 0;
+    for (int i = 0; i < FUZZY_SIG_SIZE; i++) {
+        same += (a[i] == b[i]);
+    }
+    return (double)same / FUZZY_SIG_SIZE;
+}
+
+void fuzzy_process_part(const fuzzy_plan_t* plan, const fuzzy_worker_t* workers, int threads, FILE* part,
+                        uint32_t* parent) {
+    if (fseeko(part, 0, SEEK_END) != 0) {
+        return;
+    }
+    size_t count = (size_t)ftello(part) / sizeof(fuzzy_band_t);
+    fuzzy_band_t* recs = xmalloc((count ? count : 1) * sizeof(fuzzy_band_t));
+    rewind(part);
+    count = fread(recs, sizeof(fuzzy_band_t), count, part);
+    // 行号换成全局序号后排序，桶内的行按出现顺序排列
+    for (size_t i = 0; i < count; i++) {
+        const fuzzy_worker_t* worker = &workers[recs[i].row >> 40];
+        recs[i].row = worker->first_row + (recs[i].row & (((uint64_t)1 << 40) - 1));
+    }
+    fuzzy_sort_bands(recs, count);
+
+    // 桶内每行先与桶内第一行比较，不够相似时再与前一行比较，比较次数与桶大小成正比
+    for (size_t i = 0; i < count;) {
+        size_t j = i + 1;
+        while (j < count && recs[j].key == recs[i].key) j++;
+        const uint32_t* first = fuzzy_row_signature(workers, threads, (uint32_t)recs[i].row);
+        for (size_t k = i + 1; k < j; k++) {
+            uint32_t row = (uint32_t)recs[k].row;
+            if (fuzzy_find(parent, row) == fuzzy_find(parent, (uint32_t)recs[i].row)) {
+                continue;
+            }
+            const uint32_t* sig = fuzzy_row_signature(workers, threads, row);
+            if (fuzzy_similarity(first, sig) >= plan->threshold) {
+                fuzzy_union(parent, (uint32_t)recs[i].row, row);
+            } else if (k > i + 1 && fuzzy_find(parent, row) != fuzzy_find(parent, (uint32_t)recs[k - 1].row) &&
+                       fuzzy_similarity(fuzzy_row_signature(workers, threads, (uint32_t)recs[k - 1].row), sig) >=
+                           plan->threshold) {
+                fuzzy_union(parent, (uint32_t)recs[k - 1].row, row);
+            }
+        }
+        i = j;
+    }
+    free(recs);
+}
+
+uint32_t fuzzy_find(uint32_t* parent, uint32_t x) {
+    // 路径减半
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+void fuzzy_union(uint32_t* parent, uint32_t a, uint32_t b) {
+    // 序号较小的根作为合并后的根，组的根始终是最早出现的行
+    a = fuzzy_find(parent, a);
+    b = fuzzy_find(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    } else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+void fuzzy_sort_bands(fuzzy_band_t* recs, size_t count) {
+    // 按哈希做基数排序，每趟16位，所有记录这一段都相同时跳过；排序是稳定的
+    fuzzy_band_t* tmp = xmalloc((count ? count : 1) * sizeof(fuzzy_band_t));
+    size_t* counts = xmalloc(65536 * sizeof(size_t));
+    fuzzy_band_t* from = recs;
+    fuzzy_band_t* to = tmp;
+    for (int shift = 0; shift < 64; shift += 16) {
+        memset(counts, 0, 65536 * sizeof(size_t));
+        for (size_t i = 0; i < count; i++) {
+            counts[(from[i].key >> shift) & 0xFFFF]++;
+        }
+        if (count == 0 || counts[(from[0].key >> shift) & 0xFFFF] == count) {
+            continue;
+        }
+        size_t pos = 0;
+        for (int d = 0; d < 65536; d++) {
+            size_t n = counts[d];
+            counts[d] = pos;
+            pos += n;
+        }
+        for (size_t i = 0; i < count; i++) {
+            to[counts[(from[i].key >> shift) & 0xFFFF]++] = from[i];
+        }
+        fuzzy_band_t* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != recs) {
+        memcpy(recs, from, count * sizeof(fuzzy_band_t));
+    }
+    free(counts);
+    free(tmp);
+
+    // 各线程的记录交错写入分区文件，同一桶内再按行号排序，结果与线程数无关
+    for (size_t i = 0; i < count;) {
+        size_t j = i + 1;
+        int sorted = 1;
+        while (j < count && recs[j].key == recs[i].key) {
+            if (recs[j].row < recs[j - 1].row) sorted = 0;
+            j++;
+        }
+        if (!sorted) {
+            qsort(recs + i, j - i, sizeof(fuzzy_band_t), fuzzy_band_compare);
+        }
+        i = j;
+    }
+}
+
+int fuzzy_band_compare(const void* a, const void* b) {
+    const fuzzy_band_t* ra = a;
+    const fuzzy_band_t* rb = b;
+    if (ra->key != rb->key) {
+        return ra->key < rb->key ? -1 : 1;
+    }
+    if (ra->row != rb->row) {
+        return ra->row < rb->row ? -1 : 1;
+    }
+    return 0;
+}
+
+int fuzzy_member_compare(const void* a, const void* b) {
+    const fuzzy_member_t* ma = a;
+    const fuzzy_member_t* mb = b;
+    if (ma->root != mb->root) {
+        return ma->root < mb->root ? -1 : 1;
+    }
+    if (ma->row != mb->row) {
+        return ma->row < mb->row ? -1 : 1;
+    }
+    return 0;
+}
+
+int fuzzy_row_compare(const void* a, const void* b) {
+    uint32_t ra = *(const uint32_t*)a;
+    uint32_t rb = *(const uint32_t*)b;
+    return ra < rb ? -1 : (ra > rb ? 1 : 0);
+}
+
+void random_sample_lines(const char* filename, int n_lines) {
+    table_reader_t table;
+    if (table_open(&table, filename) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    if (table_apply_window(&table) != 0) {
+        table_close(&table);
+        return;
+    }
+
+    // 初始化随机数生成器
+    srand((unsigned int)time(NULL));
+
+    // 蓄水池抽样：只保留n行，第i行以 n/i 的概率替换其中一行。
+    // 蓄水池按需扩容，请求行数远大于数据行数时不会预先分配
+    char** sample = NULL;
+    size_t* sample_len = NULL;
+    long long sample_cap = 0;
+    long long line_count = 0;
+    char* line;
+    size_t len;
+    while ((line = line_reader_next(&table.reader, &len)) != NULL) {
+        line_count++;
+        long long slot = line_count - 1;
+        if (slot >= n_lines) {
+            slot = (long long)((((uint64_t)rand() << 31) ^ (uint64_t)rand()) % (uint64_t)line_count);
+            if (slot >= n_lines) {
+                continue;
+            }
+            free(sample[slot]);
+        } else if (slot == sample_cap) {
+            sample_cap = sample_cap ? sample_cap * 2 : 1024;
+            if (sample_cap > n_lines) sample_cap = n_lines;
+            sample = xrealloc(sample, (size_t)sample_cap * sizeof(char*));
+            sample_len = xrealloc(sample_len, (size_t)sample_cap * sizeof(size_t));
+        }
+        sample[slot] = xmalloc(len + 1);
+        memcpy(sample[slot], line, len + 1);
+        sample_len[slot] = len;
+    }
+
+    // 检查请求的行数
+    if (n_lines > line_count) {
+        fprintf(stderr, "警告: 请求行数(%d)大于数据行数(%lld)，将返回所有数据行\n", 
+                n_lines, line_count);
+        n_lines = (int)line_count;
+    }
+
+    // 输出表头
+    fwrite(table.header_line, 1, table.header_len, stdout);
+    putchar('\n');
+
+    // 蓄水池中的顺序不是随机的，再用Fisher-Yates洗牌
+    for (int i = n_lines - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        char* temp = sample[i];
+        size_t temp_len = sample_len[i];
+        sample[i] = sample[j];
+        sample_len[i] = sample_len[j];
+        sample[j] = temp;
+        sample_len[j] = temp_len;
+    }
+
+    for (int i = 0; i < n_lines; i++) {
+        fwrite(sample[i], 1, sample_len[i], stdout);
+        putchar('\n');
+        free(sample[i]);
+    }
+    free(sample);
+    free(sample_len);
+    table_close(&table);
+}
+
+void split_string(const char* input, const char* delimiter) {
+    split_set_t set;
+    split_set_init(&set, (delimiter && *delimiter) ? delimiter : SPLIT_DEFAULT_DELIMS, 0);
+
+    out_buffer_t out;
+    out_buffer_init(&out, stdout);
+    split_scan(&set, input, strlen(input), 1, &out);
+    out_buffer_close(&out);
+}
+
+void split_file_content(const char* filename, const char* delimiter) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+
+    // 换行也作为分隔符，整个文件按块流式处理，不受行长限制
+    split_set_t set;
+    split_set_init(&set, (delimiter && *delimiter) ? delimiter : SPLIT_DEFAULT_DELIMS, 1);
+
+    out_buffer_t out;
+    out_buffer_init(&out, stdout);
+    size_t cap = READ_BUFFER_SIZE;
+    char* buf = xmalloc(cap);
+    size_t have = 0;
+    for (;;) {
+        if (have == cap) {
+            // 单个词超过整个缓冲区
+            cap *= 2;
+            buf = xrealloc(buf, cap);
+        }
+        PROF_BEGIN(read_start);
+        size_t n = fread(buf + have, 1, cap - have, file);
+        PROF_END(read_start, PROF_READ, n);
+        have += n;
+        
+        // 块末尾未结束的词留到下一块
+        int at_eof = (n == 0);
+        size_t used = split_scan(&set, buf, have, at_eof, &out);
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        if (at_eof) {
+            break;
+        }
+    }
+
+    free(buf);
+    out_buffer_close(&out);
+    fclose(file);
+}
+
+void split_set_init(split_set_t* set, const char* pattern, int split_lines) {
+    memset(set, 0, sizeof(*set));
+    const unsigned char* p = (const unsigned char*)pattern;
+    while (*p) {
+        // 按UTF-8首字节确定字符长度，不完整的序列按单字节处理
+        int n = (*p >= 0xF0) ? 4 : (*p >= 0xE0) ? 3 : (*p >= 0xC0) ? 2 : 1;
+        for (int i = 1; i < n; i++) {
+            if ((p[i] & 0xC0) != 0x80) {
+                n = 1;
+                break;
+            }
+        }
+        split_set_add(set, p, n);
+        p += n;
+    }
+    if (split_lines) {
+        // 按文件拆分时换行符同样是分隔符
+        split_set_add(set, (const unsigned char*)"\n", 1);
+        split_set_add(set, (const unsigned char*)"\r", 1);
+    }
+#ifdef __SSE2__
+    for (int i = 0; i < set->num_first; i++) {
+        set->first_vec[i] = _mm_set1_epi8((char)set->first[i]);
+    }
+#endif
+}
+
+void split_set_add(split_set_t* set, const unsigned char* bytes, int n) {
+    if (set->count == SPLIT_MAX_DELIMS) {
+        return;
+    }
+    memcpy(set->bytes[set->count], bytes, n);
+    set->lens[set->count] = n;
+    set->count++;
+    if (!set->is_first[bytes[0]]) {
+        set->is_first[bytes[0]] = 1;
+        set->first[set->num_first++] = bytes[0];
+    }
+}
+
+size_t split_scan(const split_set_t* set, const char* data, size_t len, int at_eof, out_buffer_t* out) {
+    // 返回已处理的字节数；未到结尾时，最后一个分隔符之后的内容留给调用者下次再传入
+    size_t token_start = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t hit = split_next_candidate(set, data, pos, len);
+        if (hit >= len) {
+            break;
+        }
+        int n = split_match(set, data + hit, len - hit);
+        if (n < 0) {
+            // 分隔符被块边界截断
+            if (!at_eof) {
+                return token_start;
+            }
+            n = 0;
+        }
+        if (n == 0) {
+            pos = hit + 1;
+            continue;
+        }
+        split_emit(data + token_start, hit - token_start, out);
+        pos = hit + n;
+        token_start = pos;
+    }
+    if (!at_eof) {
+        return token_start;
+    }
+    split_emit(data + token_start, len - token_start, out);
+    return len;
+}
+
+size_t split_next_candidate(const split_set_t* set, const char* data, size_t pos, size_t len) {
+#ifdef __SSE2__
+    // 每次比较16字节，与所有不重复的首字节逐一比较后合并结果
+    while (pos + 16 <= len) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + pos));
+        __m128i hit = _mm_cmpeq_epi8(block, set->first_vec[0]);
+        for (int i = 1; i < set->num_first; i++) {
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, set->first_vec[i]));
+        }
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) {
+            return pos + __builtin_ctz((unsigned int)mask);
+        }
+        pos += 16;
+    }
+#endif
+    while (pos < len && !set->is_first[(unsigned char)data[pos]]) {
+        pos++;
+    }
+    return pos;
+}
+
+int split_match(const split_set_t* set, const char* data, size_t avail) {
+    // 返回匹配的分隔符长度，0 表示只是首字节相同，-1 表示数据不够判断
+    int truncated = 0;
+    for (int i = 0; i < set->count; i++) {
+        int n = set->lens[i];
+        if (set->bytes[i][0] != (unsigned char)data[0]) {
+            continue;
+        }
+        if ((size_t)n > avail) {
+            if (memcmp(set->bytes[i], data, avail) == 0) truncated = 1;
+            continue;
+        }
+        if (memcmp(set->bytes[i], data, n) == 0) {
+            return n;
+        }
+    }
+    return truncated ? -1 : 0;
+}
+
+void split_emit(const char* token, size_t len, out_buffer_t* out) {
+    // 去掉首尾空白，空词不输出
+    while (len > 0 && isspace((unsigned char)*token)) {
+        token++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)token[len - 1])) {
+        len--;
+    }
+    if (len == 0) {
+        return;
+    }
+    out_buffer_write(out, token, len);
+    out_buffer_write(out, "\n", 1);
+}
+
+void process_fasta_list(const char* filename) {
+    printf("=== FASTA文件序列列表 ===\n");
+    long long seq_count = fasta_scan_parallel(filename, NULL, 0, stdout, NULL);
+    if (seq_count < 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+    printf("\n总序列数: %lld\n", seq_count);
+}
+
+void process_fasta_extract(const char* filename, const char* sequence_names, const char* output_file) {
+    if (access(filename, R_OK) != 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+        return;
+    }
+
+    FILE* output = stdout;
+    if (output_file) {
+        output = fopen(output_file, "w");
+        if (!output) {
+            fprintf(stderr, "无法创建输出文件: %s\n", output_file);
+            return;
+        }
+    }
+
+    // 解析序列名列表，转换为小写以便比较
+    char* names_copy = arena_strndup(&g_run_arena, sequence_names, strlen(sequence_names));
+    const char** target_names = arena_alloc(&g_run_arena, (count_char_occurrences(names_copy, ',') + 1) * sizeof(char*));
+    int num_targets = 0;
+    
+    char* token = strtok(names_copy, ",");
+    while (token != NULL) {
+        trim_whitespace(token);
+        for (int i = 0; token[i]; i++) {
+            token[i] = tolower((unsigned char)token[i]);
+        }
+        target_names[num_targets++] = intern_string(token, strlen(token));
+        token = strtok(NULL, ",");
+    }
+
+    long long found_any = 0;
+    if (num_targets > 0 && fasta_scan_parallel(filename, target_names, num_targets, output, &found_any) < 0) {
+        fprintf(stderr, "无法打开文件: %s\n", filename);
+    } else if (!found_any) {
+        fprintf(stderr, "未找到匹配的序列: %s\n", sequence_names);
+        fprintf(stderr, "提示: 使用 '%s %s fasta list' 查看所有可用序列\n", "detect_delim", filename);
+    } else if (output_file) {
+        printf("序列已保存到: %s\n", output_file);
+    }
+
+    if (output != stdout) {
+        fclose(output);
+    }
+}
+
+long long fasta_scan_parallel(const char* filename, const char* const* targets, int num_targets,
+                              FILE* output, long long* matched) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return -1;
+    }
+    long long file_size = get_file_size(filename);
+
+    // 按线程数等分文件，再把每个分界点推到其后第一条记录的开头，记录不会被拆开
+    int threads = choose_thread_count(file_size);
+    fasta_worker_t* workers = xmalloc(threads * sizeof(fasta_worker_t));
+    long long prev = 0;
+    for (int t = 0; t < threads; t++) {
+        memset(&workers[t], 0, sizeof(fasta_worker_t));
+        workers[t].filename = filename;
+        workers[t].targets = targets;
+        workers[t].num_targets = num_targets;
+        workers[t].start = prev;
+        workers[t].end = (t == threads - 1) ? file_size
+                         : fasta_align_start(file, file_size / threads * (t + 1), file_size);
+        if (workers[t].end < prev) {
+            workers[t].end = prev;
+        }
+        prev = workers[t].end;
+        chunk_output_init(&workers[t].out, g_options.mem_budget / threads);
+    }
+    fclose(file);
+    run_workers(fasta_worker_main, workers, sizeof(fasta_worker_t), threads);
+
+    // 按分块顺序输出；列表的编号在这里统一加上
+    long long records = 0;
+    long long number = 1;
+    int failed = 0;
+    for (int t = 0; t < threads; t++) {
+        chunk_output_drain(&workers[t].out, output, targets ? NULL : &number);
+        records += workers[t].records;
+        if (matched) {
+            *matched += workers[t].matched;
+        }
+        failed |= workers[t].failed;
+    }
+    free(workers);
+    return failed ? -1 : records;
+}
+
+long long fasta_align_start(FILE* file, long long pos, long long file_size) {
+    // 从 pos-1 开始读，找到 pos 及之后第一个位于行首的 '>'
+    if (pos <= 0) {
+        return 0;
+    }
+    char buffer[65536];
+    long long base = pos - 1;
+    int prev_newline = 0;
+    while (base < file_size && fseeko(file, base, SEEK_SET) == 0) {
+        size_t n = fread(buffer, 1, sizeof(buffer), file);
+        if (n == 0) {
+            break;
+        }
+        // 第一块的首字节在 pos 之前，只用来判断 pos 处是否位于行首
+        size_t skip = (base == pos - 1) ? 1 : 0;
+        if (skip && n == 1) {
+            break;
+        }
+        size_t hit = fasta_find_record(buffer + skip, n - skip, skip ? buffer[0] == '\n' : prev_newline);
+        if (hit < n - skip) {
+            return base + skip + hit;
+        }
+        prev_newline = (buffer[n - 1] == '\n');
+        base += n;
+    }
+    return file_size;
+}
+
+size_t fasta_find_record(const char* data, size_t len, int prev_newline) {
+    // 返回第一个位于行首的 '>' 的位置，即 "\n>" 中 '>' 的位置，没有时返回 len
+    if (len == 0) {
+        return 0;
+    }
+    if (data[0] == '>' && prev_newline) {
+        return 0;
+    }
+    size_t pos = 1;
+#ifdef __SSE2__
+    // 每次比较16字节：当前字节为 '>' 且前一字节为 '\n'
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (pos + 16 <= len) {
+        __m128i cur = _mm_loadu_si128((const __m128i*)(data + pos));
+        __m128i prev = _mm_loadu_si128((const __m128i*)(data + pos - 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(cur, gt), _mm_cmpeq_epi8(prev, nl)));
+        if (mask) {
+            return pos + __builtin_ctz((unsigned int)mask);
+        }
+        pos += 16;
+    }
+#endif
+    while (pos < len) {
+        const char* hit = memchr(data + pos, '>', len - pos);
+        if (!hit) {
+            return len;
+        }
+        pos = hit - data;
+        if (data[pos - 1] == '\n') {
+            return pos;
+        }
+        pos++;
+    }
+    return len;
+}
+
+void* fasta_worker_main(void* arg) {
+    fasta_worker_t* worker = arg;
+    FILE* file = fopen(worker->filename, "rb");
+    if (!file || fseeko(file, worker->start, SEEK_SET) != 0) {
+        if (file) fclose(file);
+        worker->failed = 1;
+        return NULL;
+    }
+
+    // 状态：0 跳过不需要的记录，1 读取表头，2 复制匹配记录的序列
+    char* buf = xmalloc(READ_BUFFER_SIZE);
+    long long remaining = worker->end - worker->start;
+    int state = 0;
+    int prev_newline = 1;  // 分块总是从文件开头或记录开头开始
+    while (remaining > 0) {
+        PROF_BEGIN(read_start);
+        size_t n = fread(buf, 1, remaining < READ_BUFFER_SIZE ? (size_t)remaining : READ_BUFFER_SIZE, file);
+        PROF_END(read_start, PROF_READ, n);
+        if (n == 0) {
+            break;
+        }
+        remaining -= n;
+
+        size_t pos = 0;
+        while (pos < n) {
+            if (state == 1) {
+                const char* nl = memchr(buf + pos, '\n', n - pos);
+                size_t stop = nl ? (size_t)(nl - buf) : n;
+                if (worker->header_len + (stop - pos) + 1 > worker->header_cap) {
+                    worker->header_cap = (worker->header_len + (stop - pos) + 1) * 2;
+                    worker->header = xrealloc(worker->header, worker->header_cap);
+                }
+                memcpy(worker->header + worker->header_len, buf + pos, stop - pos);
+                worker->header_len += stop - pos;
+                pos = stop;
+                if (nl) {
+                    pos++;
+                    fasta_finish_header(worker);
+                    state = worker->last_byte ? 2 : 0;
+                    prev_newline = 1;
+                }
+                continue;
+            }
+            // 序列部分直接向量化查找下一条记录，不逐行处理
+            size_t next = pos + fasta_find_record(buf + pos, n - pos, prev_newline);
+            if (state == 2) {
+                fasta_copy_body(worker, buf + pos, next - pos);
+            }
+            if (next < n) {
+                worker->records++;
+                state = 1;
+                pos = next + 1;
+            } else {
+                prev_newline = (buf[n - 1] == '\n');
+                pos = n;
+            }
+        }
+    }
+    if (state == 1) {
+        fasta_finish_header(worker);
+    } else if (state == 2 && worker->last_byte != '\n') {
+        // 文件末尾没有换行
+        chunk_output_write(&worker->out, "\n", 1);
+    }
+
+    free(buf);
+    free(worker->header);
+    free(worker->lower);
+    fclose(file);
+    return NULL;
+}
+
+void fasta_finish_header(fasta_worker_t* worker) {
+    size_t len = worker->header_len;
+    if (len > 0 && worker->header[len - 1] == '\r') {
+        len--;
+    }
+    worker->header_len = 0;
+    worker->last_byte = 0;
+    worker->pending_cr = 0;
+    if (!worker->targets) {
+        chunk_output_write(&worker->out, worker->header, len);
+        chunk_output_write(&worker->out, "\n", 1);
+        return;
+    }
+
+    // 不区分大小写的包含匹配
+    worker->lower = xrealloc(worker->lower, len + 1);
+    for (size_t i = 0; i < len; i++) {
+        worker->lower[i] = tolower((unsigned char)worker->header[i]);
+    }
+    worker->lower[len] = '\0';
+    for (int i = 0; i < worker->num_targets; i++) {
+        if (strstr(worker->lower, worker->targets[i]) != NULL) {
+            chunk_output_write(&worker->out, ">", 1);
+            chunk_output_write(&worker->out, worker->header, len);
+            chunk_output_write(&worker->out, "\n", 1);
+            worker->matched++;
+            worker->last_byte = '\n';
+            return;
+        }
+    }
+}
+
+void fasta_copy_body(fasta_worker_t* worker, const char* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    // 原样复制，只去掉 \r\n 中的 \r
+    if (worker->pending_cr) {
+        worker->pending_cr = 0;
+        if (data[0] != '\n') {
+            chunk_output_write(&worker->out, "\r", 1);
+        }
+    }
+    const char* end = data + len;
+    const char* p = data;
+    const char* cr;
+    while ((cr = memchr(p, '\r', end - p)) != NULL) {
+        chunk_output_write(&worker->out, p, cr - p);
+        p = cr + 1;
+        if (p == end) {
+            worker->pending_cr = 1;
+            break;
+        }
+        if (*p != '\n') {
+            chunk_output_write(&worker->out, "\r", 1);
+        }
+    }
+    chunk_output_write(&worker->out, p, end - p);
+    worker->last_byte = end[-1];
+}
+
+int is_fasta_file(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char line[MAX_LINE_LENGTH];
+    if (fgets(line, sizeof(line), file)) {
+        fclose(file);
+        return (line[0] == '>');
+    }
+    
+    fclose(file);
+    return 0;
+}
+
+data_type_t detect_data_type(const char* value) {
+    size_t value_len = strlen(value);
+    if (value_len == 0) {
+        return DATA_EMPTY;
+    }
+
+    PROF_SAMPLE_BEGIN(classify_start, PROF_CLASSIFY);
+    data_type_t type = DATA_TEXT;
+    char* endptr;
+    
+    // 尝试解析为整数
+    long int_val = strtol(value, &endptr, 10);
+    if (*endptr == '\0') {
+        type = DATA_INTEGER;
+    } else {
+        // 尝试解析为浮点数
+        double float_val = strtod(value, &endptr);
+        if (*endptr == '\0') {
+            type = DATA_FLOAT;
+        }
+    }
+    
+    PROF_SAMPLE_END(classify_start, PROF_CLASSIFY, value_len);
+    return type;
+}
+
+void trim_whitespace(char* str) {
+    // 移除前导空白
+    char* start = str;
+    while (isspace(*start)) {
+        start++;
+    }
+    
+    // 移除尾随空白
+    char* end = start + strlen(start) - 1;
+    while (end > start && isspace(*end)) {
+        end--;
+    }
+    
+    // 复制结果
+    int len = end - start + 1;
+    memmove(str, start, len);
+    str[len] = '\0';
+}
+
+int count_char_occurrences(const char* str, char ch) {
+    int count = 0;
+    for (int i = 0; str[i]; i++) {
+        if (str[i] == ch) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void format_file_size(long size, char* buffer) {
+    if (size >= 1073741824) {
+        sprintf(buffer, "%.2fGB", (double)size / 1073741824);
+    } else if (size >= 1048576) {
+        sprintf(buffer, "%.2fMB", (double)size / 1048576);
+    } else if (size >= 1024) {
+        sprintf(buffer, "%.2fKB", (double)size / 1024);
+    } else {
+        sprintf(buffer, "%ldB", size);
+    }
+}
+
+void* xmalloc(size_t size) {
+    PROF_ALLOC(size);
+    void* ptr = malloc(size);
+    if (!ptr) {
+        fprintf(stderr, "内存不足\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+void* xrealloc(void* ptr, size_t size) {
+    PROF_ALLOC(size);
+    void* new_ptr = realloc(ptr, size);
+    if (!new_ptr) {
+        fprintf(stderr, "内存不足\n");
+        exit(1);
+    }
+    return new_ptr;
+}
+
+int line_reader_open(line_reader_t* reader, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return -1;
+    }
+    line_reader_init(reader, file, READ_BUFFER_SIZE);
+    if (line_reader_detect(reader) != 0) {
+        line_reader_close(reader);
+        return -1;
+    }
+    return 0;
+}
+
+void line_reader_init(line_reader_t* reader, FILE* file, size_t buffer_size) {
+    reader->file = file;
+    reader->cap = buffer_size;
+    reader->buf = xmalloc(reader->cap);
+    reader->pos = 0;
+    reader->scan = 0;
+    reader->end = 0;
+    reader->base = ftello(file);
+    if (reader->base < 0) {
+        reader->base = 0;
+    }
+    reader->limit = -1;
+    reader->eof = 0;
+    reader->origin = reader->base;
+    reader->raw_start = reader->base;
+    reader->encoding = ENC_UTF8;
+    reader->cd = (iconv_t)-1;
+    reader->raw = NULL;
+    reader->raw_len = 0;
+    reader->raw_eof = 0;
+    reader->validate = 0;
+    reader->checked = 0;
+}
+
+int line_reader_detect(line_reader_t* reader) {
+    // 读取文件开头的样本判断编码，--encoding 可以强制指定
+    unsigned char* sample = xmalloc(ENCODING_SAMPLE_SIZE);
+    size_t n = fread(sample, 1, ENCODING_SAMPLE_SIZE, reader->file);
+    size_t bom = 0;
+    encoding_t encoding = detect_encoding(sample, n, &bom);
+    free(sample);
+    const char* name = g_options.encoding;
+    if (name) {
+        encoding_t detected = encoding;
+        if (strcasecmp(name, "utf-8") == 0 || strcasecmp(name, "utf8") == 0) {
+            encoding = (detected == ENC_UTF8_BOM) ? ENC_UTF8_BOM : ENC_UTF8;
+        } else if (strcasecmp(name, "gbk") == 0 || strcasecmp(name, "gb2312") == 0 ||
+                   strcasecmp(name, "gb18030") == 0) {
+            encoding = ENC_GB18030;
+        } else if (strcasecmp(name, "utf-16le") == 0) {
+            encoding = ENC_UTF16LE;
+        } else if (strcasecmp(name, "utf-16be") == 0) {
+            encoding = ENC_UTF16BE;
+        } else {
+            encoding = ENC_OTHER;
+        }
+        // 只有检测到的BOM与指定的编码一致时才跳过
+        if (encoding != detected) bom = 0;
+    }
+    reader->encoding = encoding;
+
+    const char* from = NULL;
+    switch (encoding) {
+        case ENC_UTF16LE: from = "UTF-16LE"; break;
+        case ENC_UTF16BE: from = "UTF-16BE"; break;
+        case ENC_GB18030: from = "GB18030"; break;
+        case ENC_OTHER: from = name; break;
+        case ENC_UNKNOWN:
+            if (!g_encoding_warned) {
+                g_encoding_warned = 1;
+                fprintf(stderr, "警告: 无法识别文件编码，按原始字节处理（可用 --encoding 指定）\n");
+            }
+            break;
+        default:
+            // UTF-8：样本之后的数据在读取时继续校验
+            reader->validate = 1;
+            break;
+    }
+    if (from) {
+        reader->cd = iconv_open("UTF-8", from);
+        if (reader->cd == (iconv_t)-1) {
+            fprintf(stderr, "错误: 不支持的编码: %s\n", from);
+            return -1;
+        }
+        reader->raw = xmalloc(RAW_BUFFER_SIZE);
+    }
+
+    // 转码后的偏移从0开始，UTF-8的偏移仍是文件中的位置
+    reader->raw_start = (long long)bom;
+    reader->origin = from ? 0 : (long long)bom;
+    reader->base = reader->origin;
+    if (fseeko(reader->file, reader->raw_start, SEEK_SET) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int line_reader_open_range(line_reader_t* reader, const char* filename, long long start, long long end) {
+    if (line_reader_open(reader, filename) != 0) {
+        return -1;
+    }
+    if (line_reader_seek(reader, start, end) != 0) {
+        line_reader_close(reader);
+        return -1;
+    }
+    return 0;
+}
+
+int line_reader_seek(line_reader_t* reader, long long start, long long end) {
+    // 从start前一个字节开始读：若它不是换行符，说明start落在行中间，
+    // 这一行属于上一个范围，跳过其剩余部分。之后只返回在end之前开始的行
+    int skip = start > reader->origin;
+    long long target = skip ? start - 1 : reader->origin;
+    if (reader->raw) {
+        if (line_reader_rewind_to(reader, target) != 0) {
+            return -1;
+        }
+    } else {
+        if (fseeko(reader->file, target, SEEK_SET) != 0) {
+            return -1;
+        }
+        reader->pos = 0;
+        reader->scan = 0;
+        reader->end = 0;
+        reader->eof = 0;
+        reader->base = target;
+    }
+    reader->limit = -1;
+    if (skip) {
+        // 被跳过的半行可能从字符中间开始，不参与校验
+        int validate = reader->validate;
+        size_t len;
+        reader->validate = 0;
+        line_reader_next(reader, &len);
+        reader->validate = validate;
+    }
+    reader->checked = reader->pos;
+    reader->limit = end;
+    return 0;
+}
+
+int line_reader_rewind_to(line_reader_t* reader, long long target) {
+    // 转码后的偏移无法直接定位，只能解码并丢弃之前的内容。目标在当前缓冲区之后时
+    // 接着往后解码，否则从头开始（缓冲区中已返回的行被改写过，不能复用）
+    if (target < reader->base + (long long)reader->end) {
+        if (fseeko(reader->file, reader->raw_start, SEEK_SET) != 0) {
+            return -1;
+        }
+        iconv(reader->cd, NULL, NULL, NULL, NULL);
+        reader->raw_len = 0;
+        reader->raw_eof = 0;
+        reader->base = 0;
+        reader->end = 0;
+        reader->eof = 0;
+    }
+    while (!reader->eof && reader->base + (long long)reader->end <= target) {
+        reader->base += reader->end;
+        reader->end = line_reader_fill(reader, reader->buf, reader->cap - 1);
+        if (reader->end == 0) {
+            reader->eof = 1;
+        }
+    }
+    long long offset = target - reader->base;
+    reader->pos = offset < (long long)reader->end ? (size_t)offset : reader->end;
+    reader->scan = reader->pos;
+    return 0;
+}
+
+char* line_reader_next(line_reader_t* reader, size_t* len) {
+    if (reader->limit >= 0 && reader->base + (long long)reader->pos >= reader->limit) {
+        return NULL;
+    }
+    for (;;) {
+        char* start = reader->buf + reader->pos;
+        char* nl = NULL;
+        if (reader->scan < reader->end) {
+            nl = memchr(reader->buf + reader->scan, '\n', reader->end - reader->scan);
+        }
+        
+        if (nl) {
+            size_t n = nl - start;
+            reader->pos += n + 1;
+            reader->scan = reader->pos;
+            if (n > 0 && start[n - 1] == '\r') n--;
+            start[n] = '\0';
+            *len = n;
+            PROF_ROW();
+            return start;
+        }
+        
+        size_t avail = reader->end - reader->pos;
+        if (reader->eof) {
+            // 文件末尾没有换行符的最后一行
+            if (avail == 0) {
+                return NULL;
+            }
+            reader->pos = reader->scan = reader->end;
+            if (start[avail - 1] == '\r') avail--;
+            start[avail] = '\0';
+            *len = avail;
+            PROF_ROW();
+            return start;
+        }
+        
+        // 将未完成的行移到缓冲区开头，必要时扩容（预留一个字节放结束符）
+        if (reader->pos > 0) {
+            memmove(reader->buf, start, avail);
+            reader->base += reader->pos;
+            reader->checked = reader->checked > reader->pos ? reader->checked - reader->pos : 0;
+            reader->pos = 0;
+            reader->end = avail;
+        }
+        reader->scan = reader->end;
+        if (reader->cap - reader->end < reader->cap / 2) {
+            reader->cap *= 2;
+            reader->buf = xrealloc(reader->buf, reader->cap);
+        }
+        
+        // 读取阶段包含转码和UTF-8校验
+        PROF_BEGIN(read_start);
+        size_t got = line_reader_fill(reader, reader->buf + reader->end, reader->cap - reader->end - 1);
+        reader->end += got;
+        if (got == 0) {
+            reader->eof = 1;
+        }
+        if (reader->validate) {
+            line_reader_validate(reader);
+        }
+        PROF_END(read_start, PROF_READ, got);
+    }
+}
+
+size_t line_reader_fill(line_reader_t* reader, char* dest, size_t room) {
+    if (!reader->raw) {
+        return fread(dest, 1, room, reader->file);
+    }
+    
+    // 转码：原始数据分块读入，转换结果直接写到行缓冲区；块末尾不完整的字符留到下次
+    int unit = (reader->encoding == ENC_UTF16LE || reader->encoding == ENC_UTF16BE) ? 2 : 1;
+    char* out = dest;
+    size_t out_left = room;
+    while (out_left > 8) {
+        if (!reader->raw_eof && reader->raw_len < RAW_BUFFER_SIZE / 2) {
+            size_t n = fread(reader->raw + reader->raw_len, 1, RAW_BUFFER_SIZE - reader->raw_len, reader->file);
+            reader->raw_len += n;
+            if (n == 0) reader->raw_eof = 1;
+        }
+        if (reader->raw_len == 0) {
+            break;
+        }
+        char* in = reader->raw;
+        size_t in_left = reader->raw_len;
+        size_t result = iconv(reader->cd, &in, &in_left, &out, &out_left);
+        int err = (result == (size_t)-1) ? errno : 0;
+        memmove(reader->raw, in, in_left);
+        reader->raw_len = in_left;
+        if (err == E2BIG) {
+            break;
+        }
+        if (err == EILSEQ || (err == EINVAL && reader->raw_eof)) {
+            // 无法转换的字节替换为U+FFFD
+            size_t skip = reader->raw_len < (size_t)unit ? reader->raw_len : (size_t)unit;
+            memmove(reader->raw, reader->raw + skip, reader->raw_len - skip);
+            reader->raw_len -= skip;
+            memcpy(out, "\xEF\xBF\xBD", 3);
+            out += 3;
+            out_left -= 3;
+            if (!g_encoding_warned) {
+                g_encoding_warned = 1;
+                fprintf(stderr, "警告: 输入中有无法按 %s 转换的字节，已替换为U+FFFD\n", encoding_name(reader->encoding));
+            }
+        }
+    }
+    return (size_t)(out - dest);
+}
+
+void line_reader_validate(line_reader_t* reader) {
+    // 只校验新读入的部分；块末尾不完整的字符等下次读入后再校验
+    const unsigned char* data = (const unsigned char*)reader->buf + reader->checked;
+    size_t len = reader->end - reader->checked;
+    size_t consumed;
+    if (utf8_validate(data, len, &consumed) == 0 && (consumed == len || !reader->eof)) {
+        reader->checked += consumed;
+        return;
+    }
+    reader->validate = 0;
+    if (!g_encoding_warned) {
+        g_encoding_warned = 1;
+        fprintf(stderr, "警告: 第 %lld 字节处不是有效的UTF-8，可用 --encoding 指定文件编码\n",
+                reader->base + (long long)(reader->checked + consumed));
+    }
+}
+
+encoding_t detect_encoding(const unsigned char* data, size_t len, size_t* bom) {
+    *bom = 0;
+    if (len >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+        *bom = 3;
+        return ENC_UTF8_BOM;
+    }
+    if (len >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+        *bom = 2;
+        return ENC_UTF16LE;
+    }
+    if (len >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+        *bom = 2;
+        return ENC_UTF16BE;
+    }
+    
+    // 没有BOM的UTF-16：ASCII字符的高字节为0，零字节集中在奇数（LE）或偶数（BE）位置
+    size_t zeros[2] = { 0, 0 };
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == 0) zeros[i & 1]++;
+    }
+    size_t pairs = len / 2;
+    if (pairs >= 2) {
+        if (zeros[1] * 10 > pairs * 3 && zeros[0] * 20 < pairs) return ENC_UTF16LE;
+        if (zeros[0] * 10 > pairs * 3 && zeros[1] * 20 < pairs) return ENC_UTF16BE;
+    }
+    
+    size_t consumed;
+    if (utf8_validate(data, len, &consumed) == 0) {
+        return ENC_UTF8;
+    }
+    if (gb18030_plausible(data, len)) {
+        return ENC_GB18030;
+    }
+    return ENC_UNKNOWN;
+}
+
+int utf8_validate(const unsigned char* data, size_t len, size_t* consumed) {
+    // 返回0表示有效（末尾不完整的字符不计入consumed），-1表示consumed处无效
+    size_t i = 0;
+    while (i < len) {
+        // 按16字节（无SSE2时8字节）分块：纯ASCII的块整块跳过，否则直接跳到第一个非ASCII字节，
+        // 块内其余部分逐字符校验，最后一个多字节字符可以越过块边界
+        size_t block_end = len;
+#ifdef __SSE2__
+        if (i + 16 <= len) {
+            int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data + i)));
+            if (mask == 0) {
+                i += 16;
+                continue;
+            }
+            block_end = i + 16;
+            i += __builtin_ctz((unsigned int)mask);
+        }
+#else
+        if (i + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+            block_end = i + 8;
+        }
+#endif
+        while (i < block_end) {
+            unsigned char c = data[i];
+            if (c < 0x80) {
+                i++;
+                continue;
+            }
+            // 常用汉字所在的 E1-EC 三字节字符没有额外限制，单独走快速路径
+            if (c >= 0xE1 && c <= 0xEC && i + 2 < len &&
+                (data[i + 1] & 0xC0) == 0x80 && (data[i + 2] & 0xC0) == 0x80) {
+                i += 3;
+                continue;
+            }
+            
+            // 多字节字符：第二字节的范围排除过长编码、代理区和超出U+10FFFF的值
+            int n;
+            unsigned char lo = 0x80, hi = 0xBF;
+            if (c >= 0xC2 && c <= 0xDF) {
+                n = 2;
+            } else if (c >= 0xE0 && c <= 0xEF) {
+                n = 3;
+                if (c == 0xE0) lo = 0xA0;
+                if (c == 0xED) hi = 0x9F;
+            } else if (c >= 0xF0 && c <= 0xF4) {
+                n = 4;
+                if (c == 0xF0) lo = 0x90;
+                if (c == 0xF4) hi = 0x8F;
+            } else {
+                *consumed = i;
+                return -1;
+            }
+            for (int k = 1; k < n; k++) {
+                if (i + k >= len) {
+                    *consumed = i;
+                    return 0;
+                }
+                unsigned char b = data[i + k];
+                if (k == 1 ? (b < lo || b > hi) : (b & 0xC0) != 0x80) {
+                    *consumed = i;
+                    return -1;
+                }
+            }
+            i += n;
+        }
+    }
+    *consumed = len;
+    return 0;
+}
+
+size_t utf8_char_length(const unsigned char* data, size_t len, size_t* invalid) {
+    // 返回 data 处一个完整有效字符的字节数；无效时返回0，*invalid 为应当整体替换掉的字节数
+    // （首字节加上后面仍然合法的续字节，至少为1），和 utf8_validate 使用相同的规则
+    unsigned char c = data[0];
+    int n;
+    unsigned char lo = 0x80, hi = 0xBF;
+    *invalid = 1;
+    if (c < 0x80) {
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        return 0;
+    }
+    for (int k = 1; k < n; k++) {
+        if ((size_t)k >= len) {
+            return 0;
+        }
+        unsigned char b = data[k];
+        if (k == 1 ? (b < lo || b > hi) : (b & 0xC0) != 0x80) {
+            return 0;
+        }
+        *invalid = (size_t)k + 1;
+    }
+    return (size_t)n;
+}
+
+int gb18030_plausible(const unsigned char* data, size_t len) {
+    // 双字节：首字节0x81-0xFE，尾字节0x40-0xFE（不含0x7F）；四字节：首字节 数字 首字节 数字
+    size_t multibyte = 0;
+    size_t i = 0;
+    while (i < len) {
+        unsigned char c = data[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        if (c == 0x80 || c == 0xFF) {
+            return 0;
+        }
+        if (i + 1 >= len) {
+            break;
+        }
+        unsigned char b = data[i + 1];
+        if (b >= 0x30 && b <= 0x39) {
+            if (i + 3 >= len) {
+                break;
+            }
+            if (data[i + 2] < 0x81 || data[i + 2] > 0xFE || data[i + 3] < 0x30 || data[i + 3] > 0x39) {
+                return 0;
+            }
+            i += 4;
+        } else if (b >= 0x40 && b <= 0xFE && b != 0x7F) {
+            i += 2;
+        } else {
+            return 0;
+        }
+        multibyte++;
+    }
+    return multibyte > 0;
+}
+
+const char* encoding_name(encoding_t encoding) {
+    if (encoding == ENC_OTHER && g_options.encoding) {
+        return g_options.encoding;
+    }
+    return encoding_keys[encoding];
+}
+
+long long line_reader_tell(const line_reader_t* reader) {
+    return reader->base + (long long)reader->pos;
+}
+
+void line_reader_close(line_reader_t* reader) {
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+    if (reader->cd != (iconv_t)-1) {
+        iconv_close(reader->cd);
+        reader->cd = (iconv_t)-1;
+    }
+    free(reader->raw);
+    reader->raw = NULL;
+    free(reader->buf);
+    reader->buf = NULL;
+}
+
+int split_fields(char* line, size_t len, char delim, int multispace, field_t* fields, int max_fields) {
+    // 通用入口：逐行调用的热点应预先选好解析内核，直接调用内核函数
+    return parse_kernel_select(delim, multispace)->split(line, len, fields, max_fields);
+}
+
+int count_fields(const char* line, size_t len, char delim, int multispace) {
+    // 只统计字段数，不受MAX_COLUMNS限制
+    return parse_kernel_select(delim, multispace)->count(line, len);
+}
+
+void field_at(char* line, size_t len, char delim, int multispace, int index, field_t* field) {
+    // 只定位第index个字段，不需要字段数组；不存在时返回行尾的空字段
+    parse_kernel_select(delim, multispace)->field_at(line, len, index, field);
+}
+
+const parse_kernel_t* parse_kernel_select(char delim, int multispace) {
+    if (multispace) {
+        return &parse_kernels[DELIM_MULTISPACE];
+    }
+    // 分隔符只会来自检测结果；没有分隔符时整行是一个字段
+    switch (delim) {
+        case '\t': return &parse_kernels[DELIM_TAB];
+        case ',': return &parse_kernels[DELIM_COMMA];
+        case ';': return &parse_kernels[DELIM_SEMICOLON];
+        case '|': return &parse_kernels[DELIM_PIPE];
+        case ' ': return &parse_kernels[DELIM_SPACE];
+        default: return &parse_kernels[DELIM_UNKNOWN];
+    }
+}
+
+unsigned int parse_mask_short(const char* p, size_t n, char ch) {
+    unsigned int mask = 0;
+    for (size_t i = 0; i < n; i++) {
+        mask |= (unsigned int)(p[i] == ch) << i;
+    }
+    return mask;
+}
+
+// 单字符分隔符的解析内核模板。DELIM 在展开后的函数中是常量，整块比较得到分隔符位置的位掩码，
+// 再逐位取出，不必对每个字段调用一次 memchr。
+// 语义与原来的 memchr 实现相同：找到 max_fields 个字段后立即停止，最后一个字段到下一个分隔符为止
+#define DEFINE_PARSE_KERNEL(name, DELIM) \
+int split_##name(char* line, size_t len, field_t* fields, int max_fields) { \
+    if (max_fields <= 0) { \
+        return 0; \
+    } \
+    PROF_SAMPLE_BEGIN(split_start, PROF_SPLIT); \
+    char* start = line; \
+    int count = 0; \
+    for (size_t base = 0; base < len; base += PARSE_BLOCK) { \
+        for (unsigned int mask = PARSE_MASK_AT(line, len, base, DELIM); mask; mask &= mask - 1) { \
+            char* q = line + base + __builtin_ctz(mask); \
+            fields[count].ptr = start; \
+            fields[count].len = q - start; \
+            start = q + 1; \
+            if (++count == max_fields) { \
+                PROF_SAMPLE_END(split_start, PROF_SPLIT, len); \
+                return count; \
+            } \
+        } \
+    } \
+    fields[count].ptr = start; \
+    fields[count].len = line + len - start; \
+    PROF_SAMPLE_END(split_start, PROF_SPLIT, len); \
+    return count + 1; \
+} \
+\
+int count_##name(const char* line, size_t len) { \
+    PROF_SAMPLE_BEGIN(split_start, PROF_SPLIT); \
+    int count = 1; \
+    for (size_t base = 0; base < len; base += PARSE_BLOCK) { \
+        count += __builtin_popcount(PARSE_MASK_AT(line, len, base, DELIM)); \
+    } \
+    PROF_SAMPLE_END(split_start, PROF_SPLIT, len); \
+    return count; \
+} \
+\
+void field_at_##name(char* line, size_t len, int index, field_t* field) { \
+    PROF_SAMPLE_BEGIN(split_start, PROF_SPLIT); \
+    char* start = line; \
+    int i = 0; \
+    for (size_t base = 0; base < len; base += PARSE_BLOCK) { \
+        unsigned int mask = PARSE_MASK_AT(line, len, base, DELIM); \
+        int hits = __builtin_popcount(mask); \
+        if (i + hits <= index) { \
+            if (hits) { \
+                i += hits; \
+                start = line + base + (31 - __builtin_clz(mask)) + 1; \
+            } \
+            continue; \
+        } \
+        for (; mask; mask &= mask - 1) { \
+            char* q = line + base + __builtin_ctz(mask); \
+            if (i == index) { \
+                field->ptr = start; \
+                field->len = q - start; \
+                PROF_SAMPLE_END(split_start, PROF_SPLIT, len); \
+                return; \
+            } \
+            i++; \
+            start = q + 1; \
+        } \
+    } \
+    field->ptr = (i == index) ? start : line + len; \
+    field->len = (i == index) ? (size_t)(line + len - start) : 0; \
+    PROF_SAMPLE_END(split_start, PROF_SPLIT, len); \
+}
+
+DEFINE_PARSE_KERNEL(tab, '\t')
+DEFINE_PARSE_KERNEL(comma, ',')
+DEFINE_PARSE_KERNEL(semicolon, ';')
+DEFINE_PARSE_KERNEL(pipe, '|')
+DEFINE_PARSE_KERNEL(space, ' ')
+DEFINE_PARSE_KERNEL(none, '\0')
+
+// 多空格分隔：连续空格视为一个分隔符，忽略行首行尾空格。
+// 字段的起止正好是空格与非空格的交界，由空格掩码与其左移一位的异或得到，起止交替出现
+int split_multispace(char* line, size_t len, field_t* fields, int max_fields) {
+    if (max_fields <= 0) {
+        return 0;
+    }
+    PROF_SAMPLE_BEGIN(split_start, PROF_SPLIT);
+    char* start = NULL;         // 当前字段的起点，NULL 表示位于空格中
+    unsigned int carry = 1;     // 上一块最后一个字节是否为空格，行首视为空格
+    int count = 0;
+    for (size_t base = 0; base < len; base += PARSE_BLOCK) {
+        unsigned int space = PARSE_MASK_AT(line, len, base, ' ');
+        unsigned int edges = (space ^ ((space << 1) | carry)) & PARSE_VALID_MASK(len, base);
+        carry = (space >> (PARSE_BLOCK - 1)) & 1;
+        for (; edges; edges &= edges - 1) {
+            char* q = line + base + __builtin_ctz(edges);
+            if (!start) {
+                start = q;
+                continue;
+            }
+            fields[count].ptr = start;
+            fields[count].len = q - start;
+            start = NULL;
+            if (++count == max_fields) {
+                PROF_SAMPLE_END(split_start, PROF_SPLIT, len);
+                return count;
+            }
+        }
+    }
+    if (start) {
+        fields[count].ptr = start;
+        fields[count].len = line + len - start;
+        count++;
+    }
+    PROF_SAMPLE_END(split_start, PROF_SPLIT, len);
+    return count;
+}
+
+int count_multispace(const char* line, size_t len) {
+    PROF_SAMPLE_BEGIN(split_start, PROF_SPLIT);
+    unsigned int carry = 1;
+    int count = 0;
+    for (size_t base = 0; base < len; base += PARSE_BLOCK) {
+        unsigned int space = PARSE_MASK_AT(line, len, base, ' ');
+        // 前一个字节是空格、本字节不是空格的位置即字段起点
+        count += __builtin_popcount(~space & ((space << 1) | carry) & PARSE_VALID_MASK(len, base));
+        carry = (space >> (PARSE_BLOCK - 1)) & 1;
+    }
+    PROF_SAMPLE_END(split_start, PROF_SPLIT, len);
+    return count;
+}
+
+void field_at_multispace(char* line, size_t len, int index, field_t* field) {
+    PROF_SAMPLE_BEGIN(split_start, PROF_SPLIT);
+    char* start = NULL;
+    unsigned int carry = 1;
+    int i = 0;
+    for (size_t base = 0; base < len; base += PARSE_BLOCK) {
+        unsigned int space = PARSE_MASK_AT(line, len, base, ' ');
+        unsigned int edges = (space ^ ((space << 1) | carry)) & PARSE_VALID_MASK(len, base);
+        carry = (space >> (PARSE_BLOCK - 1)) & 1;
+        for (; edges; edges &= edges - 1) {
+            char* q = line + base + __builtin_ctz(edges);
+            if (!start) {
+                start = q;
+                continue;
+            }
+            if (i == index) {
+                field->ptr = start;
+                field->len = q - start;
+                PROF_SAMPLE_END(split_start, PROF_SPLIT, len);
+                return;
+            }
+            i++;
+            start = NULL;
+        }
+    }
+    field->ptr = (start && i == index) ? start : line + len;
+    field->len = (start && i == index) ? (size_t)(line + len - start) : 0;
+    PROF_SAMPLE_END(split_start, PROF_SPLIT, len);
+}
+
+int table_open(table_reader_t* table, const char* filename) {
+    if (line_reader_open(&table->reader, filename) != 0) {
+        return -1;
+    }
+    table->delim_type = detect_delimiter(filename, &table->delim_char);
+    table->multispace = (table->delim_type == DELIM_MULTISPACE);
+    table->kernel = parse_kernel_select(table->delim_char, table->multispace);
+    table->names = NULL;
+    table->num_columns = 0;
+    table->first_row = 0;
+    table->include_header = 1;
+
+    // 读取表头，保存原文和各列名称（之后的读取会覆盖行缓冲区）
+    size_t len = 0;
+    char* line = line_reader_next(&table->reader, &len);
+    table->header_line = arena_strndup(&g_run_arena, line ? line : "", len);
+    table->header_len = len;
+    table->data_start = line_reader_tell(&table->reader);
+    table->file_size = get_file_size(filename);
+    table->data_end = table->reader.raw ? -1 : table->file_size;
+    if (!line) {
+        return 0;
+    }
+
+    int cap = count_char_occurrences(line, table->multispace ? ' ' : table->delim_char) + 1;
+    field_t* fields = xmalloc(cap * sizeof(field_t));
+    table->num_columns = split_fields(line, len, table->delim_char, table->multispace, fields, cap);
+    table->names = arena_alloc(&g_run_arena, table->num_columns * sizeof(char*));
+    for (int i = 0; i < table->num_columns; i++) {
+        const char* start = fields[i].ptr;
+        const char* end = start + fields[i].len;
+        while (start < end && isspace((unsigned char)*start)) start++;
+        while (end > start && isspace((unsigned char)end[-1])) end--;
+        table->names[i] = intern_string(start, end - start);
+    }
+    free(fields);
+    return 0;
+}
+
+int table_find_column(const table_reader_t* table, const char* spec) {
+    // $N 表示第N列
+    if (spec[0] == '$' && spec[1] && strspn(spec + 1, "0123456789") == strlen(spec + 1)) {
+        return atoi(spec + 1) - 1;
+    }
+    
+    // 列名完全匹配（不区分大小写）优先
+    for (int i = 0; i < table->num_columns; i++) {
+        if (strcasecmp(table->names[i], spec) == 0) {
+            return i;
+        }
+    }
+    
+    // 纯数字视为列号
+    if (spec[0] && strspn(spec, "0123456789") == strlen(spec)) {
+        return atoi(spec) - 1;
+    }
+    
+    // 最后尝试模糊匹配（包含关系）
+    size_t spec_len = strlen(spec);
+    for (int i = 0; i < table->num_columns; i++) {
+        size_t name_len = strlen(table->names[i]);
+        for (size_t j = 0; j + spec_len <= name_len; j++) {
+            if (strncasecmp(table->names[i] + j, spec, spec_len) == 0) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+int table_parse_columns(const table_reader_t* table, const char* spec, int* indices, int max_indices) {
+    char* spec_copy = arena_strndup(&g_run_arena, spec, strlen(spec));
+    
+    int count = 0;
+    char* token = strtok(spec_copy, ",");
+    while (token != NULL && count < max_indices) {
+        trim_whitespace(token);
+        int index = table_find_column(table, token);
+        if (index < 0) {
+            fprintf(stderr, "错误: 找不到列: %s\n", token);
+            return -1;
+        }
+        indices[count++] = index;
+        token = strtok(NULL, ",");
+    }
+    return count;
+}
+
+void table_close(table_reader_t* table) {
+    // 表头和列名在运行期内存池中，退出时统一释放
+    line_reader_close(&table->reader);
+}
+
+int table_apply_window(table_reader_t* table) {
+    if (!g_options.range && !g_options.rows) {
+        return 0;
+    }
+    long long header_end = table->data_start;
+    long long from, to;
+    
+    if (g_options.range) {
+        // 字节范围：与多线程分块规则相同，行属于其起始字节所在的范围
+        if (parse_span(g_options.range, "--range", &from, &to) != 0) {
+            g_exit_status = 1;
+            return -1;
+        }
+        if (from < 0) from = 0;
+        if (to >= 0 && to < from) {
+            fprintf(stderr, "错误: --range 的结束位置不能小于起始位置\n");
+            g_exit_status = 1;
+            return -1;
+        }
+        // 转码输入的偏移按转码后计算，事先不知道总长度，不检查
+        if (!table->reader.raw && from > table->file_size) {
+            fprintf(stderr, "错误: --range 的起始位置 %lld 超出文件大小 %lld\n", from, table->file_size);
+            g_exit_status = 1;
+            return -1;
+        }
+        if (to >= 0 && (table->data_end < 0 || to < table->data_end)) table->data_end = to;
+        table->include_header = (from == 0);
+        table->first_row = (from <= header_end) ? 0 : -1;
+        if (from > header_end) table->data_start = from;
+    } else {
+        // 行范围：数据行从1开始编号，a:b 包含两端，先顺序扫描找到对应的字节位置
+        if (parse_span(g_options.rows, "--rows", &from, &to) != 0) {
+            g_exit_status = 1;
+            return -1;
+        }
+        if (from < 1) from = 1;
+        if (to >= 0 && to < from) {
+            fprintf(stderr, "错误: --rows 的结束行不能小于起始行\n");
+            g_exit_status = 1;
+            return -1;
+        }
+        long long row = 0;
+        long long start = -1;
+        long long end = -1;
+        size_t len;
+        for (;;) {
+            long long pos = line_reader_tell(&table->reader);
+            if (row + 1 == from) start = pos;
+            if (to >= 0 && row == to) {
+                end = pos;
+                break;
+            }
+            if (!line_reader_next(&table->reader, &len)) {
+                break;
+            }
+            row++;
+        }
+        if (start < 0) start = end = line_reader_tell(&table->reader);
+        table->include_header = (from == 1);
+        table->first_row = from - 1;
+        table->data_start = start;
+        if (end >= 0) table->data_end = end;
+    }
+    
+    if (table->data_end >= 0 && table->data_end < table->data_start) {
+        table->data_end = table->data_start;
+    }
+    if (line_reader_seek(&table->reader, table->data_start, table->data_end) != 0) {
+        fprintf(stderr, "错误: 无法定位到数据范围\n");
+        g_exit_status = 1;
+        return -1;
+    }
+    return 0;
+}
+
+long long table_data_size(const table_reader_t* table) {
+    // 转码输入只能用原始文件大小估计
+    long long end = table->data_end >= 0 ? table->data_end : table->file_size;
+    return end > table->data_start ? end - table->data_start : 0;
+}
+
+int parse_offset(const char* text, long long* value) {
+    // 非负整数，可带 K/M/G 后缀（按1024计）
+    char* endptr;
+    long long n = strtoll(text, &endptr, 10);
+    if (endptr == text || n < 0) {
+        return -1;
+    }
+    switch (toupper((unsigned char)*endptr)) {
+        case 'K': n <<= 10; endptr++; break;
+        case 'M': n <<= 20; endptr++; break;
+        case 'G': n <<= 30; endptr++; break;
+        default: break;
+    }
+    if (toupper((unsigned char)*endptr) == 'B') endptr++;
+    if (*endptr != '\0') {
+        return -1;
+    }
+    *value = n;
+    return 0;
+}
+
+int parse_span(const char* text, const char* option, long long* from, long long* to) {
+    // start:end，两端都可以省略；end 为 -1 表示到文件末尾
+    const char* colon = strchr(text, ':');
+    char first[64];
+    *from = -1;
+    *to = -1;
+    if (!colon || (size_t)(colon - text) >= sizeof(first)) {
+        fprintf(stderr, "错误: %s 的格式为 起始:结束，如 0:1G\n", option);
+        return -1;
+    }
+    memcpy(first, text, colon - text);
+    first[colon - text] = '\0';
+    if ((first[0] && parse_offset(first, from) != 0) || (colon[1] && parse_offset(colon + 1, to) != 0)) {
+        fprintf(stderr, "错误: %s 的格式为 起始:结束，如 0:1G\n", option);
+        return -1;
+    }
+    return 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    if (!arena->head || arena->head->used + size > arena->head->cap) {
+        size_t cap = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        arena_block_t* block = xmalloc(sizeof(arena_block_t) + cap);
+        block->next = arena->head;
+        block->used = 0;
+        block->cap = cap;
+        arena->head = block;
+        arena->total += sizeof(arena_block_t) + cap;
+    }
+    void* ptr = arena->head->data + arena->head->used;
+    arena->head->used += size;
+    return ptr;
+}
+
+void arena_free(arena_t* arena) {
+    arena_block_t* block = arena->head;
+    while (block) {
+        arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->total = 0;
+}
+
+char* arena_strndup(arena_t* arena, const char* str, size_t len) {
+    char* copy = arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+const char* intern_string(const char* str, size_t len) {
+    intern_table_t* table = &g_strings;
+    if ((table->count + 1) * 10 > table->slot_cap * 7) {
+        // 旧槽位数组留在内存池中，随退出一起释放
+        size_t cap = table->slot_cap ? table->slot_cap * 2 : 256;
+        intern_slot_t* slots = arena_alloc(&g_run_arena, cap * sizeof(intern_slot_t));
+        memset(slots, 0, cap * sizeof(intern_slot_t));
+        for (size_t i = 0; i < table->slot_cap; i++) {
+            if (table->slots[i].str) {
+                size_t j = (size_t)table->slots[i].hash & (cap - 1);
+                while (slots[j].str) {
+                    j = (j + 1) & (cap - 1);
+                }
+                slots[j] = table->slots[i];
+            }
+        }
+        table->slots = slots;
+        table->slot_cap = cap;
+    }
+
+    uint64_t hash = hash_bytes(str, len, 0);
+    size_t mask = table->slot_cap - 1;
+    size_t i = (size_t)hash & mask;
+    while (table->slots[i].str) {
+        const intern_slot_t* slot = &table->slots[i];
+        if (slot->hash == hash && slot->len == len && memcmp(slot->str, str, len) == 0) {
+            return slot->str;
+        }
+        i = (i + 1) & mask;
+    }
+    intern_slot_t* slot = &table->slots[i];
+    slot->hash = hash;
+    slot->str = arena_strndup(&g_run_arena, str, len);
+    slot->len = len;
+    table->count++;
+    return slot->str;
+}
+
+void run_memory_release(void) {
+    arena_free(&g_run_arena);
+    memset(&g_strings, 0, sizeof(g_strings));
+}
+
+uint64_t hash_bytes(const void* data, size_t len, uint64_t seed) {
+    PROF_SAMPLE_BEGIN(hash_start, PROF_HASH);
+    const unsigned char* p = data;
+    uint64_t h = seed ^ (len * 0x9E3779B97F4A7C15ULL);
+    uint64_t k;
+    
+    // 每次处理8字节，末尾不足8字节补零
+    while (len >= 8) {
+        memcpy(&k, p, 8);
+        k *= 0xBF58476D1CE4E5B9ULL;
+        k ^= k >> 31;
+        h = (h ^ k) * 0x94D049BB133111EBULL;
+        p += 8;
+        len -= 8;
+    }
+    k = 0;
+    memcpy(&k, p, len);
+    h = (h ^ k) * 0xBF58476D1CE4E5B9ULL;
+    
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    PROF_SAMPLE_END(hash_start, PROF_HASH, (size_t)(p - (const unsigned char*)data) + len);
+    return h;
+}
+
+long long get_file_size(const char* filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return -1;
+    }
+    return (long long)st.st_size;
+}
+
+int parse_size(const char* text, size_t* size) {
+    char* endptr;
+    double value = strtod(text, &endptr);
+    if (endptr == text || value <= 0) {
+        return -1;
+    }
+    switch (toupper((unsigned char)*endptr)) {
+        case 'K': value *= 1024.0; endptr++; break;
+        case 'M': value *= 1024.0 * 1024; endptr++; break;
+        case 'G': value *= 1024.0 * 1024 * 1024; endptr++; break;
+        default: break;
+    }
+    if (toupper((unsigned char)*endptr) == 'B') endptr++;
+    if (*endptr != '\0') {
+        return -1;
+    }
+    *size = (size_t)value;
+    return 0;
+}
+
+int parse_global_options(int* argc, char** argv) {
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--", 2) != 0 || arg[2] == '\0') {
+            argv[out++] = argv[i];
+            continue;
+        }
+        
+        // 支持 --name value 和 --name=value 两种写法；开关类选项只接受 --name=value
+        const char* name = arg + 2;
+        const char* value = strchr(name, '=');
+        size_t name_len = value ? (size_t)(value - name) : strlen(name);
+        int is_switch = (name_len == 7 && strncmp(name, "profile", 7) == 0) ||
+                        (name_len == 6 && strncmp(name, "follow", 6) == 0) ||
+                        (name_len == 5 && strncmp(name, "fuzzy", 5) == 0) ||
+                        (name_len == 7 && strncmp(name, "summary", 7) == 0);
+        if (value) {
+            value++;
+        } else if (!is_switch && i + 1 < *argc) {
+            value = argv[++i];
+        }
+        
+        if (name_len == 7 && strncmp(name, "threads", 7) == 0) {
+            if (!value || atoi(value) <= 0) {
+                fprintf(stderr, "错误: --threads 需要正整数\n");
+                return -1;
+            }
+            g_options.threads = atoi(value);
+            if (g_options.threads > MAX_THREADS) g_options.threads = MAX_THREADS;
+        } else if (name_len == 3 && strncmp(name, "mem", 3) == 0) {
+            if (!value || parse_size(value, &g_options.mem_budget) != 0) {
+                fprintf(stderr, "错误: --mem 需要内存大小，如 512M、2G\n");
+                return -1;
+            }
+        } else if (name_len == 5 && strncmp(name, "range", 5) == 0) {
+            if (!value || !strchr(value, ':')) {
+                fprintf(stderr, "错误: --range 的格式为 起始:结束，如 0:1G\n");
+                return -1;
+            }
+            g_options.range = value;
+        } else if (name_len == 4 && strncmp(name, "rows", 4) == 0) {
+            if (!value || !strchr(value, ':')) {
+                fprintf(stderr, "错误: --rows 的格式为 起始:结束，如 1:1000000\n");
+                return -1;
+            }
+            g_options.rows = value;
+        } else if (name_len == 5 && strncmp(name, "state", 5) == 0) {
+            if (!value || !*value) {
+                fprintf(stderr, "错误: --state 需要文件路径\n");
+                return -1;
+            }
+            g_options.state = value;
+        } else if (name_len == 8 && strncmp(name, "encoding", 8) == 0) {
+            if (!value || !*value) {
+                fprintf(stderr, "错误: --encoding 需要编码名称，如 gbk、utf-16le\n");
+                return -1;
+            }
+            g_options.encoding = value;
+        } else if (name_len == 6 && strncmp(name, "follow", 6) == 0) {
+            g_options.follow = 1;
+        } else if (name_len == 8 && strncmp(name, "interval", 8) == 0) {
+            double seconds = value ? atof(value) : 0;
+            if (seconds <= 0) {
+                fprintf(stderr, "错误: --interval 需要正数秒数\n");
+                return -1;
+            }
+            g_options.interval_ms = (int)(seconds * 1000);
+            if (g_options.interval_ms < 1) g_options.interval_ms = 1;
+        } else if (name_len == 10 && strncmp(name, "checkpoint", 10) == 0) {
+            if (!value || !*value) {
+                fprintf(stderr, "错误: --checkpoint 需要文件路径\n");
+                return -1;
+            }
+            g_options.checkpoint = value;
+        } else if (name_len == 2 && strncmp(name, "by", 2) == 0) {
+            if (!value || !*value) {
+                fprintf(stderr, "错误: --by 需要列名或列号，如 id,sample\n");
+                return -1;
+            }
+            g_options.by_columns = value;
+        } else if (name_len == 5 && strncmp(name, "fuzzy", 5) == 0) {
+            g_options.fuzzy = value ? atof(value) : FUZZY_DEFAULT_THRESHOLD;
+            if (g_options.fuzzy <= 0 || g_options.fuzzy > 1) {
+                fprintf(stderr, "错误: --fuzzy 的相似度阈值应在0到1之间，如 --fuzzy=0.8\n");
+                return -1;
+            }
+        } else if (name_len == 7 && strncmp(name, "summary", 7) == 0) {
+            g_options.check_summary = 1;
+        } else if (name_len == 10 && strncmp(name, "max-errors", 10) == 0) {
+            if (!value || atoll(value) <= 0) {
+                fprintf(stderr, "错误: --max-errors 需要正整数\n");
+                return -1;
+            }
+            g_options.max_errors = atoll(value);
+        } else if (name_len == 8 && strncmp(name, "examples", 8) == 0) {
+            if (!value || atoi(value) < 0) {
+                fprintf(stderr, "错误: --examples 需要非负整数\n");
+                return -1;
+            }
+            g_options.examples = atoi(value);
+        } else if (name_len == 9 && strncmp(name, "normalize", 9) == 0) {
+            if (!value || !*value) {
+                fprintf(stderr, "错误: --normalize 需要规范化方式，如 trim,case 或 none\n");
+                return -1;
+            }
+            g_options.normalize = value;
+        } else if (name_len == 6 && strncmp(name, "ignore", 6) == 0) {
+            if (!value || !*value) {
+                fprintf(stderr, "错误: --ignore 需要列名或列号，如 id,date\n");
+                return -1;
+            }
+            g_options.ignore_columns = value;
+        } else if (name_len == 6 && strncmp(name, "format", 6) == 0) {
+            if (value && strcmp(value, "text") == 0) {
+                g_options.format = FORMAT_TEXT;
+            } else if (value && strcmp(value, "json") == 0) {
+                g_options.format = FORMAT_JSON;
+            } else if (value && strcmp(value, "ndjson") == 0) {
+                g_options.format = FORMAT_NDJSON;
+            } else {
+                fprintf(stderr, "错误: --format 只支持 text、json 或 ndjson\n");
+                return -1;
+            }
+        } else if (name_len == 7 && strncmp(name, "profile", 7) == 0) {
+            if (!value || strcmp(value, "text") == 0) {
+                g_options.profile = 1;
+            } else if (strcmp(value, "json") == 0) {
+                g_options.profile = 2;
+            } else {
+                fprintf(stderr, "错误: --profile 只支持 text 或 json\n");
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "错误: 未知选项: %s\n", arg);
+            return -1;
+        }
+    }
+    argv[out] = NULL;
+    *argc = out;
+    if (g_options.range && g_options.rows) {
+        fprintf(stderr, "错误: --range 和 --rows 不能同时使用\n");
+        return -1;
+    }
+    if ((g_options.range || g_options.rows || g_options.state) && (g_options.follow || g_options.checkpoint)) {
+        fprintf(stderr, "错误: --range/--rows/--state 不能与 --follow/--checkpoint 同时使用\n");
+        return -1;
+    }
+    if ((g_options.check_summary || g_options.max_errors) && (g_options.state || g_options.follow || g_options.checkpoint)) {
+        fprintf(stderr, "错误: --summary/--max-errors 不能与 --state/--follow/--checkpoint 同时使用\n");
+        return -1;
+    }
+    if ((g_options.normalize || g_options.ignore_columns) && g_options.fuzzy <= 0) {
+        fprintf(stderr, "错误: --normalize/--ignore 需要与 --fuzzy 一起使用\n");
+        return -1;
+    }
+    return 0;
+}
+
+int choose_thread_count(long long data_size) {
+    int threads = g_options.threads;
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    
+    // 数据量太小时多线程得不偿失
+    long long max_threads = data_size / MIN_THREAD_CHUNK + 1;
+    if (threads > max_threads) threads = (int)max_threads;
+    return threads;
+}
+
+void run_workers(void* (*worker)(void*), void* args, size_t arg_size, int count) {
+    if (count == 1) {
+        worker(args);
+        return;
+    }
+    pthread_t tids[MAX_THREADS];
+#ifdef DD_PROFILE
+    profile_task_t tasks[MAX_THREADS];
+    for (int i = 0; i < count; i++) {
+        tasks[i].worker = worker;
+        tasks[i].arg = (char*)args + i * arg_size;
+    }
+    worker = profile_worker_main;
+    args = tasks;
+    arg_size = sizeof(profile_task_t);
+#endif
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&tids[i], NULL, worker, (char*)args + i * arg_size) != 0) {
+            fprintf(stderr, "错误: 无法创建线程\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(tids[i], NULL);
+    }
+}
+
+FILE* create_temp_file(void) {
+    // 优先使用TMPDIR指定的目录，创建后立即删除目录项，关闭时自动回收
+    const char* dir = getenv("TMPDIR");
+    if (!dir || !*dir) {
+        dir = "/tmp";
+    }
+    char path[MAX_FILENAME * 4];
+    snprintf(path, sizeof(path), "%s/detect_delim_XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return tmpfile();
+    }
+    unlink(path);
+    FILE* file = fdopen(fd, "w+b");
+    if (!file) {
+        close(fd);
+    }
+    return file;
+}
+
+void copy_stream(FILE* in, FILE* out) {
+    char buffer[65536];
+    size_t n;
+    rewind(in);
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        fwrite(buffer, 1, n, out);
+    }
+}
+
+void chunk_output_init(chunk_output_t* out, size_t limit) {
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+    out->limit = limit > OUT_BUFFER_SIZE ? limit : OUT_BUFFER_SIZE;
+    out->spill = NULL;
+}
+
+void chunk_output_write(chunk_output_t* out, const char* data, size_t len) {
+    if (out->len + len > out->cap) {
+        if (out->len + len > out->limit) {
+            // 超过内存限额：已有内容写入临时文件，保持顺序
+            if (!out->spill) {
+                out->spill = create_temp_file();
+                if (!out->spill) {
+                    fprintf(stderr, "错误: 无法创建临时文件\n");
+                    exit(1);
+                }
+            }
+            fwrite(out->data, 1, out->len, out->spill);
+            out->len = 0;
+            if (len > out->cap) {
+                fwrite(data, 1, len, out->spill);
+                return;
+            }
+        } else {
+            size_t cap = out->cap ? out->cap : OUT_BUFFER_SIZE;
+            while (cap < out->len + len) cap *= 2;
+            out->cap = cap < out->limit ? cap : out->limit;
+            out->data = xrealloc(out->data, out->cap);
+        }
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+}
+
+void chunk_output_drain(chunk_output_t* out, FILE* dest, long long* number) {
+    if (out->spill) {
+        fwrite(out->data, 1, out->len, out->spill);
+        out->len = 0;
+        if (!number) {
+            copy_stream(out->spill, dest);
+        } else {
+            char* line = NULL;
+            size_t cap = 0;
+            ssize_t n;
+            rewind(out->spill);
+            while ((n = getline(&line, &cap, out->spill)) > 0) {
+                fprintf(dest, "%lld: ", (*number)++);
+                fwrite(line, 1, n, dest);
+            }
+            free(line);
+        }
+        fclose(out->spill);
+    }
+    if (!number) {
+        fwrite(out->data, 1, out->len, dest);
+    } else {
+        // 每行加上编号
+        size_t pos = 0;
+        while (pos < out->len) {
+            const char* nl = memchr(out->data + pos, '\n', out->len - pos);
+            size_t stop = nl ? (size_t)(nl - out->data) + 1 : out->len;
+            fprintf(dest, "%lld: ", (*number)++);
+            fwrite(out->data + pos, 1, stop - pos, dest);
+            pos = stop;
+        }
+    }
+    free(out->data);
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+}
+
+void out_buffer_init(out_buffer_t* buf, FILE* out) {
+    buf->out = out;
+    buf->data = xmalloc(OUT_BUFFER_SIZE);
+    buf->len = 0;
+}
+
+void out_buffer_write(out_buffer_t* buf, const char* data, size_t len) {
+    if (len > OUT_BUFFER_SIZE - buf->len) {
+        PROF_BEGIN(write_start);
+        fwrite(buf->data, 1, buf->len, buf->out);
+        PROF_END(write_start, PROF_WRITE, buf->len);
+        buf->len = 0;
+        if (len >= OUT_BUFFER_SIZE) {
+            fwrite(data, 1, len, buf->out);
+            return;
+        }
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+void out_buffer_close(out_buffer_t* buf) {
+    fwrite(buf->data, 1, buf->len, buf->out);
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+}
+
+void profile_start(void) {
+#ifdef DD_PROFILE
+    g_prof_start_ticks = profile_ticks();
+    g_prof_start_ns = profile_clock_ns();
+    
+    // 用自定义流替换stdout，统计实际写出的字节数和耗时
+    cookie_io_functions_t io = { NULL, profile_stdout_write, NULL, NULL };
+    FILE* out = fopencookie(NULL, "w", io);
+    if (out) {
+        setvbuf(out, NULL, _IOFBF, 1 << 16);
+        fflush(stdout);
+        stdout = out;
+    }
+    atexit(profile_report);
+#else
+    fprintf(stderr, "警告: 未启用性能剖析，请使用 make profile 重新编译\n");
+#endif
+}
+
+void profile_report(void) {
+#ifdef DD_PROFILE
+    fflush(stdout);
+    profile_flush_thread();
+    
+    // 用墙钟时间校准时钟周期，rdtsc不可用时两者一致
+    uint64_t elapsed_ns = profile_clock_ns() - g_prof_start_ns;
+    uint64_t elapsed_ticks = profile_ticks() - g_prof_start_ticks;
+    double ns_per_tick = elapsed_ticks > 0 ? (double)elapsed_ns / elapsed_ticks : 1.0;
+    double total = elapsed_ns / 1e9;
+    const profile_counters_t* c = &g_prof_total;
+    
+    double seconds[PROF_NUM_PHASES];
+    double accounted = 0;
+    for (int i = 0; i < PROF_NUM_PHASES; i++) {
+        // 抽样计时的阶段按总调用次数折算
+        double ticks = (double)c->ticks[i];
+        if (c->sampled[i] > 0 && c->sampled[i] < c->calls[i]) {
+            ticks *= (double)c->calls[i] / c->sampled[i];
+        }
+        seconds[i] = ticks * ns_per_tick / 1e9;
+        accounted += seconds[i];
+    }
+    double other = total > accounted ? total - accounted : 0;
+    
+    if (g_options.profile == 2) {
+        fprintf(stderr, "{\"elapsed_seconds\":%.6f,\"rows\":%llu,\"allocations\":%llu,\"allocated_bytes\":%llu,"
+                "\"arena_bytes\":%llu,\"interned_strings\":%llu,\"phases\":{",
+                total, (unsigned long long)c->rows, (unsigned long long)c->allocs,
+                (unsigned long long)c->alloc_bytes, (unsigned long long)g_run_arena.total,
+                (unsigned long long)g_strings.count);
+        for (int i = 0; i < PROF_NUM_PHASES; i++) {
+            double mb_per_s = seconds[i] > 0 ? c->bytes[i] / seconds[i] / (1024.0 * 1024) : 0;
+            fprintf(stderr, "\"%s\":{\"seconds\":%.6f,\"share\":%.4f,\"calls\":%llu,\"bytes\":%llu,\"mb_per_s\":%.1f},",
+                    prof_phase_keys[i], seconds[i], total > 0 ? seconds[i] / total : 0,
+                    (unsigned long long)c->calls[i], (unsigned long long)c->bytes[i], mb_per_s);
+        }
+        fprintf(stderr, "\"other\":{\"seconds\":%.6f,\"share\":%.4f}}}\n",
+                other, total > 0 ? other / total : 0);
+        return;
+    }
+    
+    char size_str[64];
+    fprintf(stderr, "\n=== 性能剖析 ===\n");
+    fprintf(stderr, "总耗时: %.3f 秒\n", total);
+    fprintf(stderr, "读取行数: %llu (%.0f 行/秒)\n", (unsigned long long)c->rows,
+            total > 0 ? c->rows / total : 0);
+    format_file_size((long)c->alloc_bytes, size_str);
+    fprintf(stderr, "内存分配: %llu 次, 共 %s\n", (unsigned long long)c->allocs, size_str);
+    format_file_size((long)g_run_arena.total, size_str);
+    fprintf(stderr, "运行期内存池: %s, 驻留字符串 %llu 个\n", size_str, (unsigned long long)g_strings.count);
+    for (int i = 0; i < PROF_NUM_PHASES; i++) {
+        if (c->calls[i] == 0) {
+            continue;
+        }
+        format_file_size((long)c->bytes[i], size_str);
+        fprintf(stderr, "  %s: %.3f 秒 (%.1f%%), %llu 次, %s, %.1f MB/s\n",
+                prof_phase_names[i], seconds[i], total > 0 ? seconds[i] * 100.0 / total : 0,
+                (unsigned long long)c->calls[i], size_str,
+                seconds[i] > 0 ? c->bytes[i] / seconds[i] / (1024.0 * 1024) : 0);
+    }
+    fprintf(stderr, "  其他: %.3f 秒 (%.1f%%)\n", other, total > 0 ? other * 100.0 / total : 0);
+    fprintf(stderr, "  (多线程时各阶段耗时为所有线程之和)\n");
+#endif
+}
+
+#ifdef DD_PROFILE
+uint64_t profile_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return profile_clock_ns();
+#endif
+}
+
+uint64_t profile_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void profile_add(prof_phase_t phase, uint64_t ticks, uint64_t bytes) {
+    g_prof_local.ticks[phase] += ticks;
+    g_prof_local.calls[phase]++;
+    g_prof_local.sampled[phase]++;
+    g_prof_local.bytes[phase] += bytes;
+}
+
+uint64_t profile_sample_begin(prof_phase_t phase) {
+    return (g_prof_local.calls[phase] & PROFILE_SAMPLE_MASK) == 0 ? profile_ticks() : 0;
+}
+
+void profile_sample_end(prof_phase_t phase, uint64_t start, uint64_t bytes) {
+    if (start) {
+        g_prof_local.ticks[phase] += profile_ticks() - start;
+        g_prof_local.sampled[phase]++;
+    }
+    g_prof_local.calls[phase]++;
+    g_prof_local.bytes[phase] += bytes;
+}
+
+void profile_flush_thread(void) {
+    pthread_mutex_lock(&g_prof_lock);
+    for (int i = 0; i < PROF_NUM_PHASES; i++) {
+        g_prof_total.ticks[i] += g_prof_local.ticks[i];
+        g_prof_total.calls[i] += g_prof_local.calls[i];
+        g_prof_total.sampled[i] += g_prof_local.sampled[i];
+        g_prof_total.bytes[i] += g_prof_local.bytes[i];
+    }
+    g_prof_total.rows += g_prof_local.rows;
+    g_prof_total.allocs += g_prof_local.allocs;
+    g_prof_total.alloc_bytes += g_prof_local.alloc_bytes;
+    pthread_mutex_unlock(&g_prof_lock);
+    memset(&g_prof_local, 0, sizeof(g_prof_local));
+}
+
+void* profile_worker_main(void* arg) {
+    profile_task_t* task = arg;
+    void* result = task->worker(task->arg);
+    profile_flush_thread();
+    return result;
+}
+
+ssize_t profile_stdout_write(void* cookie, const char* data, size_t size) {
+    (void)cookie;
+    PROF_BEGIN(write_start);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(STDOUT_FILENO, data + done, size - done);
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    PROF_END(write_start, PROF_WRITE, done);
+    return done > 0 ? (ssize_t)done : -1;
+}
+#endif
+
+void json_init(json_writer_t* json, FILE* out, int ndjson) {
+    json->out = out;
+    json->ndjson = ndjson;
+    json->depth = 0;
+    json->need_comma[0] = 0;
+}
+
+void json_write_key(json_writer_t* json, const char* key) {
+    // 同一层的后续元素前加逗号；ndjson顶层对象之间用换行分隔
+    if (json->need_comma[json->depth]) {
+        putc(',', json->out);
+    }
+    json->need_comma[json->depth] = !(json->ndjson && json->depth == 0);
+    if (key) {
+        putc('"', json->out);
+        json_write_escaped(json->out, key, strlen(key));
+        fputs("\":", json->out);
+    }
+}
+
+void json_begin_object(json_writer_t* json, const char* key) {
+    json_write_key(json, key);
+    putc('{', json->out);
+    if (json->depth + 1 < JSON_MAX_DEPTH) json->depth++;
+    json->need_comma[json->depth] = 0;
+}
+
+void json_end_object(json_writer_t* json) {
+    putc('}', json->out);
+    if (json->depth > 0) json->depth--;
+    if (json->depth == 0) {
+        putc('\n', json->out);
+    }
+}
+
+void json_begin_array(json_writer_t* json, const char* key) {
+    json_write_key(json, key);
+    putc('[', json->out);
+    if (json->depth + 1 < JSON_MAX_DEPTH) json->depth++;
+    json->need_comma[json->depth] = 0;
+}
+
+void json_end_array(json_writer_t* json) {
+    putc(']', json->out);
+    if (json->depth > 0) json->depth--;
+}
+
+void json_string(json_writer_t* json, const char* key, const char* str, size_t len) {
+    json_write_key(json, key);
+    putc('"', json->out);
+    json_write_escaped(json->out, str, len);
+    putc('"', json->out);
+}
+
+void json_cstring(json_writer_t* json, const char* key, const char* str) {
+    json_string(json, key, str, strlen(str));
+}
+
+void json_int(json_writer_t* json, const char* key, long long value) {
+    json_write_key(json, key);
+    fprintf(json->out, "%lld", value);
+}
+
+void json_double(json_writer_t* json, const char* key, double value) {
+    json_write_key(json, key);
+    fprintf(json->out, "%.6g", value);
+}
+
+void json_bool(json_writer_t* json, const char* key, int value) {
+    json_write_key(json, key);
+    fputs(value ? "true" : "false", json->out);
+}
+
+void json_write_escaped(FILE* out, const char* str, size_t len) {
+    // 不需要转义的连续字节整段写出，只有引号、反斜杠和控制字符逐个处理；
+    // JSON 必须是有效的UTF-8，无效的字节序列替换为 U+FFFD
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* p = (const unsigned char*)str;
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = p[i];
+        if (c >= 0x80) {
+            size_t invalid;
+            size_t n = utf8_char_length(p + i, len - i, &invalid);
+            if (n > 0) {
+                i += n - 1;
+                continue;
+            }
+            if (i > start) {
+                fwrite(str + start, 1, i - start, out);
+            }
+            fputs("\\ufffd", out);
+            i += invalid - 1;
+            start = i + 1;
+            continue;
+        }
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        if (i > start) {
+            fwrite(str + start, 1, i - start, out);
+        }
+        start = i + 1;
+        switch (c) {
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default: {
+                char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+                fwrite(esc, 1, sizeof(esc), out);
+                break;
+            }
+        }
+    }
+    if (len > start) {
+        fwrite(str + start, 1, len - start, out);
+    }
+}
+
+int serve_main(const char* socket_path) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "错误: 套接字路径过长: %s\n", socket_path);
+        return 1;
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "错误: 无法创建套接字: %s\n", strerror(errno));
+        return 1;
+    }
+    // 上次异常退出留下的套接字文件直接删除，其他类型的文件不动
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+        fprintf(stderr, "错误: 无法监听 %s: %s\n", socket_path, strerror(errno));
+        close(listen_fd);
+        return 1;
+    }
+    fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+
+    serve_t server;
+    memset(&server, 0, sizeof(server));
+    pthread_mutex_init(&server.cache.lock, NULL);
+    server.cache.budget = g_options.mem_budget;
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.cond, NULL);
+    pthread_mutex_init(&server.done_lock, NULL);
+    if (pipe(server.wake) != 0) {
+        fprintf(stderr, "错误: 无法创建管道: %s\n", strerror(errno));
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    fcntl(server.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(server.wake[1], F_SETFL, O_NONBLOCK);
+
+    // 请求都很短，工作线程数只由 --threads 或CPU核数决定
+    int threads = choose_thread_count((long long)MIN_THREAD_CHUNK * MAX_THREADS);
+    pthread_t tids[MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&tids[i], NULL, serve_worker_main, &server) != 0) {
+            fprintf(stderr, "错误: 无法创建线程\n");
+            exit(1);
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serve_signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "服务已启动: %s (%d 个工作线程)\n", socket_path, threads);
+
+    serve_conn_t* conns = xmalloc(SERVE_MAX_CONNS * sizeof(serve_conn_t));
+    memset(conns, 0, SERVE_MAX_CONNS * sizeof(serve_conn_t));
+    for (int i = 0; i < SERVE_MAX_CONNS; i++) {
+        conns[i].fd = -1;
+    }
+    struct pollfd fds[SERVE_MAX_CONNS + 2];
+    int slots[SERVE_MAX_CONNS + 2];
+
+    while (!g_serve_stop) {
+        int nfds = 2;
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = server.wake[0];
+        fds[1].events = POLLIN;
+        for (int i = 0; i < SERVE_MAX_CONNS; i++) {
+            if (conns[i].fd < 0) continue;
+            fds[nfds].fd = conns[i].fd;
+            fds[nfds].events = (conns[i].eof ? 0 : POLLIN) | (conns[i].out_pos < conns[i].out_len ? POLLOUT : 0);
+            slots[nfds++] = i;
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "错误: poll 失败: %s\n", strerror(errno));
+            break;
+        }
+
+        // 完成的响应按请求顺序追加到对应连接的输出缓冲区，连接已关闭的直接丢弃
+        if (fds[1].revents & POLLIN) {
+            char drain[256];
+            while (read(server.wake[0], drain, sizeof(drain)) > 0) {
+            }
+            pthread_mutex_lock(&server.done_lock);
+            serve_job_t* job = server.done;
+            server.done = server.done_tail = NULL;
+            pthread_mutex_unlock(&server.done_lock);
+            while (job) {
+                serve_job_t* next = job->next;
+                serve_conn_t* conn = &conns[job->conn];
+                if (conn->fd >= 0 && conn->generation == job->generation) {
+                    serve_conn_deliver(conn, job);
+                    if (serve_conn_flush(conn) != 0) {
+                        serve_conn_close(conn);
+                    }
+                } else {
+                    free(job->response);
+                    free(job);
+                }
+                job = next;
+            }
+        }
+
+        for (int k = 2; k < nfds; k++) {
+            serve_conn_t* conn = &conns[slots[k]];
+            if (conn->fd < 0) continue;
+            if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                serve_read(&server, conns, slots[k]);
+            }
+            if (conn->fd >= 0 && (fds[k].revents & POLLOUT) && serve_conn_flush(conn) != 0) {
+                serve_conn_close(conn);
+            }
+            // 客户端关闭写端后，等所有响应写完再关闭连接
+            if (conn->fd >= 0 && conn->eof && conn->pending == 0 && conn->out_pos == conn->out_len) {
+                serve_conn_close(conn);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            serve_accept(conns, listen_fd);
+        }
+    }
+
+    // 停止工作线程，未处理的请求直接丢弃
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.cond);
+    pthread_mutex_unlock(&server.lock);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    while (server.jobs) {
+        serve_job_t* next = server.jobs->next;
+        free(server.jobs->request);
+        free(server.jobs);
+        server.jobs = next;
+    }
+    while (server.done) {
+        serve_job_t* next = server.done->next;
+        free(server.done->response);
+        free(server.done);
+        server.done = next;
+    }
+    for (int i = 0; i < SERVE_MAX_CONNS; i++) {
+        if (conns[i].fd >= 0) serve_conn_close(&conns[i]);
+    }
+    free(conns);
+    for (int i = 0; i < server.cache.count; i++) {
+        serve_file_free(server.cache.files[i]);
+    }
+    close(server.wake[0]);
+    close(server.wake[1]);
+    close(listen_fd);
+    unlink(socket_path);
+    fprintf(stderr, "服务已停止，共处理 %llu 个请求\n", (unsigned long long)server.requests);
+    return 0;
+}
+
+void serve_signal_handler(int sig) {
+    (void)sig;
+    g_serve_stop = 1;
+}
+
+void serve_accept(serve_conn_t* conns, int listen_fd) {
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        int slot = -1;
+        for (int i = 0; i < SERVE_MAX_CONNS && slot < 0; i++) {
+            if (conns[i].fd < 0) slot = i;
+        }
+        if (slot < 0) {
+            // 连接数已满
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        serve_conn_t* conn = &conns[slot];
+        conn->fd = fd;
+        conn->in_len = conn->out_pos = conn->out_len = 0;
+        conn->pending = 0;
+        conn->eof = 0;
+        conn->next_seq = conn->write_seq = 0;
+    }
+}
+
+void serve_read(serve_t* server, serve_conn_t* conns, int slot) {
+    serve_conn_t* conn = &conns[slot];
+    for (;;) {
+        if (conn->in_cap - conn->in_len < 4096) {
+            conn->in_cap = conn->in_cap ? conn->in_cap * 2 : 16384;
+            conn->in = xrealloc(conn->in, conn->in_cap);
+        }
+        ssize_t n = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (n > 0) {
+            conn->in_len += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0) {
+            serve_conn_close(conn);
+            return;
+        }
+        conn->eof = 1;
+        break;
+    }
+
+    // 每个完整的行是一个请求；客户端关闭写端时，最后不带换行的内容也算一个请求
+    size_t pos = 0;
+    for (;;) {
+        char* nl = memchr(conn->in + pos, '\n', conn->in_len - pos);
+        if (!nl) break;
+        serve_submit(server, conns, slot, conn->in + pos, nl - (conn->in + pos));
+        pos = nl - conn->in + 1;
+    }
+    if (conn->eof && pos < conn->in_len) {
+        serve_submit(server, conns, slot, conn->in + pos, conn->in_len - pos);
+        pos = conn->in_len;
+    }
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+
+    if (conn->in_len > SERVE_MAX_REQUEST) {
+        // 错误响应也排在之前的请求之后
+        static const char too_long[] = "{\"ok\":false,\"error\":\"请求过长\"}\n";
+        serve_job_t* job = xmalloc(sizeof(serve_job_t));
+        memset(job, 0, sizeof(serve_job_t));
+        job->seq = conn->next_seq++;
+        job->response = xmalloc(sizeof(too_long) - 1);
+        memcpy(job->response, too_long, sizeof(too_long) - 1);
+        job->response_len = sizeof(too_long) - 1;
+        conn->pending++;
+        serve_conn_deliver(conn, job);
+        conn->in_len = 0;
+        conn->eof = 1;
+    }
+}
+
+void serve_submit(serve_t* server, serve_conn_t* conns, int slot, const char* line, size_t len) {
+    if (len > 0 && line[len - 1] == '\r') len--;
+    size_t start = 0;
+    while (start < len && isspace((unsigned char)line[start])) start++;
+    if (start == len) {
+        return;
+    }
+    serve_job_t* job = xmalloc(sizeof(serve_job_t));
+    memset(job, 0, sizeof(serve_job_t));
+    job->conn = slot;
+    job->generation = conns[slot].generation;
+    job->seq = conns[slot].next_seq++;
+    job->request = xmalloc(len - start + 1);
+    memcpy(job->request, line + start, len - start);
+    job->request[len - start] = '\0';
+    job->request_len = len - start;
+    conns[slot].pending++;
+
+    pthread_mutex_lock(&server->lock);
+    if (server->jobs_tail) {
+        server->jobs_tail->next = job;
+    } else {
+        server->jobs = job;
+    }
+    server->jobs_tail = job;
+    pthread_cond_signal(&server->cond);
+    pthread_mutex_unlock(&server->lock);
+}
+
+void serve_conn_append(serve_conn_t* conn, const char* data, size_t len) {
+    if (conn->out_len + len > conn->out_cap) {
+        if (conn->out_pos > 0) {
+            memmove(conn->out, conn->out + conn->out_pos, conn->out_len - conn->out_pos);
+            conn->out_len -= conn->out_pos;
+            conn->out_pos = 0;
+        }
+        if (conn->out_len + len > conn->out_cap) {
+            size_t cap = conn->out_cap ? conn->out_cap : 16384;
+            while (cap < conn->out_len + len) cap *= 2;
+            conn->out = xrealloc(conn->out, cap);
+            conn->out_cap = cap;
+        }
+    }
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+}
+
+void serve_conn_deliver(serve_conn_t* conn, serve_job_t* job) {
+    // 工作线程完成的顺序不定，先按序号插入等待列表，再写出从 write_seq 开始连续的响应
+    serve_job_t** link = &conn->held;
+    while (*link && (*link)->seq < job->seq) {
+        link = &(*link)->next;
+    }
+    job->next = *link;
+    *link = job;
+    while (conn->held && conn->held->seq == conn->write_seq) {
+        serve_job_t* ready = conn->held;
+        conn->held = ready->next;
+        serve_conn_append(conn, ready->response, ready->response_len);
+        conn->write_seq++;
+        conn->pending--;
+        free(ready->response);
+        free(ready);
+    }
+}
+
+int serve_conn_flush(serve_conn_t* conn) {
+    while (conn->out_pos < conn->out_len) {
+        ssize_t n = send(conn->fd, conn->out + conn->out_pos, conn->out_len - conn->out_pos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        conn->out_pos += n;
+    }
+    conn->out_pos = conn->out_len = 0;
+    return 0;
+}
+
+void serve_conn_close(serve_conn_t* conn) {
+    close(conn->fd);
+    conn->fd = -1;
+    conn->generation++;
+    free(conn->in);
+    free(conn->out);
+    conn->in = conn->out = NULL;
+    conn->in_len = conn->in_cap = 0;
+    conn->out_pos = conn->out_len = conn->out_cap = 0;
+    while (conn->held) {
+        serve_job_t* next = conn->held->next;
+        free(conn->held->response);
+        free(conn->held);
+        conn->held = next;
+    }
+    conn->pending = 0;
+    conn->eof = 0;
+}
+
+void* serve_worker_main(void* arg) {
+    serve_t* server = arg;
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (!server->jobs && !server->stopping) {
+            pthread_cond_wait(&server->cond, &server->lock);
+        }
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            return NULL;
+        }
+        serve_job_t* job = server->jobs;
+        server->jobs = job->next;
+        if (!server->jobs) server->jobs_tail = NULL;
+        pthread_mutex_unlock(&server->lock);
+
+        job->response = serve_handle(server, job->request, job->request_len, &job->response_len);
+        free(job->request);
+        job->request = NULL;
+        job->next = NULL;
+
+        pthread_mutex_lock(&server->done_lock);
+        if (server->done_tail) {
+            server->done_tail->next = job;
+        } else {
+            server->done = job;
+        }
+        server->done_tail = job;
+        server->requests++;
+        pthread_mutex_unlock(&server->done_lock);
+        // 管道写满时事件循环必然会被唤醒，忽略写入失败
+        if (write(server->wake[1], "", 1) < 0) {
+        }
+    }
+}
+
+char* serve_handle(serve_t* server, const char* line, size_t len, size_t* out_len) {
+    char* response = NULL;
+    FILE* out = open_memstream(&response, out_len);
+    if (!out) {
+        fprintf(stderr, "内存不足\n");
+        exit(1);
+    }
+    json_writer_t json;
+    json_init(&json, out, 0);
+    json_begin_object(&json, NULL);
+
+    serve_request_t req;
+    const char* error = serve_parse_request(line, len, &req);
+    if (req.id) {
+        json_write_key(&json, "id");
+        fputs(req.id, out);
+    }
+    static const char* ops[] = { "head", "check", "random", "status" };
+    int op = -1;
+    for (int i = 0; i < 4 && !error && req.op; i++) {
+        if (strcmp(req.op, ops[i]) == 0) op = i;
+    }
+    if (!error && op < 0) {
+        error = "op 必须是 head、check、random 或 status";
+    }
+    serve_file_t* file = NULL;
+    if (!error && op != 3) {
+        if (!req.file) {
+            error = "缺少 file";
+        } else {
+            file = serve_cache_acquire(&server->cache, req.file, &error);
+        }
+    }
+
+    json_bool(&json, "ok", error == NULL);
+    if (req.file) {
+        json_cstring(&json, "file", req.file);
+    }
+    if (error) {
+        json_cstring(&json, "error", error);
+    } else if (op == 0) {
+        serve_do_head(file, &req, &json);
+    } else if (op == 1) {
+        serve_do_check(&server->cache, file, &req, &json);
+    } else if (op == 2) {
+        serve_do_random(&server->cache, file, &req, &json);
+    } else {
+        serve_do_status(server, &json);
+    }
+    json_end_object(&json);
+    fclose(out);
+
+    if (file) {
+        serve_cache_release(&server->cache, file);
+    }
+    serve_request_free(&req);
+    return response;
+}
+
+const char* serve_parse_request(const char* line, size_t len, serve_request_t* req) {
+    memset(req, 0, sizeof(*req));
+    req->n = 10;
+    req->limit = 100;
+
+    // 只接受一层的JSON对象，值为字符串、数字或 true/false/null
+    const char* p = line;
+    const char* end = line + len;
+    while (p < end && isspace((unsigned char)*p)) p++;
+    if (p == end || *p != '{') {
+        return "请求必须是一个JSON对象";
+    }
+    p++;
+    for (;;) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p < end && *p == '}') {
+            break;
+        }
+        char* key = (p < end && *p == '"') ? json_parse_string(&p, end) : NULL;
+        if (!key) {
+            return "请求格式错误";
+        }
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end || *p != ':') {
+            free(key);
+            return "请求格式错误";
+        }
+        p++;
+        while (p < end && isspace((unsigned char)*p)) p++;
+
+        const char* value = p;
+        char* str = NULL;
+        if (p < end && *p == '"') {
+            str = json_parse_string(&p, end);
+        } else {
+            while (p < end && *p != ',' && *p != '}' && !isspace((unsigned char)*p)) p++;
+            char token[64];
+            size_t n = p - value;
+            char* num_end = token;
+            if (n > 0 && n < sizeof(token)) {
+                memcpy(token, value, n);
+                token[n] = '\0';
+                strtod(token, &num_end);
+            }
+            if (n == 0 || n >= sizeof(token) ||
+                (*num_end && strcmp(token, "true") != 0 && strcmp(token, "false") != 0 && strcmp(token, "null") != 0)) {
+                free(key);
+                return "请求格式错误";
+            }
+        }
+        if (value < end && *value == '"' && !str) {
+            free(key);
+            return "请求格式错误";
+        }
+
+        if (strcmp(key, "id") == 0) {
+            free(req->id);
+            req->id = xmalloc(p - value + 1);
+            memcpy(req->id, value, p - value);
+            req->id[p - value] = '\0';
+        } else if (strcmp(key, "op") == 0 && str) {
+            free(req->op);
+            req->op = str;
+            str = NULL;
+        } else if (strcmp(key, "file") == 0 && str) {
+            free(req->file);
+            req->file = str;
+            str = NULL;
+        } else if (strcmp(key, "n") == 0) {
+            req->n = strtoll(str ? str : value, NULL, 10);
+        } else if (strcmp(key, "limit") == 0) {
+            req->limit = strtoll(str ? str : value, NULL, 10);
+        } else if (strcmp(key, "seed") == 0) {
+            req->seed = strtoll(str ? str : value, NULL, 10);
+        }
+        free(key);
+        free(str);
+
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        if (p < end && *p == '}') {
+            break;
+        }
+        return "请求格式错误";
+    }
+    if (!req->op) {
+        return "缺少 op";
+    }
+    return NULL;
+}
+
+void serve_request_free(serve_request_t* req) {
+    free(req->id);
+    free(req->op);
+    free(req->file);
+}
+
+char* json_parse_string(const char** cursor, const char* end) {
+    // *cursor 指向开头的引号，成功时移到结尾引号之后；\uXXXX 转为UTF-8
+    const char* p = *cursor + 1;
+    char* out = xmalloc(end - p + 1);
+    size_t n = 0;
+    while (p < end && *p != '"') {
+        if (*p != '\\') {
+            out[n++] = *p++;
+            continue;
+        }
+        if (++p == end) break;
+        char c = *p++;
+        switch (c) {
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case 'u': {
+                unsigned int code = 0;
+                for (int i = 0; i < 4; i++) {
+                    if (p == end || !isxdigit((unsigned char)*p)) {
+                        free(out);
+                        return NULL;
+                    }
+                    char h = *p++;
+                    code = code * 16 + (isdigit((unsigned char)h) ? h - '0' : (tolower((unsigned char)h) - 'a' + 10));
+                }
+                // 不组合代理对，代理项替换为U+FFFD
+                if (code >= 0xD800 && code <= 0xDFFF) {
+                    code = 0xFFFD;
+                }
+                if (code < 0x80) {
+                    out[n++] = (char)code;
+                } else if (code < 0x800) {
+                    out[n++] = (char)(0xC0 | (code >> 6));
+                    out[n++] = (char)(0x80 | (code & 0x3F));
+                } else {
+                    out[n++] = (char)(0xE0 | (code >> 12));
+                    out[n++] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    out[n++] = (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: out[n++] = c; break;
+        }
+    }
+    if (p == end) {
+        free(out);
+        return NULL;
+    }
+    out[n] = '\0';
+    *cursor = p + 1;
+    return out;
+}
+
+serve_file_t* serve_cache_acquire(serve_cache_t* cache, const char* path, const char** error) {
+    char* real = realpath(path, NULL);
+    struct stat st;
+    if (!real || stat(real, &st) != 0) {
+        free(real);
+        *error = "无法打开文件";
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        free(real);
+        *error = "不是普通文件";
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    serve_file_t* file = NULL;
+    for (int i = 0; i < cache->count; i++) {
+        serve_file_t* cached = cache->files[i];
+        if (strcmp(cached->path, real) != 0) {
+            continue;
+        }
+        if (cached->dev == st.st_dev && cached->ino == st.st_ino && cached->size == st.st_size &&
+            cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            file = cached;
+        } else {
+            // 文件已被修改或替换，重新加载
+            serve_cache_remove(cache, i);
+        }
+        break;
+    }
+    if (file) {
+        cache->hits++;
+        free(real);
+    } else {
+        cache->misses++;
+        if (serve_cache_evict(cache, SERVE_MAX_FILES - 1) != 0) {
+            pthread_mutex_unlock(&cache->lock);
+            free(real);
+            *error = "缓存的文件都在使用中，请稍后重试";
+            return NULL;
+        }
+        file = serve_file_load(real, &st, error);
+        if (!file) {
+            pthread_mutex_unlock(&cache->lock);
+            free(real);
+            return NULL;
+        }
+        cache->files[cache->count++] = file;
+        cache->memory += file->memory;
+    }
+    file->refs++;
+    file->last_used = ++cache->tick;
+    pthread_mutex_unlock(&cache->lock);
+    return file;
+}
+
+void serve_cache_release(serve_cache_t* cache, serve_file_t* file) {
+    pthread_mutex_lock(&cache->lock);
+    file->refs--;
+    if (file->stale) {
+        if (file->refs == 0) serve_file_free(file);
+    } else {
+        serve_cache_evict(cache, SERVE_MAX_FILES);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void serve_cache_remove(serve_cache_t* cache, int index) {
+    serve_file_t* file = cache->files[index];
+    cache->files[index] = cache->files[--cache->count];
+    cache->memory -= file->memory;
+    if (file->refs == 0) {
+        serve_file_free(file);
+    } else {
+        file->stale = 1;
+    }
+}
+
+int serve_cache_evict(serve_cache_t* cache, int max_files) {
+    // 文件数或索引内存超出上限时，淘汰最久未用且没有请求在用的文件
+    while (cache->count > max_files || cache->memory > cache->budget) {
+        int victim = -1;
+        for (int i = 0; i < cache->count; i++) {
+            if (cache->files[i]->refs == 0 &&
+                (victim < 0 || cache->files[i]->last_used < cache->files[victim]->last_used)) {
+                victim = i;
+            }
+        }
+        if (victim < 0) {
+            return cache->count > max_files ? -1 : 0;
+        }
+        serve_cache_remove(cache, victim);
+    }
+    return 0;
+}
+
+serve_file_t* serve_file_load(char* path, const struct stat* st, const char** error) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *error = "无法打开文件";
+        return NULL;
+    }
+    // 用 pread 读入内存而不是映射：文件在使用中被截断时，访问映射会触发 SIGBUS
+    char* data = NULL;
+    size_t size = (size_t)st->st_size;
+    if (size > 0) {
+        data = malloc(size);
+        if (!data) {
+            close(fd);
+            *error = "内存不足，无法缓存文件";
+            return NULL;
+        }
+        size_t got = 0;
+        while (got < size) {
+            ssize_t n = pread(fd, data + got, size - got, (off_t)got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += (size_t)n;
+        }
+        if (got < size) {
+            free(data);
+            close(fd);
+            *error = "文件在读取时被截断，请重试";
+            return NULL;
+        }
+    }
+    close(fd);
+
+    // 读入的内容直接使用，不转码
+    size_t bom = 0;
+    encoding_t encoding = detect_encoding((const unsigned char*)data,
+                                          size < ENCODING_SAMPLE_SIZE ? size : ENCODING_SAMPLE_SIZE, &bom);
+    if (encoding != ENC_UTF8 && encoding != ENC_UTF8_BOM && encoding != ENC_UNKNOWN) {
+        free(data);
+        *error = "服务模式只支持UTF-8文件，其他编码请用命令行处理";
+        return NULL;
+    }
+
+    serve_file_t* file = xmalloc(sizeof(serve_file_t));
+    memset(file, 0, sizeof(serve_file_t));
+    file->path = path;
+    file->dev = st->st_dev;
+    file->ino = st->st_ino;
+    file->size = st->st_size;
+    file->mtime = st->st_mtim;
+    file->data = data;
+    file->memory = size;
+    file->encoding = encoding;
+    file->header_start = bom;
+    pthread_mutex_init(&file->lock, NULL);
+
+    // 分隔符按表头检测，与命令行一致
+    if (size > bom) {
+        const char* nl = memchr(data + bom, '\n', size - bom);
+        file->data_start = nl ? (size_t)(nl - data) + 1 : size;
+        file->header_len = serve_line_length(file, bom);
+        char* header = xmalloc(file->header_len + 1);
+        memcpy(header, data + bom, file->header_len);
+        header[file->header_len] = '\0';
+        file->delim_type = detect_delimiter_in_line(header, &file->delim_char);
+        free(header);
+        file->num_columns = count_fields(data + bom, file->header_len, file->delim_char,
+                                         file->delim_type == DELIM_MULTISPACE);
+    } else {
+        file->data_start = size;
+        file->delim_type = DELIM_UNKNOWN;
+    }
+    return file;
+}
+
+void serve_file_free(serve_file_t* file) {
+    free((void*)file->data);
+    pthread_mutex_destroy(&file->lock);
+    free(file->rows);
+    free(file->bad);
+    free(file->path);
+    free(file);
+}
+
+void serve_file_index(serve_cache_t* cache, serve_file_t* file) {
+    pthread_mutex_lock(&file->lock);
+    if (file->indexed) {
+        pthread_mutex_unlock(&file->lock);
+        return;
+    }
+    size_t size = (size_t)file->size;
+    size_t cap = 0;
+    size_t pos = file->data_start;
+    while (pos < size) {
+        if ((size_t)file->num_rows == cap) {
+            cap = cap ? cap * 2 : 1024;
+            file->rows = xrealloc(file->rows, cap * sizeof(long long));
+        }
+        file->rows[file->num_rows++] = (long long)pos;
+        const char* nl = memchr(file->data + pos, '\n', size - pos);
+        pos = nl ? (size_t)(nl - file->data) + 1 : size;
+    }
+    file->indexed = 1;
+    pthread_mutex_unlock(&file->lock);
+
+    // 索引内存计入缓存预算，超出时在请求结束后淘汰其他文件
+    pthread_mutex_lock(&cache->lock);
+    if (!file->stale) {
+        file->memory += cap * sizeof(long long);
+        cache->memory += cap * sizeof(long long);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void serve_file_check(serve_cache_t* cache, serve_file_t* file) {
+    serve_file_index(cache, file);
+    pthread_mutex_lock(&file->lock);
+    if (!file->checked && file->size > 0) {
+        // 与 check 命令相同：表头决定期望列数，行号从表头的1开始
+        const parse_kernel_t* kernel = parse_kernel_select(file->delim_char, file->delim_type == DELIM_MULTISPACE);
+        file->expected_columns = file->num_columns;
+        file->check_lines = 1;
+        for (long long r = 0; r < file->num_rows; r++) {
+            size_t offset = (size_t)file->rows[r];
+            int columns = kernel->count(file->data + offset, serve_line_length(file, offset));
+            file->check_lines++;
+            if (columns == file->expected_columns) {
+                continue;
+            }
+            file->inconsistent_lines++;
+            if (file->num_bad < SERVE_MAX_REPORT) {
+                if (!file->bad) file->bad = xmalloc(SERVE_MAX_REPORT * sizeof(serve_bad_line_t));
+                file->bad[file->num_bad].line = file->check_lines;
+                file->bad[file->num_bad].columns = columns;
+                file->bad[file->num_bad].offset = (long long)offset;
+                file->num_bad++;
+            }
+        }
+    }
+    file->checked = 1;
+    pthread_mutex_unlock(&file->lock);
+}
+
+size_t serve_line_length(const serve_file_t* file, size_t offset) {
+    size_t avail = (size_t)file->size - offset;
+    const char* nl = memchr(file->data + offset, '\n', avail);
+    size_t n = nl ? (size_t)(nl - (file->data + offset)) : avail;
+    if (n > 0 && file->data[offset + n - 1] == '\r') n--;
+    return n;
+}
+
+void serve_do_head(const serve_file_t* file, const serve_request_t* req, json_writer_t* json) {
+    json_cstring(json, "delimiter", delimiter_keys[file->delim_type]);
+    json_cstring(json, "encoding", encoding_keys[file->encoding]);
+    json_begin_array(json, "columns");
+    if (file->num_columns > 0) {
+        field_t* fields = xmalloc(file->num_columns * sizeof(field_t));
+        int count = split_fields((char*)file->data + file->header_start, file->header_len, file->delim_char,
+                                 file->delim_type == DELIM_MULTISPACE, fields, file->num_columns);
+        for (int i = 0; i < count; i++) {
+            const char* start = fields[i].ptr;
+            const char* end = start + fields[i].len;
+            while (start < end && isspace((unsigned char)*start)) start++;
+            while (end > start && isspace((unsigned char)end[-1])) end--;
+            json_string(json, NULL, start, end - start);
+        }
+        free(fields);
+    }
+    json_end_array(json);
+
+    // 只读前几行，不需要行索引
+    json_begin_array(json, "rows");
+    size_t pos = file->data_start;
+    for (long long i = 0; i < req->n && pos < (size_t)file->size; i++) {
+        json_string(json, NULL, file->data + pos, serve_line_length(file, pos));
+        const char* nl = memchr(file->data + pos, '\n', (size_t)file->size - pos);
+        pos = nl ? (size_t)(nl - file->data) + 1 : (size_t)file->size;
+    }
+    json_end_array(json);
+}
+
+void serve_do_check(serve_cache_t* cache, serve_file_t* file, const serve_request_t* req, json_writer_t* json) {
+    serve_file_check(cache, file);
+    json_cstring(json, "delimiter", delimiter_keys[file->delim_type]);
+    json_int(json, "expected_columns", file->expected_columns);
+    json_int(json, "lines", file->check_lines);
+    json_int(json, "inconsistent_lines", file->inconsistent_lines);
+    json_bool(json, "consistent", file->inconsistent_lines == 0);
+    json_begin_array(json, "inconsistent");
+    for (int i = 0; i < file->num_bad && i < req->limit; i++) {
+        const serve_bad_line_t* bad = &file->bad[i];
+        json_begin_object(json, NULL);
+        json_int(json, "line", bad->line);
+        json_int(json, "columns", bad->columns);
+        json_int(json, "expected", file->expected_columns);
+        json_string(json, "content", file->data + bad->offset, serve_line_length(file, (size_t)bad->offset));
+        json_end_object(json);
+    }
+    json_end_array(json);
+}
+
+void serve_do_random(serve_cache_t* cache, serve_file_t* file, const serve_request_t* req, json_writer_t* json) {
+    serve_file_index(cache, file);
+    long long total = file->num_rows;
+    long long n = req->n < total ? req->n : total;
+    if (n < 0) n = 0;
+
+    uint64_t state = (uint64_t)req->seed;
+    if (!state) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        state = (uint64_t)now.tv_sec * 1000000007ULL ^ (uint64_t)now.tv_nsec ^ (uint64_t)(uintptr_t)&state;
+    }
+
+    // Floyd 算法抽取 n 个不重复的行号，只用 O(n) 内存；已选行号放在开放寻址集合中
+    long long* picked = xmalloc((n > 0 ? n : 1) * sizeof(long long));
+    size_t set_cap = 16;
+    while (set_cap < (size_t)n * 2) set_cap *= 2;
+    long long* set = xmalloc(set_cap * sizeof(long long));
+    memset(set, 0xff, set_cap * sizeof(long long));
+    for (long long j = total - n, k = 0; j < total; j++, k++) {
+        long long t = (long long)(splitmix64_next(&state) % (uint64_t)(j + 1));
+        size_t i = (size_t)splitmix64_next(&(uint64_t){ (uint64_t)t }) & (set_cap - 1);
+        while (set[i] >= 0 && set[i] != t) i = (i + 1) & (set_cap - 1);
+        if (set[i] == t) {
+            // t 已被选过，改选 j（j 不可能已在集合中）
+            t = j;
+            i = (size_t)splitmix64_next(&(uint64_t){ (uint64_t)t }) & (set_cap - 1);
+            while (set[i] >= 0) i = (i + 1) & (set_cap - 1);
+        }
+        set[i] = t;
+        picked[k] = t;
+    }
+    free(set);
+    // Floyd 的结果顺序不随机，再洗牌一次
+    for (long long i = n - 1; i > 0; i--) {
+        long long j = (long long)(splitmix64_next(&state) % (uint64_t)(i + 1));
+        long long temp = picked[i];
+        picked[i] = picked[j];
+        picked[j] = temp;
+    }
+
+    json_int(json, "total_rows", total);
+    json_string(json, "header", file->data ? file->data + file->header_start : "", file->header_len);
+    json_begin_array(json, "rows");
+    for (long long i = 0; i < n; i++) {
+        size_t offset = (size_t)file->rows[picked[i]];
+        json_string(json, NULL, file->data + offset, serve_line_length(file, offset));
+    }
+    json_end_array(json);
+    free(picked);
+}
+
+void serve_do_status(serve_t* server, json_writer_t* json) {
+    pthread_mutex_lock(&server->done_lock);
+    uint64_t requests = server->requests;
+    pthread_mutex_unlock(&server->done_lock);
+
+    serve_cache_t* cache = &server->cache;
+    pthread_mutex_lock(&cache->lock);
+    json_int(json, "requests", (long long)requests);
+    json_int(json, "cache_hits", (long long)cache->hits);
+    json_int(json, "cache_misses", (long long)cache->misses);
+    json_int(json, "cache_memory", (long long)cache->memory);
+    json_begin_array(json, "cached_files");
+    for (int i = 0; i < cache->count; i++) {
+        json_cstring(json, NULL, cache->files[i]->path);
+    }
+    json_end_array(json);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+uint64_t splitmix64_next(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+int client_main(const char* socket_path, int count, char** requests) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "错误: 套接字路径过长: %s\n", socket_path);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    // 服务刚启动时套接字可能还不存在，最多重试约2秒
+    int fd = -1;
+    int err = 0;
+    for (int attempt = 0; attempt < 40; attempt++) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            break;
+        }
+        err = errno;
+        if (fd >= 0) close(fd);
+        fd = -1;
+        if (err != ENOENT && err != ECONNREFUSED) {
+            break;
+        }
+        poll(NULL, 0, 50);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "错误: 无法连接 %s: %s\n", socket_path, strerror(err));
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // 请求来自命令行参数，没有参数时从标准输入逐行读取；发完后关闭写端，
+    // 服务端处理完所有请求再关闭连接
+    FILE* out = fdopen(dup(fd), "w");
+    if (!out) {
+        close(fd);
+        return 1;
+    }
+    if (count > 0) {
+        for (int i = 0; i < count; i++) {
+            fprintf(out, "%s\n", requests[i]);
+        }
+    } else {
+        copy_stream(stdin, out);
+    }
+    fclose(out);
+    shutdown(fd, SHUT_WR);
+
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        fwrite(buffer, 1, n, stdout);
+    }
+    close(fd);
+    return 0;
+}